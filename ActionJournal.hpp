@@ -0,0 +1,370 @@
+#ifndef ACTION_JOURNAL_HPP
+#define ACTION_JOURNAL_HPP
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "DatasetRecorder.hpp"
+#include "PDOGS.hpp"
+#include "ReplayFile.hpp"
+#include "SpscQueue.hpp"
+
+namespace Feis {
+    // On-disk layout, all integers in host byte order like ReplayFile:
+    //
+    // A JournalHeader, then blocks appended as the game goes on. Block: a JournalBlockHeader, then size bytes of
+    // actions encoded as in a replay, the first tick gap counting from the previous block's last action.
+    // elapsedTime is the last tick the block accounts for, so a block with no actions still records that the game
+    // got that far. checksum is FNV-1a over size, elapsedTime and the actions; a crash can leave the last block
+    // partly written, and reading stops at the first block that does not check out.
+    struct JournalHeader {
+        static constexpr std::uint32_t kMagic = 0x4e4a4450; // "PDJN"
+        static constexpr std::uint32_t kVersion = 1;
+
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t engineVersion;
+        std::uint32_t seed;
+        std::int32_t commonDivisor;
+        std::uint32_t reserved;
+    };
+
+    struct JournalBlockHeader {
+        std::uint32_t size;
+        std::int32_t elapsedTime;
+        std::uint64_t checksum;
+    };
+
+    // What survived of a journal: every action up to elapsedTime, the last tick known to have been reached.
+    struct RecoveredJournal {
+        JournalHeader header;
+        std::vector<ReplayAction> actions;
+        int elapsedTime;
+        std::size_t discardedBytes;
+    };
+
+    namespace Journal {
+        inline std::uint64_t GetChecksum(const JournalBlockHeader &block, const std::uint8_t *actions) {
+            std::uint64_t hash = 14695981039346656037ull;
+            const auto add = [&hash](const std::uint8_t *data, const std::size_t size) {
+                for (std::size_t i = 0; i < size; ++i) {
+                    hash = (hash ^ data[i]) * 1099511628211ull;
+                }
+            };
+            add(reinterpret_cast<const std::uint8_t *>(&block.size), sizeof(block.size));
+            add(reinterpret_cast<const std::uint8_t *>(&block.elapsedTime), sizeof(block.elapsedTime));
+            add(actions, block.size);
+            return hash;
+        }
+
+        // Append-only file with an explicit durability point, which std::ofstream does not offer.
+        class File {
+        public:
+            File() = default;
+
+            File(const File &) = delete;
+
+            File &operator=(const File &) = delete;
+
+            ~File() { Close(); }
+
+            bool Open(const std::string &filename) {
+                Close();
+#if defined(_WIN32)
+                handle_ = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                                      FILE_ATTRIBUTE_NORMAL, nullptr);
+                return handle_ != INVALID_HANDLE_VALUE;
+#else
+                fd_ = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                return fd_ >= 0;
+#endif
+            }
+
+            bool Write(const std::uint8_t *data, std::size_t size) {
+                while (size > 0) {
+#if defined(_WIN32)
+                    DWORD written = 0;
+                    if (!WriteFile(handle_, data, static_cast<DWORD>(size), &written, nullptr))
+                        return false;
+#else
+                    const ssize_t written = write(fd_, data, size);
+                    if (written < 0)
+                        return false;
+#endif
+                    data += written;
+                    size -= static_cast<std::size_t>(written);
+                }
+                return true;
+            }
+
+            // Returns once everything written so far is on the disk itself.
+            bool Sync() {
+#if defined(_WIN32)
+                return FlushFileBuffers(handle_) != 0;
+#else
+                return fsync(fd_) == 0;
+#endif
+            }
+
+            void Close() {
+#if defined(_WIN32)
+                if (handle_ != INVALID_HANDLE_VALUE) {
+                    CloseHandle(handle_);
+                    handle_ = INVALID_HANDLE_VALUE;
+                }
+#else
+                if (fd_ >= 0) {
+                    close(fd_);
+                    fd_ = -1;
+                }
+#endif
+            }
+
+        private:
+#if defined(_WIN32)
+            HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+            int fd_ = -1;
+#endif
+        };
+    } // namespace Journal
+
+    // Journals every decision of a game as it is made. Append only hands the decision to a lock-free queue; a
+    // background thread turns whatever has queued up into one block every flushInterval and forces the file to
+    // disk every syncInterval, so a crash loses at most about syncInterval of play and the game thread never
+    // touches the file.
+    class ActionJournal {
+    public:
+        // A whole 9000-tick game is 3000 decisions, so the queue only fills if the disk stalls for a full game.
+        static constexpr std::size_t kQueueCapacity = 4096;
+
+        ActionJournal(std::string filename, const int commonDivisor, const std::uint32_t seed,
+                      const std::chrono::milliseconds flushInterval = std::chrono::milliseconds(100),
+                      const std::chrono::milliseconds syncInterval = std::chrono::milliseconds(1000)) :
+            filename_(std::move(filename)), commonDivisor_(commonDivisor), seed_(seed), flushInterval_(flushInterval),
+            syncInterval_(syncInterval) {}
+
+        ActionJournal(const ActionJournal &) = delete;
+
+        ActionJournal &operator=(const ActionJournal &) = delete;
+
+        ~ActionJournal() { Stop(); }
+
+        // Truncates the file and writes its header durably before any decision is taken.
+        bool Start() {
+            if (thread_.joinable() || !file_.Open(filename_)) {
+                return false;
+            }
+            const JournalHeader header{JournalHeader::kMagic, JournalHeader::kVersion,
+                                       GameManagerConfig::kEngineVersion, seed_, commonDivisor_, 0};
+            failed_ = !file_.Write(reinterpret_cast<const std::uint8_t *>(&header), sizeof(header)) ||
+                      !file_.Sync();
+            lastActionTime_ = 0;
+            writtenElapsedTime_ = 0;
+            stopping_ = false;
+            thread_ = std::thread([this] { Run(); });
+            return !failed_;
+        }
+
+        // Writes and syncs everything appended so far and closes the file.
+        void Stop() {
+            if (!thread_.joinable()) {
+                return;
+            }
+            {
+                std::lock_guard lock(mutex_);
+                stopping_ = true;
+            }
+            wakeWriter_.notify_one();
+            thread_.join();
+            file_.Close();
+        }
+
+        // Game thread only. Waits only when the queue is full, and then without taking any lock.
+        void Append(const int elapsedTime, const PlayerAction &action) {
+            const ReplayAction decision{elapsedTime, action};
+            while (!queue_.TryPush(decision)) {
+                fullQueueCount_.fetch_add(1, std::memory_order_relaxed);
+                std::this_thread::yield();
+            }
+        }
+
+        [[nodiscard]] bool HasFailed() const { return failed_.load(std::memory_order_relaxed); }
+
+        // How often Append found the queue full; anything but 0 means the disk cannot keep up.
+        [[nodiscard]] std::uint64_t GetFullQueueCount() const {
+            return fullQueueCount_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        void Run() {
+            auto lastSync = std::chrono::steady_clock::now();
+            bool unsynced = false;
+            std::unique_lock lock(mutex_);
+            while (true) {
+                const bool stopping = wakeWriter_.wait_for(lock, flushInterval_, [this] { return stopping_; });
+                lock.unlock();
+
+                unsynced = WriteBlock() || unsynced;
+                const auto now = std::chrono::steady_clock::now();
+                if (unsynced && (stopping || now - lastSync >= syncInterval_)) {
+                    if (!file_.Sync()) {
+                        failed_.store(true, std::memory_order_relaxed);
+                    }
+                    lastSync = now;
+                    unsynced = false;
+                }
+                if (stopping) {
+                    return;
+                }
+                lock.lock();
+            }
+        }
+
+        // Drains the queue into one block; returns whether there was anything to write.
+        bool WriteBlock() {
+            block_.resize(sizeof(JournalBlockHeader));
+            int elapsedTime = writtenElapsedTime_;
+            ReplayAction decision{};
+            while (queue_.TryPop(decision)) {
+                elapsedTime = decision.elapsedTime;
+                if (decision.action.type != PlayerActionType::None) {
+                    Dataset::PutVarint(block_, static_cast<std::uint32_t>(decision.elapsedTime - lastActionTime_));
+                    block_.push_back(static_cast<std::uint8_t>(decision.action.type));
+                    Dataset::PutSigned(block_, decision.action.cellPosition.row);
+                    Dataset::PutSigned(block_, decision.action.cellPosition.col);
+                    lastActionTime_ = decision.elapsedTime;
+                }
+            }
+            if (elapsedTime == writtenElapsedTime_) {
+                return false;
+            }
+
+            JournalBlockHeader header{static_cast<std::uint32_t>(block_.size() - sizeof(JournalBlockHeader)),
+                                      elapsedTime, 0};
+            header.checksum = Journal::GetChecksum(header, block_.data() + sizeof(header));
+            std::memcpy(block_.data(), &header, sizeof(header));
+            if (!file_.Write(block_.data(), block_.size())) {
+                failed_.store(true, std::memory_order_relaxed);
+            }
+            writtenElapsedTime_ = elapsedTime;
+            return true;
+        }
+
+        std::string filename_;
+        int commonDivisor_;
+        std::uint32_t seed_;
+        std::chrono::milliseconds flushInterval_;
+        std::chrono::milliseconds syncInterval_;
+        SpscQueue<ReplayAction, kQueueCapacity> queue_;
+        std::atomic<std::uint64_t> fullQueueCount_{0};
+        std::atomic<bool> failed_{false};
+        std::mutex mutex_;
+        std::condition_variable wakeWriter_;
+        bool stopping_ = false;
+        std::thread thread_;
+
+        // Only touched by the writer thread while it runs.
+        Journal::File file_;
+        std::vector<std::uint8_t> block_;
+        int lastActionTime_ = 0;
+        int writtenElapsedTime_ = 0;
+    };
+
+    // Wraps a player so that every decision it makes goes into the journal.
+    class JournalingGamePlayer final : public IGamePlayer {
+    public:
+        JournalingGamePlayer(IGamePlayer *player, ActionJournal *journal) : player_(player), journal_(journal) {}
+
+        PlayerAction GetNextAction(const IGameInfo &info) override {
+            const PlayerAction action = player_->GetNextAction(info);
+            journal_->Append(info.GetElapsedTime(), action);
+            return action;
+        }
+
+    private:
+        IGamePlayer *player_;
+        ActionJournal *journal_;
+    };
+
+    // Reads back every whole block of a journal, including one left behind by a crash. Fails only when the file
+    // cannot be read or does not start with a journal header a game can be started from; the header is not
+    // checksummed, so its level is checked here before RecoverReplay ever simulates it.
+    inline bool ReadJournal(const std::string &filename, RecoveredJournal &out) {
+        Replay::MappedFile file;
+        if (!file.Open(filename) || file.GetSize() < sizeof(JournalHeader)) {
+            return false;
+        }
+        std::memcpy(&out.header, file.GetData(), sizeof(out.header));
+        if (out.header.magic != JournalHeader::kMagic || out.header.version != JournalHeader::kVersion ||
+            out.header.commonDivisor <= 0) {
+            return false;
+        }
+
+        out.actions.clear();
+        out.elapsedTime = 0;
+        std::size_t offset = sizeof(JournalHeader);
+        int lastActionTime = 0;
+        while (file.GetSize() - offset >= sizeof(JournalBlockHeader)) {
+            JournalBlockHeader block{};
+            std::memcpy(&block, file.GetData() + offset, sizeof(block));
+            const std::uint8_t *actions = file.GetData() + offset + sizeof(block);
+            if (block.size > file.GetSize() - offset - sizeof(block) || block.elapsedTime < out.elapsedTime ||
+                block.elapsedTime > static_cast<int>(GameManagerConfig::kEndTime) ||
+                Journal::GetChecksum(block, actions) != block.checksum) {
+                break;
+            }
+
+            const std::size_t actionCount = out.actions.size();
+            ReplayView::Cursor cursor(actions, actions + block.size, lastActionTime);
+            ReplayAction action{};
+            bool consistent = true;
+            while (consistent && cursor.Next(action)) {
+                consistent = action.elapsedTime <= block.elapsedTime;
+                out.actions.push_back(action);
+            }
+            if (!consistent || !cursor.IsAtEnd()) {
+                out.actions.resize(actionCount);
+                break;
+            }
+            lastActionTime = cursor.GetElapsedTime();
+            out.elapsedTime = block.elapsedTime;
+            offset += sizeof(block) + block.size;
+        }
+        out.discardedBytes = file.GetSize() - offset;
+        return true;
+    }
+
+    // Re-runs what a journal recovered and returns it as a replay (see ReplayFile.hpp) ending at the last tick
+    // the journal reached, ready for VerifyReplay or for resuming the game from there.
+    inline std::vector<std::uint8_t> RecoverReplay(const RecoveredJournal &journal) {
+        ScriptedGamePlayer player(&journal.actions);
+        ReplayRecorder recorder(&player, journal.header.commonDivisor, journal.header.seed);
+        GameManager gameManager(&recorder, journal.header.commonDivisor, journal.header.seed);
+        while (gameManager.GetElapsedTime() < journal.elapsedTime && !gameManager.IsGameOver()) {
+            gameManager.Update();
+        }
+        return recorder.Finish(gameManager);
+    }
+} // namespace Feis
+#endif
@@ -0,0 +1,55 @@
+#define PDOGS_TRACK_ALLOCATIONS
+#include <cstdlib>
+#include <iostream>
+#include "AllocationTracker.hpp"
+#include "DifferentialHarness.hpp"
+
+namespace {
+    // Plays RandomGamePlayer's actions until settleTime and then keeps repeating the last one, which can no longer
+    // change the board, so the rest of the game is steady state that still tries a build every time it is asked.
+    class SettlingGamePlayer final : public Feis::IGamePlayer {
+    public:
+        SettlingGamePlayer(const unsigned int seed, const int settleTime) : random_(seed), settleTime_(settleTime) {}
+
+        Feis::PlayerAction GetNextAction(const Feis::IGameInfo &info) override {
+            if (info.GetElapsedTime() < settleTime_) {
+                last_ = random_.GetNextAction(info);
+            }
+            return last_;
+        }
+
+    private:
+        Feis::RandomGamePlayer random_;
+        int settleTime_;
+        Feis::PlayerAction last_{};
+    };
+} // namespace
+
+// Checks that GameManager never allocates once the board stops changing: every game is played by a
+// SettlingGamePlayer and each tick after the last successful build or removal must allocate nothing.
+// Usage: allocation_check [firstSeed] [seedCount]. Exits with 1 at the first game that allocates, after printing it.
+int main(const int argc, char **argv) {
+    const auto firstSeed = static_cast<unsigned int>(argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1);
+    const int seedCount = argc > 2 ? std::atoi(argv[2]) : 20;
+
+    long long steadyStateTicks = 0;
+    for (int k = 0; k < seedCount; ++k) {
+        const unsigned int seed = firstSeed + static_cast<unsigned int>(k);
+        const int commonDivisor = 1 + static_cast<int>(seed % 14);
+
+        SettlingGamePlayer player(seed * 7919u + 1, static_cast<int>(Feis::GameManagerConfig::kEndTime / 2));
+        Feis::GameManager gameManager(&player, commonDivisor, seed);
+        const Feis::SteadyStateAllocationReport report = Feis::RunSteadyStateAllocationCheck(gameManager);
+
+        if (!report.Passed()) {
+            std::cout << "seed " << seed << " divisor " << commonDivisor << ": tick " << report.firstAllocatingTick
+                      << " allocated, " << report.allocatingTicks << " of " << report.steadyStateTicks
+                      << " steady-state ticks allocated " << report.steadyStateTotal.allocations << " times ("
+                      << report.steadyStateTotal.bytes << " B)\n";
+            return 1;
+        }
+        steadyStateTicks += report.steadyStateTicks;
+    }
+    std::cout << seedCount << " games, " << steadyStateTicks << " steady-state ticks: none allocated\n";
+    return 0;
+}
@@ -0,0 +1,224 @@
+#ifndef ALLOCATION_TRACKER_HPP
+#define ALLOCATION_TRACKER_HPP
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <ostream>
+#include <vector>
+#include "PDOGS.hpp"
+
+// Define PDOGS_TRACK_ALLOCATIONS in exactly one translation unit before including this header to install the
+// counting operator new/delete. Without it every counter stays at zero and IsAllocationTrackingEnabled() is false.
+
+namespace Feis {
+    struct AllocationCounters {
+        static inline std::atomic<std::size_t> allocations{0};
+        static inline std::atomic<std::size_t> bytes{0};
+        static inline thread_local std::size_t threadAllocations = 0;
+        static inline thread_local std::size_t threadBytes = 0;
+        static inline bool enabled = false;
+
+        static void Record(const std::size_t size) {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(size, std::memory_order_relaxed);
+            threadAllocations += 1;
+            threadBytes += size;
+        }
+    };
+
+    inline bool IsAllocationTrackingEnabled() { return AllocationCounters::enabled; }
+
+    struct AllocationCount {
+        std::size_t allocations;
+        std::size_t bytes;
+    };
+
+    // Counts only the calling thread, so a renderer or network thread never pollutes the simulation's ticks.
+    class TickAllocationCounter {
+    public:
+        void BeginTick() {
+            begin_ = {AllocationCounters::threadAllocations, AllocationCounters::threadBytes};
+        }
+
+        void EndTick() {
+            last_ = {AllocationCounters::threadAllocations - begin_.allocations,
+                     AllocationCounters::threadBytes - begin_.bytes};
+            total_.allocations += last_.allocations;
+            total_.bytes += last_.bytes;
+            if (last_.allocations != 0) {
+                allocatingTicks_ += 1;
+            }
+        }
+
+        [[nodiscard]] AllocationCount GetLastTick() const { return last_; }
+
+        [[nodiscard]] AllocationCount GetTotal() const { return total_; }
+
+        [[nodiscard]] std::size_t GetAllocatingTicks() const { return allocatingTicks_; }
+
+    private:
+        AllocationCount begin_{};
+        AllocationCount last_{};
+        AllocationCount total_{};
+        std::size_t allocatingTicks_{};
+    };
+
+    struct SteadyStateAllocationReport {
+        bool trackingEnabled;
+        int lastBoardChangeTime;
+        int steadyStateTicks;
+        int allocatingTicks;
+        int firstAllocatingTick;
+        AllocationCount steadyStateTotal;
+
+        [[nodiscard]] bool Passed() const { return allocatingTicks == 0; }
+    };
+
+    // Runs the game to the end and checks that no tick after the last successful build or removal allocated.
+    // The per-tick log is reserved up front so the check itself never allocates inside the measured window.
+    inline SteadyStateAllocationReport RunSteadyStateAllocationCheck(GameManager &gameManager) {
+        std::vector<AllocationCount> perTick(static_cast<std::size_t>(gameManager.GetEndTime()) + 1);
+        TickAllocationCounter counter;
+
+        while (!gameManager.IsGameOver()) {
+            counter.BeginTick();
+            gameManager.Update();
+            counter.EndTick();
+            perTick[gameManager.GetElapsedTime()] = counter.GetLastTick();
+        }
+
+        SteadyStateAllocationReport report{IsAllocationTrackingEnabled(), gameManager.GetLastBoardChangeTime(), 0, 0,
+                                           -1, {}};
+
+        for (int tick = report.lastBoardChangeTime + 1; tick <= gameManager.GetElapsedTime(); ++tick) {
+            report.steadyStateTicks += 1;
+            if (perTick[tick].allocations != 0) {
+                if (report.firstAllocatingTick < 0) {
+                    report.firstAllocatingTick = tick;
+                }
+                report.allocatingTicks += 1;
+                report.steadyStateTotal.allocations += perTick[tick].allocations;
+                report.steadyStateTotal.bytes += perTick[tick].bytes;
+            }
+        }
+        return report;
+    }
+
+    struct MemoryFootprint {
+        enum Kind { kNumber, kCollectionCenter, kMiningMachine, kConveyor, kCombiner, kWall, kKindCount };
+
+        static constexpr std::size_t kSharedControlBlockSize = 2 * sizeof(long) + sizeof(void *);
+
+        std::array<std::size_t, kKindCount> counts;
+        std::array<std::size_t, kKindCount> bytes;
+        std::size_t gameManagerBytes;
+        std::size_t layeredCellBytes;
+
+        [[nodiscard]] std::size_t GetTotalBytes() const {
+            std::size_t total = gameManagerBytes;
+            for (const auto b: bytes) {
+                total += b;
+            }
+            return total;
+        }
+
+        [[nodiscard]] double GetBytesPerCell() const {
+            return static_cast<double>(GetTotalBytes()) /
+                   (GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight);
+        }
+    };
+
+    class MemoryFootprintVisitor final : public CellVisitor {
+    public:
+        explicit MemoryFootprintVisitor(MemoryFootprint *footprint) : footprint_(footprint) {}
+
+        void Visit(const NumberCell *cell) const override { Add<NumberCell>(MemoryFootprint::kNumber); }
+
+        void Visit(const CollectionCenterCell *cell) const override {
+            Add<CollectionCenterCell>(MemoryFootprint::kCollectionCenter);
+        }
+
+        void Visit(const MiningMachineCell *cell) const override {
+            Add<MiningMachineCell>(MemoryFootprint::kMiningMachine);
+        }
+
+        void Visit(const ConveyorCell *cell) const override { Add<ConveyorCell>(MemoryFootprint::kConveyor); }
+
+        void Visit(const CombinerCell *cell) const override { Add<CombinerCell>(MemoryFootprint::kCombiner); }
+
+        void Visit(const WallCell *cell) const override { Add<WallCell>(MemoryFootprint::kWall); }
+
+    private:
+        template<typename TCell>
+        void Add(const MemoryFootprint::Kind kind) const {
+            footprint_->counts[kind] += 1;
+            footprint_->bytes[kind] += sizeof(TCell) + MemoryFootprint::kSharedControlBlockSize;
+        }
+
+        MemoryFootprint *footprint_;
+    };
+
+    inline MemoryFootprint GetMemoryFootprint(const GameManager &gameManager) {
+        MemoryFootprint footprint{};
+        footprint.gameManagerBytes = sizeof(GameManager);
+        footprint.layeredCellBytes = sizeof(LayeredCell);
+
+        const MemoryFootprintVisitor visitor(&footprint);
+
+        for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+            for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                const auto &layeredCell = gameManager.GetLayeredCell({row, col});
+
+                if (const auto &background = layeredCell.GetBackground()) {
+                    background->Accept(&visitor);
+                }
+                if (const auto &foreground = layeredCell.GetForeground()) {
+                    if (foreground->GetTopLeftCellPosition() == CellPosition{row, col}) {
+                        foreground->Accept(&visitor);
+                    }
+                }
+            }
+        }
+        return footprint;
+    }
+
+    inline void PrintMemoryFootprint(std::ostream &out, const MemoryFootprint &footprint) {
+        static constexpr const char *kNames[] = {"number",   "collection center", "mining machine",
+                                                 "conveyor", "combiner",          "wall"};
+
+        out << "GameManager (board inline, " << footprint.layeredCellBytes << " B per layered cell): "
+            << footprint.gameManagerBytes << " B\n";
+        for (int kind = 0; kind < MemoryFootprint::kKindCount; ++kind) {
+            out << std::setw(18) << kNames[kind] << ": " << std::setw(5) << footprint.counts[kind] << " x "
+                << (footprint.counts[kind] ? footprint.bytes[kind] / footprint.counts[kind] : 0) << " B = "
+                << footprint.bytes[kind] << " B\n";
+        }
+        out << "total: " << footprint.GetTotalBytes() << " B (" << std::fixed << std::setprecision(1)
+            << footprint.GetBytesPerCell() << " B per cell)\n";
+    }
+} // namespace Feis
+
+#ifdef PDOGS_TRACK_ALLOCATIONS
+namespace Feis {
+    struct AllocationTrackingInstaller {
+        AllocationTrackingInstaller() { AllocationCounters::enabled = true; }
+    };
+
+    inline const AllocationTrackingInstaller allocationTrackingInstaller;
+} // namespace Feis
+
+void *operator new(const std::size_t size) {
+    Feis::AllocationCounters::Record(size);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+#endif
+#endif
@@ -0,0 +1,21 @@
+#include <cstdlib>
+#include <iostream>
+#include "BatchEnvironment.hpp"
+#include "DifferentialHarness.hpp"
+
+// Checks BatchEnvironment against GameManager: every game is played by both with the same random actions and their
+// states are compared after every tick. Usage: batch_check [firstSeed] [seedCount]. Exits with 1 on the first
+// divergence, after printing it.
+int main(const int argc, char **argv) {
+    const auto firstSeed = static_cast<unsigned int>(argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1);
+    const int seedCount = argc > 2 ? std::atoi(argv[2]) : 70;
+
+    Feis::DifferentialHarness<Feis::BatchGameAdapter> harness;
+    if (const auto divergence = harness.Run(firstSeed, seedCount)) {
+        Feis::PrintDivergence(std::cout, *divergence);
+        return 1;
+    }
+    std::cout << harness.GetGamesCompared() << " games, " << harness.GetTicksCompared()
+              << " ticks: BatchEnvironment matches GameManager\n";
+    return 0;
+}
@@ -0,0 +1,795 @@
+#ifndef BATCH_ENVIRONMENT_HPP
+#define BATCH_ENVIRONMENT_HPP
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "CellState.hpp"
+#include "PDOGS.hpp"
+
+// Every game is independent of every other, so the loops over games carry no dependencies; telling the compiler
+// spares it the run-time overlap checks it would otherwise give up on.
+#if defined(__clang__)
+#define PDOGS_INDEPENDENT_GAMES _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define PDOGS_INDEPENDENT_GAMES _Pragma("GCC ivdep")
+#else
+#define PDOGS_INDEPENDENT_GAMES
+#endif
+
+namespace Feis {
+    // Many independent games stepped together, for evaluating players on thousands of seeds. Games are grouped in
+    // blocks of kBlockSize and each block is kept structure-of-arrays with the game innermost: cell c of lane l
+    // lives at [c * kBlockSize + l] of its block, conveyor slot s at [(c * kSlotCount + s) * kBlockSize + l]. The
+    // board is stored with a one-cell empty border, so every cell has four neighbours at fixed offsets and "off the
+    // board" is just a cell that never has room.
+    //
+    // A tick walks each block's cells in the same row-major order as GameBoard::Update and, at each cell, runs
+    // branch-free loops over the block's lanes: every lane reads its four neighbours as contiguous streams and
+    // selects the one it points at, so the loops have no gathers or scatters and the compiler vectorizes them (at
+    // -O3; -march=native widens them further). Per game the result is exactly what its own GameManager would
+    // compute. Cells are only visited on ticks where something there can move in at least one of the block's games:
+    // a conveyor carries a product, a combiner is full, or a mining machine's cycle ends. Mining machines keep the
+    // phase their cycle ends on instead of counting, so the rest of the time they cost nothing.
+    class BatchEnvironment {
+    public:
+        static constexpr int kSlotCount = static_cast<int>(GameManagerConfig::kConveyorBufferSize);
+        static constexpr int kBlockSize = 64;
+
+        // Combiners are split into the cell that sends (main) and the one that only holds the second slot.
+        enum class Kind : std::uint8_t {
+            kEmpty,
+            kWall,
+            kCollectionCenter,
+            kMiningMachine,
+            kConveyor,
+            kCombinerMain,
+            kCombinerSecond,
+        };
+
+        // Every game still needs a Reset before its first step.
+        explicit BatchEnvironment(const int gameCount) :
+            gameCount_(gameCount), blockCount_((gameCount + kBlockSize - 1) / kBlockSize),
+            kinds_(Size(kPaddedCellCount), Kind::kEmpty), directions_(Size(kPaddedCellCount)),
+            rooms_(Size(kPaddedCellCount)), anchors_(Size(kPaddedCellCount)), numbers_(Size(kPaddedCellCount)),
+            products_(Size(kPaddedCellCount * kSlotCount)), loadedConveyors_(blockCount_ * kPaddedCellCount),
+            waitingCombiners_(blockCount_ * kPaddedCellCount), commonDivisors_(Size(1), 1), scores_(Size(1)),
+            elapsedTimes_(Size(1), GameManagerConfig::kEndTime), resetSteps_(Size(1)), miningPhases_(Size(1)),
+            live_(Size(1)), scheduledMiners_(GetSchedule(blockCount_, 0)), sends_(kBlockSize),
+            combines_(kBlockSize) {}
+
+        [[nodiscard]] int GetGameCount() const { return gameCount_; }
+
+        // Same board as GameManager(player, commonDivisor, seed) builds, with the game's clock back at zero.
+        void Reset(const int game, const int commonDivisor, const unsigned int seed) {
+            std::mt19937 backgroundGen(seed);
+            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                    const int cell = ToIndex({row, col});
+                    const int value = static_cast<int>(backgroundGen() % 30);
+                    const bool isNumber = value == 1 || value == 2 || value == 3 || value == 5 || value == 7 ||
+                                          value == 11 || value == 13;
+                    Clear(game, cell);
+                    At(numbers_, cell, game) = isNumber ? value : 0;
+                }
+            }
+
+            constexpr int kGoalSize = static_cast<int>(GameManagerConfig::kGoalSize);
+            const int centerTopLeft =
+                    ToIndex({GameManager::CollectionCenterConfig::kTop, GameManager::CollectionCenterConfig::kLeft});
+            for (int i = 0; i < kGoalSize; ++i) {
+                for (int j = 0; j < kGoalSize; ++j) {
+                    const int cell = centerTopLeft + i * kPaddedWidth + j;
+                    At(kinds_, cell, game) = Kind::kCollectionCenter;
+                    At(rooms_, cell, game) = kFullRoom;
+                    At(anchors_, cell, game) = centerTopLeft;
+                }
+            }
+
+            std::mt19937 wallGen(seed);
+            for (int k = 1; k <= GameManagerConfig::kNumberOfWalls; ++k) {
+                const int row = static_cast<int>(wallGen() % GameManagerConfig::kBoardHeight);
+                const int col = static_cast<int>(wallGen() % GameManagerConfig::kBoardWidth);
+                if (At(kinds_, ToIndex({row, col}), game) == Kind::kEmpty) {
+                    At(kinds_, ToIndex({row, col}), game) = Kind::kWall;
+                }
+            }
+
+            commonDivisors_[game] = commonDivisor;
+            scores_[game] = 0;
+            elapsedTimes_[game] = 0;
+            resetSteps_[game] = steps_ % kMiningInterval;
+            miningPhases_[game] = 0;
+        }
+
+        // One GameManager::Update for every game that is not over yet: actions[g] is applied to game g on the
+        // ticks its GameManager would ask the player for one, and ignored on the others.
+        void StepAll(const PlayerAction *actions) {
+            steps_ += 1;
+            for (int game = 0; game < gameCount_; ++game) {
+                live_[game] = MaskOf(elapsedTimes_[game] < GetEndTime());
+                if (live_[game] == 0)
+                    continue;
+
+                elapsedTimes_[game] += 1;
+                miningPhases_[game] = elapsedTimes_[game] % kMiningInterval;
+                if (elapsedTimes_[game] % 3 == 0) {
+                    ApplyPlayerAction(game, actions[game]);
+                }
+            }
+
+            const int stepPhase = steps_ % kMiningInterval;
+
+            for (int block = 0; block < blockCount_; ++block) {
+                std::uint8_t *loadedConveyors = &loadedConveyors_[block * kPaddedCellCount];
+                std::uint8_t *waitingCombiners = &waitingCombiners_[block * kPaddedCellCount];
+                const std::uint8_t *miners = &scheduledMiners_[GetSchedule(block, stepPhase)];
+                for (int cell = kFirstCell; cell <= kLastCell; ++cell) {
+                    if ((loadedConveyors[cell] | waitingCombiners[cell] | miners[cell]) != 0) {
+                        waitingCombiners[cell] = UpdatePassOne(block, cell);
+                    }
+                }
+                for (int cell = kFirstCell; cell <= kLastCell; ++cell) {
+                    if (loadedConveyors[cell] != 0) {
+                        loadedConveyors[cell] = UpdatePassTwo(block, cell);
+                    }
+                }
+            }
+        }
+
+        // Whether the next StepAll applies this game's action.
+        [[nodiscard]] bool IsAskingForAction(const int game) const {
+            return !IsGameOver(game) && (elapsedTimes_[game] + 1) % 3 == 0;
+        }
+
+        [[nodiscard]] static constexpr int GetEndTime() { return GameManagerConfig::kEndTime; }
+
+        [[nodiscard]] bool IsGameOver(const int game) const { return elapsedTimes_[game] >= GetEndTime(); }
+
+        [[nodiscard]] int GetElapsedTime(const int game) const { return elapsedTimes_[game]; }
+
+        [[nodiscard]] int GetScores(const int game) const { return scores_[game]; }
+
+        [[nodiscard]] int GetCommonDivisor(const int game) const { return commonDivisors_[game]; }
+
+        [[nodiscard]] Kind GetKind(const int game, const CellPosition cellPosition) const {
+            return At(kinds_, ToIndex(cellPosition), game);
+        }
+
+        // The background number under a cell, 0 where there is none.
+        [[nodiscard]] int GetNumber(const int game, const CellPosition cellPosition) const {
+            return At(numbers_, ToIndex(cellPosition), game);
+        }
+
+        [[nodiscard]] CellState GetCellState(const int game, const CellPosition cellPosition) const {
+            const int cell = ToIndex(cellPosition);
+            const auto direction = static_cast<Direction>(At(directions_, cell, game));
+            CellState state{CellKind::kEmpty, Direction::kTop, ToPosition(At(anchors_, cell, game)), {}};
+
+            switch (At(kinds_, cell, game)) {
+                case Kind::kEmpty:
+                    break;
+                case Kind::kWall:
+                    state.kind = CellKind::kWall;
+                    break;
+                case Kind::kCollectionCenter:
+                    state.kind = CellKind::kCollectionCenter;
+                    break;
+                case Kind::kMiningMachine:
+                    state.kind = CellKind::kMiningMachine;
+                    state.direction = direction;
+                    state.products[0] = (miningPhases_[game] - GetProduct(cell, 0, game) + kMiningInterval) %
+                                         kMiningInterval;
+                    break;
+                case Kind::kConveyor:
+                    state.kind = CellKind::kConveyor;
+                    state.direction = direction;
+                    for (int slot = 0; slot < kSlotCount; ++slot) {
+                        state.products[slot] = GetProduct(cell, slot, game);
+                    }
+                    break;
+                case Kind::kCombinerMain:
+                    state.kind = CellKind::kCombiner;
+                    state.direction = direction;
+                    state.products[0] = GetProduct(cell, 0, game);
+                    state.products[1] = GetProduct(GetPartner(cell, direction), 0, game);
+                    break;
+                case Kind::kCombinerSecond:
+                    state.kind = CellKind::kCombiner;
+                    state.direction = direction;
+                    state.products[0] = GetProduct(GetMain(cell, direction), 0, game);
+                    state.products[1] = GetProduct(cell, 0, game);
+                    break;
+            }
+            return state;
+        }
+
+        // GetCellState of every cell of games [begin, end), reduced to what fits in a few planes: function is
+        // called as function(game, i, kind, direction, heldProducts, products[0], products[1]) with i the cell's
+        // row-major index, kind and direction as in CellState. Reads the arrays directly and walks the games of a
+        // cell together, so every cache line of a block is read once however many of its games are asked for.
+        template<typename TFunction>
+        void ForEachCellSummary(const int begin, const int end, TFunction function) const {
+            // Indexed by Kind.
+            constexpr CellKind kCellKinds[] = {CellKind::kEmpty, CellKind::kWall, CellKind::kCollectionCenter,
+                                               CellKind::kMiningMachine, CellKind::kConveyor, CellKind::kCombiner,
+                                               CellKind::kCombiner};
+            int i = 0;
+            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col, ++i) {
+                    const int cell = ToIndex({row, col});
+                    for (int game = begin; game < end; ++game) {
+                        const std::size_t lanes = GetLanes(game / kBlockSize, cell);
+                        const int lane = game % kBlockSize;
+                        const Kind kind = kinds_[lanes + lane];
+                        const int *slots = &products_[lanes * kSlotCount + lane];
+                        const int direction = kind <= Kind::kCollectionCenter ? 0 : directions_[lanes + lane];
+
+                        int held = 0;
+                        int first = 0;
+                        int second = 0;
+                        if (kind == Kind::kConveyor) {
+                            for (int slot = 0; slot < kSlotCount; ++slot) {
+                                held += slots[slot * kBlockSize] != 0 ? 1 : 0;
+                            }
+                            first = slots[0];
+                            second = slots[kBlockSize];
+                        } else if (kind == Kind::kMiningMachine) {
+                            const int cycle = miningPhases_[game] - slots[0];
+                            first = cycle < 0 ? cycle + kMiningInterval : cycle;
+                        } else if (kind == Kind::kCombinerMain) {
+                            first = slots[0];
+                            second = GetProduct(GetPartner(cell, static_cast<Direction>(direction)), 0, game);
+                            held = (first != 0 ? 1 : 0) + (second != 0 ? 1 : 0);
+                        } else if (kind == Kind::kCombinerSecond) {
+                            first = GetProduct(GetMain(cell, static_cast<Direction>(direction)), 0, game);
+                            second = slots[0];
+                            held = (first != 0 ? 1 : 0) + (second != 0 ? 1 : 0);
+                        }
+                        function(game, i, kCellKinds[static_cast<int>(kind)], direction, held, first, second);
+                    }
+                }
+            }
+        }
+
+    private:
+        static constexpr int kPaddedWidth = GameManagerConfig::kBoardWidth + 2;
+        static constexpr int kPaddedCellCount = kPaddedWidth * (GameManagerConfig::kBoardHeight + 2);
+        static constexpr int kFirstCell = kPaddedWidth + 1;
+        static constexpr int kLastCell =
+                GameManagerConfig::kBoardHeight * kPaddedWidth + GameManagerConfig::kBoardWidth;
+        static constexpr int kMiningInterval = 100;
+        // A cell's room is how many of GetNeighborCapacity's >= 1, 2 and 3 it meets: the number of empty slots at
+        // the back of a conveyor, at most three; all of them for a collection center or a combiner cell with an
+        // empty slot; none for anything else.
+        static constexpr std::uint8_t kFullRoom = 3;
+
+        static int ToIndex(const CellPosition cellPosition) {
+            return (cellPosition.row + 1) * kPaddedWidth + cellPosition.col + 1;
+        }
+
+        static CellPosition ToPosition(const int cell) { return {cell / kPaddedWidth - 1, cell % kPaddedWidth - 1}; }
+
+        // In Direction order: top, right, bottom, left.
+        static constexpr int GetOffset(const int direction) {
+            constexpr int kOffsets[] = {-kPaddedWidth, 1, kPaddedWidth, -1};
+            return kOffsets[direction];
+        }
+
+        // A combiner's main cell finds its other cell a quarter turn anticlockwise from where it sends.
+        static int GetPartner(const int cell, const Direction direction) {
+            return cell + GetOffset((static_cast<int>(direction) + 3) % 4);
+        }
+
+        static int GetMain(const int cell, const Direction direction) {
+            return cell - GetOffset((static_cast<int>(direction) + 3) % 4);
+        }
+
+
+        static bool IsRemovable(const Kind kind) {
+            return kind == Kind::kMiningMachine || kind == Kind::kConveyor || kind == Kind::kCombinerMain ||
+                   kind == Kind::kCombinerSecond;
+        }
+
+        // Room for that many values per game, the last block padded with lanes that never run.
+        [[nodiscard]] std::size_t Size(const int count) const {
+            return static_cast<std::size_t>(count) * blockCount_ * kBlockSize;
+        }
+
+        // Where lane 0 of a block's cell starts in the per-cell arrays.
+        static std::size_t GetLanes(const int block, const int cell) {
+            return (static_cast<std::size_t>(block) * kPaddedCellCount + cell) * kBlockSize;
+        }
+
+        template<typename T>
+        [[nodiscard]] T &At(std::vector<T> &values, const int cell, const int game) {
+            return values[GetLanes(game / kBlockSize, cell) + game % kBlockSize];
+        }
+
+        template<typename T>
+        [[nodiscard]] const T &At(const std::vector<T> &values, const int cell, const int game) const {
+            return values[GetLanes(game / kBlockSize, cell) + game % kBlockSize];
+        }
+
+        [[nodiscard]] int *GetSlots(const int block, const int cell, const int slot) {
+            return &products_[GetLanes(block, cell) * kSlotCount + slot * kBlockSize];
+        }
+
+        [[nodiscard]] int GetProduct(const int cell, const int slot, const int game) const {
+            return products_[GetLanes(game / kBlockSize, cell) * kSlotCount + slot * kBlockSize + game % kBlockSize];
+        }
+
+        // Per block and step phase, how many games have a mining machine at each cell that produces on steps
+        // of that phase.
+        [[nodiscard]] static std::size_t GetSchedule(const int block, const int stepPhase) {
+            return (static_cast<std::size_t>(block) * kMiningInterval + stepPhase) * kPaddedCellCount;
+        }
+
+        [[nodiscard]] std::uint8_t &GetScheduledMiners(const int game, const int cell) {
+            const int fires = GetSlots(game / kBlockSize, cell, 0)[game % kBlockSize];
+            return scheduledMiners_[GetSchedule(game / kBlockSize, (fires + resetSteps_[game]) % kMiningInterval) +
+                                    cell];
+        }
+
+        void Clear(const int game, const int cell) {
+            if (At(kinds_, cell, game) == Kind::kMiningMachine) {
+                GetScheduledMiners(game, cell) -= 1;
+            }
+            At(kinds_, cell, game) = Kind::kEmpty;
+            At(rooms_, cell, game) = 0;
+            At(anchors_, cell, game) = cell;
+            for (int slot = 0; slot < kSlotCount; ++slot) {
+                GetSlots(game / kBlockSize, cell, slot)[game % kBlockSize] = 0;
+            }
+        }
+
+        bool Build(const int game, const CellPosition topLeft, const Kind kind, const Direction direction) {
+            const bool isCombiner = kind == Kind::kCombinerMain;
+            const bool isHorizontal = direction == Direction::kTop || direction == Direction::kBottom;
+            const int width = isCombiner && isHorizontal ? 2 : 1;
+            const int height = isCombiner && !isHorizontal ? 2 : 1;
+
+            if (topLeft.col < 0 || topLeft.col + width > GameManagerConfig::kBoardWidth || topLeft.row < 0 ||
+                topLeft.row + height > GameManagerConfig::kBoardHeight) {
+                return false;
+            }
+
+            const int anchor = ToIndex(topLeft);
+            const int other = anchor + (isHorizontal ? 1 : kPaddedWidth);
+            if (At(kinds_, anchor, game) != Kind::kEmpty || (isCombiner && At(kinds_, other, game) != Kind::kEmpty)) {
+                return false;
+            }
+
+            if (!isCombiner) {
+                At(kinds_, anchor, game) = kind;
+                At(directions_, anchor, game) = static_cast<std::uint8_t>(direction);
+                At(rooms_, anchor, game) = kind == Kind::kConveyor ? kFullRoom : 0;
+                if (kind == Kind::kMiningMachine) {
+                    // The machine counts this tick too, so it produces on the elapsed times one short of a multiple
+                    // of kMiningInterval after now; that phase is what its slot 0 keeps.
+                    GetSlots(game / kBlockSize, anchor, 0)[game % kBlockSize] =
+                            (elapsedTimes_[game] + kMiningInterval - 1) % kMiningInterval;
+                    GetScheduledMiners(game, anchor) += 1;
+                }
+                return true;
+            }
+
+            const bool anchorIsMain = direction == Direction::kBottom || direction == Direction::kLeft;
+            At(kinds_, anchorIsMain ? anchor : other, game) = Kind::kCombinerMain;
+            At(kinds_, anchorIsMain ? other : anchor, game) = Kind::kCombinerSecond;
+            for (const int cell: {anchor, other}) {
+                At(directions_, cell, game) = static_cast<std::uint8_t>(direction);
+                At(rooms_, cell, game) = kFullRoom;
+                At(anchors_, cell, game) = anchor;
+            }
+            return true;
+        }
+
+        bool Remove(const int game, const CellPosition cellPosition) {
+            if (!IsWithinBoard(cellPosition))
+                return false;
+
+            const int cell = ToIndex(cellPosition);
+            const Kind kind = At(kinds_, cell, game);
+            if (!IsRemovable(kind))
+                return false;
+
+            const auto direction = static_cast<Direction>(At(directions_, cell, game));
+            if (kind == Kind::kCombinerMain) {
+                Clear(game, GetPartner(cell, direction));
+            } else if (kind == Kind::kCombinerSecond) {
+                Clear(game, GetMain(cell, direction));
+            }
+            Clear(game, cell);
+            return true;
+        }
+
+        bool ApplyPlayerAction(const int game, const PlayerAction &playerAction) {
+            const CellPosition position = playerAction.cellPosition;
+            switch (playerAction.type) {
+                case PlayerActionType::None:
+                    return false;
+                case PlayerActionType::BuildLeftOutMiningMachine:
+                    return Build(game, position, Kind::kMiningMachine, Direction::kLeft);
+                case PlayerActionType::BuildTopOutMiningMachine:
+                    return Build(game, position, Kind::kMiningMachine, Direction::kTop);
+                case PlayerActionType::BuildRightOutMiningMachine:
+                    return Build(game, position, Kind::kMiningMachine, Direction::kRight);
+                case PlayerActionType::BuildBottomOutMiningMachine:
+                    return Build(game, position, Kind::kMiningMachine, Direction::kBottom);
+                case PlayerActionType::BuildLeftToRightConveyor:
+                    return Build(game, position, Kind::kConveyor, Direction::kRight);
+                case PlayerActionType::BuildTopToBottomConveyor:
+                    return Build(game, position, Kind::kConveyor, Direction::kBottom);
+                case PlayerActionType::BuildRightToLeftConveyor:
+                    return Build(game, position, Kind::kConveyor, Direction::kLeft);
+                case PlayerActionType::BuildBottomToTopConveyor:
+                    return Build(game, position, Kind::kConveyor, Direction::kTop);
+                case PlayerActionType::BuildTopOutCombiner:
+                    return Build(game, position, Kind::kCombinerMain, Direction::kTop);
+                case PlayerActionType::BuildRightOutCombiner:
+                    return Build(game, position, Kind::kCombinerMain, Direction::kRight);
+                case PlayerActionType::BuildBottomOutCombiner:
+                    return Build(game, position, Kind::kCombinerMain, Direction::kBottom);
+                case PlayerActionType::BuildLeftOutCombiner:
+                    return Build(game, position, Kind::kCombinerMain, Direction::kLeft);
+                case PlayerActionType::Clear:
+                    return Remove(game, position);
+            }
+            return false;
+        }
+
+        // All ones where condition holds. The kernels combine values with masks rather than ?:, since chains of
+        // conditionals turn into control flow the compiler does not vectorize.
+        static int MaskOf(const bool condition) { return -static_cast<int>(condition); }
+
+        static int Blend(const int mask, const int ifSet, const int otherwise) {
+            return (ifSet & mask) | (otherwise & ~mask);
+        }
+
+        // The value of the neighbour a direction points at, in Direction order.
+        static int Select(const int direction, const int top, const int right, const int bottom, const int left) {
+            const int odd = MaskOf((direction & 1) != 0);
+            return Blend(MaskOf((direction & 2) != 0), Blend(odd, left, bottom), Blend(odd, right, top));
+        }
+
+        // Conveyors, mining machines and combiner main cells of one block's games at one cell, as in their
+        // UpdatePassOne. Each game reads how much room the cell it points at has from the four neighbour room
+        // streams, then updates its own slots. Whatever is sent is written into the neighbours afterwards, one
+        // neighbour at a time. Returns whether any combiner here is full but could not send.
+        bool UpdatePassOne(const int block, const int cell) {
+            const std::size_t lanes = GetLanes(block, cell);
+            const Kind *kinds = &kinds_[lanes];
+            const std::uint8_t *directions = &directions_[lanes];
+            const std::uint8_t *rooms = &rooms_[lanes];
+            const int *numbers = &numbers_[lanes];
+            const int *live = &live_[block * kBlockSize];
+            const int *miningPhases = &miningPhases_[block * kBlockSize];
+            int *slots = &products_[lanes * kSlotCount];
+            int *sends = sends_.data();
+            std::uint8_t *combines = combines_.data();
+
+            constexpr int kTopLanes = GetOffset(static_cast<int>(Direction::kTop)) * kBlockSize;
+            constexpr int kRightLanes = GetOffset(static_cast<int>(Direction::kRight)) * kBlockSize;
+            constexpr int kBottomLanes = GetOffset(static_cast<int>(Direction::kBottom)) * kBlockSize;
+            constexpr int kLeftLanes = GetOffset(static_cast<int>(Direction::kLeft)) * kBlockSize;
+
+            int anySends = 0;
+            int anyCombines = 0;
+            int anyWaits = 0;
+            PDOGS_INDEPENDENT_GAMES
+            for (int lane = 0; lane < kBlockSize; ++lane) {
+                const int direction = directions[lane];
+                const int room = Select(direction, rooms[lane + kTopLanes], rooms[lane + kRightLanes],
+                                        rooms[lane + kBottomLanes], rooms[lane + kLeftLanes]);
+                // For combiner main cells: whether the other cell, a quarter turn anticlockwise, holds a product.
+                const int partnerRoom = Select(direction, rooms[lane + kLeftLanes], rooms[lane + kTopLanes],
+                                               rooms[lane + kRightLanes], rooms[lane + kBottomLanes]);
+                const int room1 = MaskOf(room >= 1);
+                const int room2 = MaskOf(room >= 2);
+                const int room3 = MaskOf(room >= 3);
+
+                const int isLive = live[lane];
+                const int isConveyor = isLive & MaskOf(kinds[lane] == Kind::kConveyor);
+                const int isMiningMachine = isLive & MaskOf(kinds[lane] == Kind::kMiningMachine);
+                const int isCombiner = isLive & MaskOf(kinds[lane] == Kind::kCombinerMain);
+
+                int first = slots[lane];
+                int second = slots[lane + kBlockSize];
+                int third = slots[lane + 2 * kBlockSize];
+
+                const int conveyorSends = isConveyor & room3 & MaskOf(first != 0);
+                int send = first & conveyorSends;
+                first &= ~conveyorSends;
+                const int shiftFirst = isConveyor & room2 & MaskOf(first == 0 && second != 0);
+                first = Blend(shiftFirst, second, first);
+                second &= ~shiftFirst;
+                const int shiftSecond = isConveyor & room1 & MaskOf(first == 0 && second == 0 && third != 0);
+                second = Blend(shiftSecond, third, second);
+                third &= ~shiftSecond;
+
+                // A mining machine keeps the phase of the elapsed times its cycle ends on in slot 0.
+                const int cycleEnds = isMiningMachine & MaskOf(first == miningPhases[lane]);
+                const int mines = cycleEnds & MaskOf(numbers[lane] != 0) & room3;
+                send = Blend(mines, numbers[lane], send);
+
+                // A combiner keeps its first slot in slot 0 of the main cell and its second in that of the other;
+                // the other one is added in once the main cell knows it combines.
+                const int full = isCombiner & MaskOf(first != 0 && partnerRoom == 0);
+                const int combining = full & room3;
+                send = Blend(combining, first, send);
+                first &= ~combining;
+
+                slots[lane] = first;
+                slots[lane + kBlockSize] = second;
+                slots[lane + 2 * kBlockSize] = third;
+                sends[lane] = send;
+                combines[lane] = static_cast<std::uint8_t>(combining & 1);
+                anySends |= send;
+                anyCombines |= combining;
+                anyWaits |= full & ~room3;
+            }
+
+            if (anyCombines != 0) {
+                for (int lane = 0; lane < kBlockSize; ++lane) {
+                    if (combines[lane] != 0) {
+                        const int game = block * kBlockSize + lane;
+                        const int partner = GetPartner(cell, static_cast<Direction>(directions[lane]));
+                        int &partnerProduct = GetSlots(block, partner, 0)[lane];
+                        sends[lane] += partnerProduct;
+                        partnerProduct = 0;
+                        At(rooms_, cell, game) = kFullRoom;
+                        At(rooms_, partner, game) = kFullRoom;
+                    }
+                }
+            }
+
+            if (anySends != 0) {
+                Deliver<static_cast<int>(Direction::kTop)>(block, cell);
+                Deliver<static_cast<int>(Direction::kRight)>(block, cell);
+                Deliver<static_cast<int>(Direction::kBottom)>(block, cell);
+                Deliver<static_cast<int>(Direction::kLeft)>(block, cell);
+            }
+            return anyWaits != 0;
+        }
+
+        // Hands what UpdatePassOne sent towards one direction to that neighbour: the back slot of a conveyor, the
+        // slot of a combiner cell, or the collection center's score. Either slot leaves the neighbour no room.
+        template<int kDirection>
+        void Deliver(const int block, const int cell) {
+            const int target = cell + GetOffset(kDirection);
+            const std::uint8_t *directions = &directions_[GetLanes(block, cell)];
+            const Kind *targetKinds = &kinds_[GetLanes(block, target)];
+            std::uint8_t *targetRooms = &rooms_[GetLanes(block, target)];
+            int *targetFronts = GetSlots(block, target, 0);
+            int *targetBacks = GetSlots(block, target, kSlotCount - 1);
+            const int *sends = sends_.data();
+
+            int anyToConveyor = 0;
+            int anyToCombiner = 0;
+            int anyToCenter = 0;
+            PDOGS_INDEPENDENT_GAMES
+            for (int lane = 0; lane < kBlockSize; ++lane) {
+                const int sendsHere = MaskOf(sends[lane] != 0) & MaskOf(directions[lane] == kDirection);
+                const int toConveyor = sendsHere & MaskOf(targetKinds[lane] == Kind::kConveyor);
+                const int toCombiner = sendsHere & (MaskOf(targetKinds[lane] == Kind::kCombinerMain) |
+                                                    MaskOf(targetKinds[lane] == Kind::kCombinerSecond));
+                targetBacks[lane] = Blend(toConveyor, sends[lane], targetBacks[lane]);
+                targetFronts[lane] = Blend(toCombiner, sends[lane], targetFronts[lane]);
+                targetRooms[lane] = static_cast<std::uint8_t>(targetRooms[lane] & ~(toConveyor | toCombiner));
+                anyToConveyor |= toConveyor;
+                anyToCombiner |= toCombiner;
+                anyToCenter |= sendsHere & MaskOf(targetKinds[lane] == Kind::kCollectionCenter);
+            }
+
+            if (anyToConveyor != 0) {
+                loadedConveyors_[static_cast<std::size_t>(block) * kPaddedCellCount + target] = 1;
+            }
+            if (anyToCombiner != 0) {
+                // The combiner may be full now; its main cell decides on its next visit.
+                for (int lane = 0; lane < kBlockSize; ++lane) {
+                    if (sends[lane] != 0 && directions[lane] == kDirection) {
+                        const int game = block * kBlockSize + lane;
+                        const Kind kind = targetKinds[lane];
+                        const auto targetDirection = static_cast<Direction>(At(directions_, target, game));
+                        if (kind == Kind::kCombinerMain || kind == Kind::kCombinerSecond) {
+                            const int main = kind == Kind::kCombinerMain ? target : GetMain(target, targetDirection);
+                            waitingCombiners_[static_cast<std::size_t>(block) * kPaddedCellCount + main] = 1;
+                        }
+                    }
+                }
+            }
+            if (anyToCenter == 0)
+                return;
+
+            for (int lane = 0; lane < kBlockSize; ++lane) {
+                const int game = block * kBlockSize + lane;
+                if (sends[lane] != 0 && directions[lane] == kDirection &&
+                    targetKinds[lane] == Kind::kCollectionCenter && sends[lane] % commonDivisors_[game] == 0) {
+                    scores_[game] += 1;
+                }
+            }
+        }
+
+        // ConveyorCell::UpdatePassTwo for one block's games at one cell, one slot at a time across the games, after
+        // which each conveyor's room is counted again. Returns whether any of them still holds a product.
+        bool UpdatePassTwo(const int block, const int cell) {
+            const std::size_t lanes = GetLanes(block, cell);
+            const Kind *kinds = &kinds_[lanes];
+            const int *live = &live_[block * kBlockSize];
+            std::uint8_t *rooms = &rooms_[lanes];
+            int *slots = &products_[lanes * kSlotCount];
+
+            // Only conveyors hold anything past slot 0, so the moves need not look at kinds.
+            int anyProducts = 0;
+            for (int k = 3; k < kSlotCount; ++k) {
+                int *moving = slots + k * kBlockSize;
+                int *next = moving - kBlockSize;
+                const int *next2 = moving - 2 * kBlockSize;
+                const int *next3 = moving - 3 * kBlockSize;
+                PDOGS_INDEPENDENT_GAMES
+                for (int lane = 0; lane < kBlockSize; ++lane) {
+                    const int moves = live[lane] & MaskOf(moving[lane] != 0) &
+                                      MaskOf((next[lane] | next2[lane] | next3[lane]) == 0);
+                    next[lane] = Blend(moves, moving[lane], next[lane]);
+                    moving[lane] &= ~moves;
+                    anyProducts |= moving[lane] | next[lane];
+                }
+            }
+            PDOGS_INDEPENDENT_GAMES
+            for (int lane = 0; lane < kBlockSize; ++lane) {
+                anyProducts |= slots[kBlockSize + lane] | (slots[lane] & MaskOf(kinds[lane] == Kind::kConveyor));
+            }
+
+            const int *back1 = slots + (kSlotCount - 1) * kBlockSize;
+            const int *back2 = slots + (kSlotCount - 2) * kBlockSize;
+            const int *back3 = slots + (kSlotCount - 3) * kBlockSize;
+            PDOGS_INDEPENDENT_GAMES
+            for (int lane = 0; lane < kBlockSize; ++lane) {
+                const int room1 = MaskOf(back1[lane] == 0);
+                const int room2 = room1 & MaskOf(back2[lane] == 0);
+                const int room3 = room2 & MaskOf(back3[lane] == 0);
+                const int room = (room1 & 1) + (room2 & 1) + (room3 & 1);
+                rooms[lane] = static_cast<std::uint8_t>(
+                        Blend(MaskOf(kinds[lane] == Kind::kConveyor), room, rooms[lane]));
+            }
+            return anyProducts != 0;
+        }
+
+        int gameCount_;
+        int blockCount_;
+        std::vector<Kind> kinds_;
+        std::vector<std::uint8_t> directions_;
+        std::vector<std::uint8_t> rooms_;
+        std::vector<int> anchors_;
+        std::vector<int> numbers_;
+        std::vector<int> products_;
+        // Per block and cell: whether any game's conveyor there may hold a product, and whether any game's
+        // combiner main cell there may have both slots full. Nothing else there moves unless a mining machine
+        // produces, which scheduledMiners_ tracks.
+        std::vector<std::uint8_t> loadedConveyors_;
+        std::vector<std::uint8_t> waitingCombiners_;
+        std::vector<int> commonDivisors_;
+        std::vector<int> scores_;
+        std::vector<int> elapsedTimes_;
+        // steps_ modulo kMiningInterval at each game's Reset, and its elapsed time modulo kMiningInterval.
+        std::vector<int> resetSteps_;
+        std::vector<int> miningPhases_;
+        // All ones for the games the current step advances.
+        std::vector<int> live_;
+        std::vector<std::uint8_t> scheduledMiners_;
+        int steps_ = 0;
+        std::vector<int> sends_;
+        std::vector<std::uint8_t> combines_;
+    };
+
+    // One game of a BatchEnvironment seen as an engine, so HashGameState and CaptureCellState work on it.
+    struct BatchGameView {
+        const BatchEnvironment *environment;
+        int game;
+
+        [[nodiscard]] int GetScores() const { return environment->GetScores(game); }
+
+        [[nodiscard]] int GetElapsedTime() const { return environment->GetElapsedTime(game); }
+    };
+
+    inline CellState CaptureCellState(const BatchGameView &view, const CellPosition cellPosition) {
+        return view.environment->GetCellState(view.game, cellPosition);
+    }
+
+    // A BatchEnvironment of one game behind GameManager's constructor and Update, so that
+    // DifferentialHarness<BatchGameAdapter> holds the batch against GameManager tick by tick. The player is shown a
+    // board that mirrors what is built, so numbers, distances and flow status are exact, but it never runs: what
+    // conveyors and combiners hold is not shown.
+    class BatchGameAdapter final : public IGameManager {
+    public:
+        BatchGameAdapter(IGamePlayer *player, const int commonDivisor, const unsigned int seed) :
+            player_(player), environment_(1) {
+            environment_.Reset(0, commonDivisor, seed);
+            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                    if (const int number = environment_.GetNumber(0, {row, col}); number != 0) {
+                        board_.SetBackground({row, col}, std::make_shared<NumberCell>(number));
+                    }
+                }
+            }
+            MirrorShapes();
+        }
+
+        void Update() {
+            PlayerAction action{};
+            if (environment_.IsAskingForAction(0)) {
+                // GameManager asks with the new tick already counted.
+                asking_ = true;
+                action = player_->GetNextAction(*this);
+                asking_ = false;
+            }
+            environment_.StepAll(&action);
+            if (action.type != PlayerActionType::None) {
+                MirrorShapes();
+            }
+        }
+
+        [[nodiscard]] const BatchEnvironment &GetEnvironment() const { return environment_; }
+
+        [[nodiscard]] std::string GetLevelInfo() const override {
+            return "(" + std::to_string(environment_.GetCommonDivisor(0)) + ")";
+        }
+
+        [[nodiscard]] const LayeredCell &GetLayeredCell(const CellPosition cellPosition) const override {
+            return board_.GetLayeredCell(cellPosition);
+        }
+
+        [[nodiscard]] bool IsScoredProduct(const int number) const override {
+            return number % environment_.GetCommonDivisor(0) == 0;
+        }
+
+        [[nodiscard]] int GetScores() const override { return environment_.GetScores(0); }
+
+        [[nodiscard]] int GetEndTime() const override { return BatchEnvironment::GetEndTime(); }
+
+        [[nodiscard]] int GetElapsedTime() const override { return environment_.GetElapsedTime(0) + (asking_ ? 1 : 0); }
+
+        [[nodiscard]] bool IsGameOver() const override { return environment_.IsGameOver(0); }
+
+        [[nodiscard]] int GetDistanceToCollectionCenter(const CellPosition cellPosition) const override {
+            return board_.GetDistanceToCollectionCenter(cellPosition);
+        }
+
+        [[nodiscard]] FlowStatus GetFlowStatus(const CellPosition cellPosition) const override {
+            return board_.GetFlowStatus(cellPosition);
+        }
+
+        // The mirror board is never updated, so nothing is ever delivered to it.
+        void OnProductReceived(int number, ProductTag tag) override {}
+
+    private:
+        void MirrorShapes() {
+            records_.clear();
+            for (int index = 0; index < GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight; ++index) {
+                const CellPosition position{index / GameManagerConfig::kBoardWidth,
+                                            index % GameManagerConfig::kBoardWidth};
+                const CellState target = environment_.GetCellState(0, position);
+                const CellState current = CaptureCellState(board_.GetLayeredCell(position), position);
+                if (target.kind != current.kind || target.direction != current.direction ||
+                    target.topLeft != current.topLeft) {
+                    records_.emplace_back(index, CellState{target.kind, target.direction, target.topLeft, {}});
+                }
+            }
+            ApplyCellStates(board_, this, records_);
+        }
+
+        IGamePlayer *player_;
+        BatchEnvironment environment_;
+        GameBoard board_;
+        std::vector<CellStateRecord> records_;
+        bool asking_ = false;
+    };
+
+    inline CellState CaptureCellState(const BatchGameAdapter &adapter, const CellPosition cellPosition) {
+        return adapter.GetEnvironment().GetCellState(0, cellPosition);
+    }
+} // namespace Feis
+#endif
@@ -0,0 +1,53 @@
+#ifndef BOTTLENECK_REPORT_HPP
+#define BOTTLENECK_REPORT_HPP
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+#include "CellState.hpp"
+#include "PDOGS.hpp"
+
+namespace Feis {
+    // Ranks the entities that held products back the longest. Each entity is reported once, at the cell that sends
+    // its products on: a combiner at its main cell (GetMainCellPosition, where its other cell's output leads), which
+    // is not its top-left cell when it faces up or right, and every other entity at its only cell. The stall share
+    // is ticks blocked over ticks blocked plus products forwarded, and mining machines rank by the cycles they lost
+    // to a full target instead.
+    inline void PrintBottleneckReport(std::ostream &out, const IGameInfo &info, const FlowCounters &counters,
+                                      const std::size_t limit = 10) {
+        struct Row {
+            CellPosition position;
+            const char *name;
+            std::uint32_t stalls;
+            std::uint32_t forwarded;
+        };
+
+        std::vector<Row> rows;
+        for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+            for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                const auto &entry = counters.Get({row, col});
+                const std::uint32_t stalls = entry.ticksBlocked + entry.miningCyclesLost;
+                if (stalls == 0) {
+                    continue;
+                }
+
+                static constexpr const char *kNames[] = {"removed", "collection center", "mining machine",
+                                                         "conveyor", "combiner", "wall"};
+                const char *name = kNames[static_cast<int>(CaptureCellState(info, {row, col}).kind)];
+                rows.push_back({{row, col}, name, stalls, entry.forwarded});
+            }
+        }
+        std::sort(rows.begin(), rows.end(), [](const Row &lhs, const Row &rhs) { return lhs.stalls > rhs.stalls; });
+        rows.resize(std::min(rows.size(), limit));
+
+        out << "bottlenecks (worst " << rows.size() << "):\n";
+        out << "  cell      kind             stalled  forwarded  stall-share\n";
+        for (const auto &[position, name, stalls, forwarded]: rows) {
+            out << "  (" << std::setw(2) << position.row << ", " << std::setw(2) << position.col << ")  "
+                << std::left << std::setw(15) << name << std::right << std::setw(9) << stalls << std::setw(11)
+                << forwarded << std::setw(12) << std::fixed << std::setprecision(1)
+                << 100.0 * stalls / (stalls + forwarded) << "%\n";
+        }
+    }
+} // namespace Feis
+#endif
@@ -1,5 +1,6 @@
 #ifndef CELL_RENDERER_SECOND_PASS_VISITOR_HPP
 #define CELL_RENDERER_SECOND_PASS_VISITOR_HPP
+#include "GameSnapshot.hpp"
 #include "PDOGS.hpp"
 
 template<typename TGameRendererConfig>
@@ -8,37 +9,39 @@ public:
     using Direction = Feis::Direction;
     using CellPosition = Feis::CellPosition;
 
+    // With productMotion, each product is drawn at interpolation (0 to 1) along its way from its previous slot.
     CellRendererSecondPassVisitor(const Feis::IGameInfo *info, Drawer<TGameRendererConfig> *drawer,
-                                  const CellPosition cellPosition) :
-        info(info), drawer_(drawer), cellPosition_(cellPosition) {}
+                                  const CellPosition cellPosition, const Feis::ProductMotion *productMotion = nullptr,
+                                  const float interpolation = 1.0f) :
+        info(info), drawer_(drawer), cellPosition_(cellPosition), productMotion_(productMotion),
+        interpolation_(interpolation) {}
     void Visit(const Feis::ConveyorCell *cell) const override {
         std::size_t productCount = cell->GetProductCount();
 
-        for (std::size_t k = 0; k < productCount; ++k) {
-            int product;
+        for (std::size_t slot = 0; slot < productCount; ++slot) {
+            const int product = cell->GetProduct(slot);
+            const float position =
+                    productMotion_ ? productMotion_->GetSlot(cellPosition_, slot, interpolation_) : slot;
             sf::Vector2f offset;
 
             switch (cell->GetDirection()) {
                 case Direction::kTop:
-                    product = cell->GetProduct(k);
                     offset = sf::Vector2f(
                             0, TGameRendererConfig::kCellSize *
-                                       (-1.0f + static_cast<float>(k + 1) / static_cast<float>(productCount)));
+                                       (-1.0f + (position + 1) / static_cast<float>(productCount)));
                     break;
                 case Direction::kRight:
-                    product = cell->GetProduct(productCount - 1 - k);
-                    offset = sf::Vector2f(TGameRendererConfig::kCellSize * static_cast<float>(k) / productCount, 0);
+                    offset = sf::Vector2f(
+                            TGameRendererConfig::kCellSize * (productCount - 1 - position) / productCount, 0);
                     break;
                 case Direction::kBottom:
-                    product = cell->GetProduct(productCount - 1 - k);
-                    offset = sf::Vector2f(0, TGameRendererConfig::kCellSize * static_cast<float>(k) / productCount);
+                    offset = sf::Vector2f(
+                            0, TGameRendererConfig::kCellSize * (productCount - 1 - position) / productCount);
                     break;
                 case Direction::kLeft:
-                    product = cell->GetProduct(k);
-                    offset =
-                            sf::Vector2f(TGameRendererConfig::kCellSize *
-                                                 (-1.0f + static_cast<float>(k + 1) / static_cast<float>(productCount)),
-                                         0);
+                    offset = sf::Vector2f(TGameRendererConfig::kCellSize *
+                                                  (-1.0f + (position + 1) / static_cast<float>(productCount)),
+                                          0);
                     break;
                 default:
                     assert(0);
@@ -62,5 +65,7 @@ private:
     const Feis::IGameInfo *info;
     Drawer<TGameRendererConfig> *drawer_;
     CellPosition cellPosition_;
+    const Feis::ProductMotion *productMotion_;
+    float interpolation_;
 };
 #endif
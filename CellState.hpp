@@ -0,0 +1,224 @@
+#ifndef CELL_STATE_HPP
+#define CELL_STATE_HPP
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "PDOGS.hpp"
+
+namespace Feis {
+    enum class CellKind : std::uint8_t { kEmpty, kCollectionCenter, kMiningMachine, kConveyor, kCombiner, kWall };
+
+    // Plain-data view of a cell's foreground: enough to compare two engines cell by cell.
+    // Conveyors use all of products; combiners keep their first and second slot in products[0] and products[1];
+    // mining machines keep their cycle counter in products[0].
+    struct CellState {
+        CellKind kind;
+        Direction direction;
+        CellPosition topLeft;
+        std::array<int, GameManagerConfig::kConveyorBufferSize> products;
+    };
+
+    inline bool operator==(const CellState &lhs, const CellState &rhs) {
+        return lhs.kind == rhs.kind && lhs.direction == rhs.direction && lhs.topLeft == rhs.topLeft &&
+               lhs.products == rhs.products;
+    }
+
+    inline bool operator!=(const CellState &lhs, const CellState &rhs) { return !(lhs == rhs); }
+
+    class CellStateCaptureVisitor final : public CellVisitor {
+    public:
+        explicit CellStateCaptureVisitor(CellState *state) : state_(state) {}
+
+        void Visit(const CollectionCenterCell *cell) const override {
+            state_->kind = CellKind::kCollectionCenter;
+            state_->topLeft = cell->GetTopLeftCellPosition();
+        }
+
+        void Visit(const MiningMachineCell *cell) const override {
+            state_->kind = CellKind::kMiningMachine;
+            state_->direction = cell->GetDirection();
+            state_->topLeft = cell->GetTopLeftCellPosition();
+            state_->products[0] = static_cast<int>(cell->GetElapsedTime());
+        }
+
+        void Visit(const ConveyorCell *cell) const override {
+            state_->kind = CellKind::kConveyor;
+            state_->direction = cell->GetDirection();
+            state_->topLeft = cell->GetTopLeftCellPosition();
+            for (std::size_t i = 0; i < cell->GetProductCount(); ++i) {
+                state_->products[i] = cell->GetProduct(i);
+            }
+        }
+
+        void Visit(const CombinerCell *cell) const override {
+            state_->kind = CellKind::kCombiner;
+            state_->direction = cell->GetDirection();
+            state_->topLeft = cell->GetTopLeftCellPosition();
+            state_->products[0] = cell->GetFirstSlotProduct();
+            state_->products[1] = cell->GetSecondSlotProduct();
+        }
+
+        void Visit(const WallCell *cell) const override {
+            state_->kind = CellKind::kWall;
+            state_->topLeft = cell->GetTopLeftCellPosition();
+        }
+
+    private:
+        CellState *state_;
+    };
+
+    inline CellState CaptureCellState(const LayeredCell &layeredCell, const CellPosition cellPosition) {
+        CellState state{CellKind::kEmpty, Direction::kTop, cellPosition, {}};
+
+        if (const auto &foreground = layeredCell.GetForeground()) {
+            const CellStateCaptureVisitor visitor(&state);
+            foreground->Accept(&visitor);
+        }
+        return state;
+    }
+
+    inline CellState CaptureCellState(const IGameInfo &info, const CellPosition cellPosition) {
+        return CaptureCellState(info.GetLayeredCell(cellPosition), cellPosition);
+    }
+
+    // A mining machine SetSkipDeadEntities is skipping reports the cycle counter it would have had it kept running,
+    // so captured state and HashGameState come out the same whether skipping is on or off.
+    inline CellState CaptureCellState(const GameBoard &board, const CellPosition cellPosition) {
+        CellState state = CaptureCellState(board.GetLayeredCell(cellPosition), cellPosition);
+        const long long idleSince =
+                board.GetIdleSince(cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col);
+        if (state.kind == CellKind::kMiningMachine && idleSince >= 0) {
+            const auto *cell =
+                    static_cast<const MiningMachineCell *>(board.GetLayeredCell(cellPosition).GetForeground().get());
+            state.products[0] =
+                    static_cast<int>(cell->GetElapsedTimeAfter(static_cast<std::size_t>(board.GetTick() - idleSince)));
+        }
+        return state;
+    }
+
+    inline CellState CaptureCellState(const GameManager &gameManager, const CellPosition cellPosition) {
+        return CaptureCellState(gameManager.GetBoard(), cellPosition);
+    }
+
+    // A cell's index in row-major order and the state it should have.
+    using CellStateRecord = std::pair<int, CellState>;
+
+    namespace CellStates {
+        inline bool Build(GameBoard &board, IGameManager *gameManager, const CellPosition position,
+                          const CellState &target) {
+            switch (target.kind) {
+                case CellKind::kCollectionCenter:
+                    return board.Build<CollectionCenterCell>(position, gameManager);
+                case CellKind::kMiningMachine:
+                    return board.Build<MiningMachineCell>(position, target.direction);
+                case CellKind::kConveyor:
+                    return board.Build<ConveyorCell>(position, target.direction);
+                case CellKind::kCombiner:
+                    return board.Build<CombinerCell>(position, target.direction);
+                case CellKind::kWall:
+                    return board.Build<WallCell>(position);
+                case CellKind::kEmpty:
+                    break;
+            }
+            return false;
+        }
+
+        inline void Restore(ForegroundCell *cell, const CellState &target) {
+            switch (target.kind) {
+                case CellKind::kMiningMachine:
+                    static_cast<MiningMachineCell *>(cell)->SetElapsedTime(
+                            static_cast<std::size_t>(target.products[0]));
+                    break;
+                case CellKind::kConveyor:
+                    for (std::size_t i = 0; i < GameManagerConfig::kConveyorBufferSize; ++i) {
+                        static_cast<ConveyorCell *>(cell)->SetProduct(i, target.products[i]);
+                    }
+                    break;
+                case CellKind::kCombiner:
+                    static_cast<CombinerCell *>(cell)->SetSlotProducts(target.products[0], target.products[1]);
+                    break;
+                default:
+                    break;
+            }
+        }
+    } // namespace CellStates
+
+    // Makes every listed cell of the board match its state: first clears whatever is built there in another shape,
+    // then builds the entities whose top-left cell is listed, then copies in their contents. Contents come last
+    // because building next to a skipped mining machine wakes it up and moves its cycle counter. States hold the
+    // caught-up counter CaptureCellState(board, ...) reports, so a machine still skipped starts its idle span over.
+    // gameManager owns any collection center built. Product tags are not restored.
+    inline bool ApplyCellStates(GameBoard &board, IGameManager *gameManager,
+                                const std::vector<CellStateRecord> &records) {
+        for (const auto &[index, target]: records) {
+            const CellPosition position{index / GameManagerConfig::kBoardWidth, index % GameManagerConfig::kBoardWidth};
+            if (board.GetLayeredCell(position).GetForeground()) {
+                const CellState current = CaptureCellState(board.GetLayeredCell(position), position);
+                if ((current.kind != target.kind || current.direction != target.direction ||
+                     current.topLeft != target.topLeft) &&
+                    !board.Remove(position))
+                    return false;
+            }
+        }
+
+        for (const auto &[index, target]: records) {
+            const CellPosition position{index / GameManagerConfig::kBoardWidth, index % GameManagerConfig::kBoardWidth};
+            if (target.kind == CellKind::kEmpty || target.topLeft != position)
+                continue;
+
+            if (!board.GetLayeredCell(position).GetForeground() &&
+                !CellStates::Build(board, gameManager, position, target))
+                return false;
+        }
+
+        for (const auto &[index, target]: records) {
+            const CellPosition position{index / GameManagerConfig::kBoardWidth, index % GameManagerConfig::kBoardWidth};
+            if (target.kind != CellKind::kEmpty && target.topLeft == position) {
+                if (board.GetIdleSince(index) >= 0) {
+                    board.SetIdleSince(index, board.GetTick());
+                }
+                CellStates::Restore(board.GetLayeredCell(position).GetForeground().get(), target);
+            }
+        }
+        board.RecountProductsInFlight();
+        return true;
+    }
+
+    class StateHasher {
+    public:
+        void Add(const std::uint64_t value) {
+            for (int i = 0; i < 8; ++i) {
+                hash_ = (hash_ ^ ((value >> (i * 8)) & 0xff)) * 1099511628211ull;
+            }
+        }
+
+        void Add(const CellState &state) {
+            Add(static_cast<std::uint64_t>(state.kind) << 8 | static_cast<std::uint64_t>(state.direction));
+            Add(static_cast<std::uint64_t>(state.topLeft.row) << 32 | static_cast<std::uint32_t>(state.topLeft.col));
+            for (const int product: state.products) {
+                Add(static_cast<std::uint32_t>(product));
+            }
+        }
+
+        [[nodiscard]] std::uint64_t GetHash() const { return hash_; }
+
+    private:
+        std::uint64_t hash_ = 14695981039346656037ull;
+    };
+
+    // TEngine is anything CaptureCellState(engine, position) resolves for, plus GetScores and GetElapsedTime.
+    template<typename TEngine>
+    std::uint64_t HashGameState(const TEngine &engine) {
+        StateHasher hasher;
+        for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+            for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                hasher.Add(CaptureCellState(engine, {row, col}));
+            }
+        }
+        hasher.Add(static_cast<std::uint64_t>(engine.GetScores()));
+        hasher.Add(static_cast<std::uint64_t>(engine.GetElapsedTime()));
+        return hasher.GetHash();
+    }
+} // namespace Feis
+#endif
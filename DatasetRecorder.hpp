@@ -0,0 +1,674 @@
+#ifndef DATASET_RECORDER_HPP
+#define DATASET_RECORDER_HPP
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "CellState.hpp"
+#include "PDOGS.hpp"
+
+namespace Feis {
+    // On-disk layout, all integers in host byte order like TimelineRecorder::WriteBinary.
+    //
+    // Shard <prefix>-NNNNN.pdds: a Dataset::FileHeader, then whole episodes back to back. A shard is closed once the
+    // next episode would take it past the shard size, so only an episode larger than a shard makes one bigger.
+    // Episode: DatasetEpisodeHeader, keyframeCount uint32 byte offsets from the episode start, one byte per cell
+    // for the number under it (0 for none), then decisionCount decisions.
+    // Decision: varint elapsed time, varint scores, action type byte, zigzag varint row and col, varint count of
+    // cells that differ from the previous decision, then per cell a varint gap from the previous cell index, a tag
+    // byte (kind | direction << 3 | 32 when the cell is its entity's top-left) and the CellState products the kind
+    // uses: 10 for a conveyor, 2 for a combiner, 1 for a mining machine. Every keyframeInterval-th decision is a
+    // keyframe listing all non-empty cells instead, so any decision decodes from at most that many records.
+    // Index <prefix>.index: a Dataset::FileHeader, then one DatasetIndexEntry per episode in the order written.
+    struct DatasetEpisodeHeader {
+        static constexpr std::uint32_t kMagic = 0x50454450; // "PDEP"
+
+        std::uint32_t magic;
+        std::uint32_t size;
+        std::uint32_t seed;
+        std::int32_t commonDivisor;
+        std::int32_t finalScores;
+        std::uint32_t decisionCount;
+        std::uint32_t keyframeInterval;
+        std::uint32_t keyframeCount;
+    };
+
+    struct DatasetIndexEntry {
+        std::uint64_t firstDecision;
+        std::uint64_t offset;
+        std::uint32_t shard;
+        std::uint32_t size;
+        std::uint32_t decisionCount;
+        std::int32_t finalScores;
+    };
+
+    // One decision point read back: the board the player saw, what it chose and how its game ended.
+    struct DatasetDecision {
+        std::uint32_t seed;
+        int commonDivisor;
+        int finalScores;
+        int elapsedTime;
+        int scores;
+        PlayerAction action;
+        std::vector<std::uint8_t> numbers;
+        std::vector<CellState> cells;
+    };
+
+    namespace Dataset {
+        constexpr std::uint32_t kShardMagic = 0x53444450; // "PDDS"
+        constexpr std::uint32_t kIndexMagic = 0x58494450; // "PDIX"
+        constexpr std::uint32_t kVersion = 1;
+        constexpr int kCellCount = GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight;
+
+        struct FileHeader {
+            std::uint32_t magic;
+            std::uint32_t version;
+        };
+
+        inline std::string GetShardFilename(const std::string &prefix, const std::uint32_t shard) {
+            char suffix[16];
+            std::snprintf(suffix, sizeof(suffix), "-%05u.pdds", shard);
+            return prefix + suffix;
+        }
+
+        inline std::string GetIndexFilename(const std::string &prefix) { return prefix + ".index"; }
+
+        inline void PutVarint(std::vector<std::uint8_t> &out, std::uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<std::uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<std::uint8_t>(value));
+        }
+
+        inline std::uint64_t GetVarint(const std::uint8_t *&in) {
+            std::uint64_t value = 0;
+            for (int shift = 0;; shift += 7) {
+                const std::uint8_t byte = *in++;
+                value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                    return value;
+            }
+        }
+
+        inline void PutSigned(std::vector<std::uint8_t> &out, const std::int64_t value) {
+            PutVarint(out, (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+        }
+
+        inline std::int64_t GetSigned(const std::uint8_t *&in) {
+            const std::uint64_t value = GetVarint(in);
+            return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+        }
+
+        inline std::size_t GetStoredProductCount(const CellKind kind) {
+            switch (kind) {
+                case CellKind::kConveyor:
+                    return GameManagerConfig::kConveyorBufferSize;
+                case CellKind::kCombiner:
+                    return 2;
+                case CellKind::kMiningMachine:
+                    return 1;
+                default:
+                    return 0;
+            }
+        }
+
+        inline void PutCell(std::vector<std::uint8_t> &out, const int index, const CellState &state) {
+            const CellPosition position{index / GameManagerConfig::kBoardWidth, index % GameManagerConfig::kBoardWidth};
+            out.push_back(static_cast<std::uint8_t>(static_cast<int>(state.kind) |
+                                                    static_cast<int>(state.direction) << 3 |
+                                                    (state.topLeft == position ? 32 : 0)));
+            for (std::size_t i = 0; i < GetStoredProductCount(state.kind); ++i) {
+                PutVarint(out, static_cast<std::uint32_t>(state.products[i]));
+            }
+        }
+
+        inline CellState GetCell(const std::uint8_t *&in, const int index) {
+            const CellPosition position{index / GameManagerConfig::kBoardWidth, index % GameManagerConfig::kBoardWidth};
+            const std::uint8_t tag = *in++;
+            CellState state{static_cast<CellKind>(tag & 7), static_cast<Direction>(tag >> 3 & 3), position, {}};
+
+            if ((tag & 32) == 0) {
+                if (state.kind == CellKind::kCollectionCenter) {
+                    state.topLeft = {GameManager::CollectionCenterConfig::kTop,
+                                     GameManager::CollectionCenterConfig::kLeft};
+                } else if (state.direction == Direction::kTop || state.direction == Direction::kBottom) {
+                    state.topLeft = position + CellPosition{0, -1};
+                } else {
+                    state.topLeft = position + CellPosition{-1, 0};
+                }
+            }
+            for (std::size_t i = 0; i < GetStoredProductCount(state.kind); ++i) {
+                state.products[i] = static_cast<int>(GetVarint(in));
+            }
+            return state;
+        }
+
+        // Bounds-checked reading of an episode read back from disk, which may be truncated or damaged.
+        class Reader {
+        public:
+            Reader(const std::uint8_t *data, const std::uint8_t *end) : in_(data), end_(end) {}
+
+            [[nodiscard]] const std::uint8_t *GetPosition() const { return in_; }
+
+            bool GetByte(std::uint8_t &value) {
+                if (in_ == end_)
+                    return false;
+                value = *in_++;
+                return true;
+            }
+
+            bool GetVarint(std::uint64_t &value) {
+                value = 0;
+                for (int shift = 0; shift < 64; shift += 7) {
+                    std::uint8_t byte;
+                    if (!GetByte(byte))
+                        return false;
+                    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                    if (!(byte & 0x80))
+                        return true;
+                }
+                return false;
+            }
+
+            bool GetInt(int &value, const int limit) {
+                std::uint64_t raw;
+                if (!GetVarint(raw) || raw > static_cast<std::uint64_t>(limit))
+                    return false;
+                value = static_cast<int>(raw);
+                return true;
+            }
+
+            bool GetSigned(int &value) {
+                std::uint64_t raw;
+                if (!GetVarint(raw) || raw > 0xffffffffu)
+                    return false;
+                value = static_cast<int>(static_cast<std::int64_t>(raw >> 1) ^ -static_cast<std::int64_t>(raw & 1));
+                return true;
+            }
+
+            // Reads the next cell's gap and the cell, as GetCell would, into index and state.
+            bool GetCell(int &index, CellState &state) {
+                int gap;
+                std::uint8_t tag;
+                if (!GetInt(gap, kCellCount) || (index += gap + 1) >= kCellCount || !GetByte(tag) ||
+                    (tag & 7) > static_cast<int>(CellKind::kWall) || tag >= 64)
+                    return false;
+
+                const CellPosition position{index / GameManagerConfig::kBoardWidth,
+                                            index % GameManagerConfig::kBoardWidth};
+                state = {static_cast<CellKind>(tag & 7), static_cast<Direction>(tag >> 3 & 3), position, {}};
+                if ((tag & 32) == 0) {
+                    if (state.kind == CellKind::kCollectionCenter) {
+                        state.topLeft = {GameManager::CollectionCenterConfig::kTop,
+                                         GameManager::CollectionCenterConfig::kLeft};
+                    } else if (state.kind != CellKind::kCombiner) {
+                        return false;
+                    } else if (state.direction == Direction::kTop || state.direction == Direction::kBottom) {
+                        state.topLeft = position + CellPosition{0, -1};
+                    } else {
+                        state.topLeft = position + CellPosition{-1, 0};
+                    }
+                }
+                for (std::size_t i = 0; i < GetStoredProductCount(state.kind); ++i) {
+                    if (!GetInt(state.products[i], 0x7fffffff))
+                        return false;
+                }
+                return true;
+            }
+
+        private:
+            const std::uint8_t *in_;
+            const std::uint8_t *end_;
+        };
+    } // namespace Dataset
+
+    // Appends finished episodes to size-capped shards and the index from a background thread. Any number of
+    // threads may Submit; each call hands over a whole episode, so the lock is taken once per game, not per
+    // decision. Submit only waits when more than maxQueuedBytes are still waiting for the disk.
+    class DatasetWriter {
+    public:
+        explicit DatasetWriter(std::string prefix, const std::size_t shardSize = std::size_t{256} << 20,
+                               const std::size_t maxQueuedBytes = std::size_t{64} << 20) :
+            prefix_(std::move(prefix)), shardSize_(shardSize), maxQueuedBytes_(maxQueuedBytes) {}
+
+        DatasetWriter(const DatasetWriter &) = delete;
+
+        DatasetWriter &operator=(const DatasetWriter &) = delete;
+
+        ~DatasetWriter() { Stop(); }
+
+        bool Start() {
+            if (thread_.joinable()) {
+                return false;
+            }
+            index_.open(Dataset::GetIndexFilename(prefix_), std::ios::binary | std::ios::trunc);
+            if (!index_) {
+                return false;
+            }
+            const Dataset::FileHeader header{Dataset::kIndexMagic, Dataset::kVersion};
+            index_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+            shard_ = 0;
+            shardBytes_ = 0;
+            decisionCount_ = 0;
+            stopping_ = false;
+            thread_ = std::thread([this] { Run(); });
+            return true;
+        }
+
+        // Writes every episode submitted so far and closes the files.
+        void Stop() {
+            if (!thread_.joinable()) {
+                return;
+            }
+            {
+                std::lock_guard lock(mutex_);
+                stopping_ = true;
+            }
+            wakeWriter_.notify_one();
+            thread_.join();
+            out_.close();
+            index_.close();
+        }
+
+        // episode is what EpisodeRecorder::Finish produces. Returns false, dropping the episode, when the writer
+        // is not running: before Start, after Stop, or when Stop is called while Submit waits for room.
+        bool Submit(std::vector<std::uint8_t> episode) {
+            std::unique_lock lock(mutex_);
+            wakeSubmitters_.wait(lock, [this] { return queuedBytes_ <= maxQueuedBytes_ || stopping_; });
+            if (stopping_)
+                return false;
+            queuedBytes_ += episode.size();
+            queue_.push_back(std::move(episode));
+            lock.unlock();
+            wakeWriter_.notify_one();
+            return true;
+        }
+
+        [[nodiscard]] bool HasFailed() const { return failed_.load(std::memory_order_relaxed); }
+
+    private:
+        void Run() {
+            std::unique_lock lock(mutex_);
+            while (true) {
+                wakeWriter_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+                if (queue_.empty()) {
+                    return;
+                }
+                std::vector<std::uint8_t> episode = std::move(queue_.front());
+                queue_.pop_front();
+                lock.unlock();
+
+                Write(episode);
+
+                lock.lock();
+                queuedBytes_ -= episode.size();
+                wakeSubmitters_.notify_all();
+            }
+        }
+
+        void Write(const std::vector<std::uint8_t> &episode) {
+            if (!out_.is_open() || (shardBytes_ > sizeof(Dataset::FileHeader) &&
+                                    shardBytes_ + episode.size() > shardSize_)) {
+                out_.close();
+                out_.open(Dataset::GetShardFilename(prefix_, shard_), std::ios::binary | std::ios::trunc);
+                const Dataset::FileHeader header{Dataset::kShardMagic, Dataset::kVersion};
+                out_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                shard_ += 1;
+                shardBytes_ = sizeof(header);
+            }
+
+            DatasetEpisodeHeader header{};
+            std::memcpy(&header, episode.data(), sizeof(header));
+            const DatasetIndexEntry entry{decisionCount_, shardBytes_, shard_ - 1,
+                                          static_cast<std::uint32_t>(episode.size()), header.decisionCount,
+                                          header.finalScores};
+
+            // The shard is flushed before the index so that no index entry ever points past written data.
+            out_.write(reinterpret_cast<const char *>(episode.data()), static_cast<std::streamsize>(episode.size()));
+            out_.flush();
+            index_.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+            index_.flush();
+            if (!out_ || !index_) {
+                failed_.store(true, std::memory_order_relaxed);
+            }
+
+            shardBytes_ += episode.size();
+            decisionCount_ += header.decisionCount;
+        }
+
+        std::string prefix_;
+        std::size_t shardSize_;
+        std::size_t maxQueuedBytes_;
+        std::mutex mutex_;
+        std::condition_variable wakeWriter_;
+        std::condition_variable wakeSubmitters_;
+        std::deque<std::vector<std::uint8_t>> queue_;
+        std::size_t queuedBytes_ = 0;
+        // Also set while the writer is not started, so nothing is queued that no thread would ever write.
+        bool stopping_ = true;
+        std::thread thread_;
+
+        // Only touched by the writer thread while it runs.
+        std::ofstream out_;
+        std::ofstream index_;
+        std::uint32_t shard_ = 0;
+        std::uint64_t shardBytes_ = 0;
+        std::uint64_t decisionCount_ = 0;
+        std::atomic<bool> failed_{false};
+    };
+
+    // Encodes one game's decisions as they happen; owned by the thread playing that game. Each decision stores
+    // only the cells that differ from the previous one, so a quiet board costs a few bytes per decision.
+    class EpisodeRecorder {
+    public:
+        static constexpr std::uint32_t kKeyframeInterval = 64;
+
+        EpisodeRecorder(DatasetWriter *writer, const std::uint32_t seed, const int commonDivisor) :
+            writer_(writer), seed_(seed), commonDivisor_(commonDivisor), numbers_(Dataset::kCellCount),
+            cells_(Dataset::kCellCount) {}
+
+        // Call with the game the player was just asked about and the action it chose.
+        void Record(const IGameInfo &info, const PlayerAction &action) {
+            if (decisionCount_ == 0) {
+                CaptureNumbers(info);
+            }
+            const bool keyframe = decisionCount_ % kKeyframeInterval == 0;
+            if (keyframe) {
+                keyframeOffsets_.push_back(static_cast<std::uint32_t>(body_.size()));
+            }
+
+            Dataset::PutVarint(body_, static_cast<std::uint32_t>(info.GetElapsedTime()));
+            Dataset::PutVarint(body_, static_cast<std::uint32_t>(info.GetScores()));
+            body_.push_back(static_cast<std::uint8_t>(action.type));
+            Dataset::PutSigned(body_, action.cellPosition.row);
+            Dataset::PutSigned(body_, action.cellPosition.col);
+
+            changed_.clear();
+            for (int index = 0; index < Dataset::kCellCount; ++index) {
+                const CellState state = CaptureCellState(info, {index / GameManagerConfig::kBoardWidth,
+                                                                index % GameManagerConfig::kBoardWidth});
+                if (keyframe ? state.kind != CellKind::kEmpty : state != cells_[index]) {
+                    changed_.push_back(index);
+                }
+                cells_[index] = state;
+            }
+
+            Dataset::PutVarint(body_, changed_.size());
+            int previous = -1;
+            for (const int index: changed_) {
+                Dataset::PutVarint(body_, static_cast<std::uint64_t>(index - previous - 1));
+                Dataset::PutCell(body_, index, cells_[index]);
+                previous = index;
+            }
+            decisionCount_ += 1;
+        }
+
+        // Hands the episode to the writer with the game's final score and starts over for the next game. Returns
+        // false when the writer was not running and the episode was dropped.
+        bool Finish(const int finalScores) {
+            bool submitted = true;
+            if (decisionCount_ > 0) {
+                const std::size_t prefixSize = sizeof(DatasetEpisodeHeader) +
+                                               keyframeOffsets_.size() * sizeof(std::uint32_t) + numbers_.size();
+                const DatasetEpisodeHeader header{DatasetEpisodeHeader::kMagic,
+                                                  static_cast<std::uint32_t>(prefixSize + body_.size()),
+                                                  seed_,
+                                                  commonDivisor_,
+                                                  finalScores,
+                                                  decisionCount_,
+                                                  kKeyframeInterval,
+                                                  static_cast<std::uint32_t>(keyframeOffsets_.size())};
+
+                std::vector<std::uint8_t> episode(prefixSize);
+                std::memcpy(episode.data(), &header, sizeof(header));
+                for (std::size_t k = 0; k < keyframeOffsets_.size(); ++k) {
+                    const auto offset = static_cast<std::uint32_t>(prefixSize + keyframeOffsets_[k]);
+                    std::memcpy(episode.data() + sizeof(header) + k * sizeof(offset), &offset, sizeof(offset));
+                }
+                std::copy(numbers_.begin(), numbers_.end(), episode.data() + prefixSize - numbers_.size());
+                episode.insert(episode.end(), body_.begin(), body_.end());
+                submitted = writer_->Submit(std::move(episode));
+            }
+            Restart(seed_, commonDivisor_);
+            return submitted;
+        }
+
+        void Restart(const std::uint32_t seed, const int commonDivisor) {
+            seed_ = seed;
+            commonDivisor_ = commonDivisor;
+            decisionCount_ = 0;
+            body_.clear();
+            keyframeOffsets_.clear();
+        }
+
+    private:
+        void CaptureNumbers(const IGameInfo &info) {
+            for (int index = 0; index < Dataset::kCellCount; ++index) {
+                const auto *numberCell = dynamic_cast<const NumberCell *>(
+                        info.GetLayeredCell({index / GameManagerConfig::kBoardWidth,
+                                             index % GameManagerConfig::kBoardWidth})
+                                .GetBackground()
+                                .get());
+                numbers_[index] = static_cast<std::uint8_t>(numberCell ? numberCell->GetNumber() : 0);
+            }
+        }
+
+        DatasetWriter *writer_;
+        std::uint32_t seed_;
+        int commonDivisor_;
+        std::uint32_t decisionCount_ = 0;
+        std::vector<std::uint8_t> numbers_;
+        std::vector<CellState> cells_;
+        std::vector<int> changed_;
+        std::vector<std::uint32_t> keyframeOffsets_;
+        std::vector<std::uint8_t> body_;
+    };
+
+    // Wraps a player so that every decision it makes is recorded; call Finish once its game is over.
+    class RecordingGamePlayer final : public IGamePlayer {
+    public:
+        RecordingGamePlayer(IGamePlayer *player, EpisodeRecorder *recorder) : player_(player), recorder_(recorder) {}
+
+        PlayerAction GetNextAction(const IGameInfo &info) override {
+            const PlayerAction action = player_->GetNextAction(info);
+            recorder_->Record(info, action);
+            return action;
+        }
+
+    private:
+        IGamePlayer *player_;
+        EpisodeRecorder *recorder_;
+    };
+
+    // Random access to decision points by their position across all episodes, in the order the index lists
+    // them. Keeps the last episode it touched and the last decision it decoded, so reading in order decodes each
+    // record once and a random read decodes at most one keyframe interval.
+    class DatasetReader {
+    public:
+        bool Open(const std::string &prefix) {
+            prefix_ = prefix;
+            entries_.clear();
+            episodeShard_ = ~std::uint32_t{0};
+
+            std::ifstream index(Dataset::GetIndexFilename(prefix), std::ios::binary);
+            Dataset::FileHeader header{};
+            if (!index.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+                header.magic != Dataset::kIndexMagic || header.version != Dataset::kVersion) {
+                return false;
+            }
+            // Each entry has to start where the one before ended, or Read would look in the wrong episode.
+            DatasetIndexEntry entry{};
+            std::uint64_t decisionCount = 0;
+            while (index.read(reinterpret_cast<char *>(&entry), sizeof(entry))) {
+                if (entry.firstDecision != decisionCount || entry.offset < sizeof(Dataset::FileHeader) ||
+                    entry.size < sizeof(DatasetEpisodeHeader)) {
+                    entries_.clear();
+                    return false;
+                }
+                decisionCount += entry.decisionCount;
+                entries_.push_back(entry);
+            }
+            return true;
+        }
+
+        [[nodiscard]] std::size_t GetEpisodeCount() const { return entries_.size(); }
+
+        [[nodiscard]] const DatasetIndexEntry &GetEpisode(const std::size_t k) const { return entries_[k]; }
+
+        [[nodiscard]] std::uint64_t GetDecisionCount() const {
+            return entries_.empty() ? 0 : entries_.back().firstDecision + entries_.back().decisionCount;
+        }
+
+        bool Read(const std::uint64_t decision, DatasetDecision &out) {
+            const auto it = std::upper_bound(entries_.begin(), entries_.end(), decision,
+                                             [](const std::uint64_t value, const DatasetIndexEntry &entry) {
+                                                 return value < entry.firstDecision;
+                                             });
+            if (it == entries_.begin() || decision >= GetDecisionCount() || !LoadEpisode(*(it - 1))) {
+                return false;
+            }
+            const auto local = static_cast<std::uint32_t>(decision - (it - 1)->firstDecision);
+
+            DatasetEpisodeHeader header{};
+            std::memcpy(&header, episode_.data(), sizeof(header));
+            out.seed = header.seed;
+            out.commonDivisor = header.commonDivisor;
+            out.finalScores = header.finalScores;
+            const std::uint8_t *numbers =
+                    episode_.data() + sizeof(header) + header.keyframeCount * sizeof(std::uint32_t);
+            out.numbers.assign(numbers, numbers + Dataset::kCellCount);
+
+            // Reading forward within the same stretch between keyframes resumes from the last decoded decision.
+            const std::uint32_t keyframe = local / header.keyframeInterval * header.keyframeInterval;
+            if (next_ == nullptr || local + 1 < decodedCount_ || keyframe > decodedCount_) {
+                std::uint32_t offset = 0;
+                std::memcpy(&offset, episode_.data() + sizeof(header) + keyframe / header.keyframeInterval * 4,
+                            sizeof(offset));
+                next_ = episode_.data() + offset;
+                decodedCount_ = keyframe;
+            }
+            for (; decodedCount_ <= local; ++decodedCount_) {
+                if (!DecodeRecord(decodedCount_ % header.keyframeInterval == 0)) {
+                    next_ = nullptr;
+                    return false;
+                }
+            }
+
+            out.elapsedTime = decoded_.elapsedTime;
+            out.scores = decoded_.scores;
+            out.action = decoded_.action;
+            out.cells = decoded_.cells;
+            return true;
+        }
+
+    private:
+        bool LoadEpisode(const DatasetIndexEntry &entry) {
+            if (entry.shard == episodeShard_ && entry.offset == episodeOffset_) {
+                return true;
+            }
+            episodeShard_ = ~std::uint32_t{0};
+            next_ = nullptr;
+            std::ifstream shard(Dataset::GetShardFilename(prefix_, entry.shard), std::ios::binary | std::ios::ate);
+            if (!shard) {
+                return false;
+            }
+            const auto length = static_cast<std::uint64_t>(shard.tellg());
+            Dataset::FileHeader header{};
+            if (entry.offset > length || entry.size > length - entry.offset || !shard.seekg(0) ||
+                !shard.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+                header.magic != Dataset::kShardMagic || header.version != Dataset::kVersion) {
+                return false;
+            }
+            episode_.resize(entry.size);
+            if (!shard.seekg(static_cast<std::streamoff>(entry.offset)) ||
+                !shard.read(reinterpret_cast<char *>(episode_.data()), entry.size) || !IsValidEpisode(entry)) {
+                return false;
+            }
+            episodeShard_ = entry.shard;
+            episodeOffset_ = entry.offset;
+            return true;
+        }
+
+        // The header has to describe the entry that led to it and every keyframe has to start among the records,
+        // since Read indexes by both without further checks.
+        [[nodiscard]] bool IsValidEpisode(const DatasetIndexEntry &entry) const {
+            DatasetEpisodeHeader header{};
+            std::memcpy(&header, episode_.data(), sizeof(header));
+            if (header.magic != DatasetEpisodeHeader::kMagic || header.size != entry.size ||
+                header.decisionCount != entry.decisionCount || header.keyframeInterval == 0 ||
+                header.keyframeCount != (std::uint64_t{header.decisionCount} + header.keyframeInterval - 1) /
+                                                header.keyframeInterval) {
+                return false;
+            }
+            const std::uint64_t prefixSize =
+                    sizeof(header) + std::uint64_t{header.keyframeCount} * sizeof(std::uint32_t) + Dataset::kCellCount;
+            if (prefixSize > entry.size) {
+                return false;
+            }
+            for (std::uint32_t k = 0; k < header.keyframeCount; ++k) {
+                std::uint32_t offset = 0;
+                std::memcpy(&offset, episode_.data() + sizeof(header) + k * sizeof(offset), sizeof(offset));
+                if (offset < prefixSize || offset >= entry.size) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool DecodeRecord(const bool keyframe) {
+            Dataset::Reader in(next_, episode_.data() + episode_.size());
+            std::uint8_t actionType;
+            if (!in.GetInt(decoded_.elapsedTime, GameManagerConfig::kEndTime) ||
+                !in.GetInt(decoded_.scores, 0x7fffffff) || !in.GetByte(actionType) ||
+                actionType > static_cast<int>(PlayerActionType::Clear) ||
+                !in.GetSigned(decoded_.action.cellPosition.row) || !in.GetSigned(decoded_.action.cellPosition.col))
+                return false;
+            decoded_.action.type = static_cast<PlayerActionType>(actionType);
+
+            if (keyframe) {
+                decoded_.cells.resize(Dataset::kCellCount);
+                for (int index = 0; index < Dataset::kCellCount; ++index) {
+                    decoded_.cells[index] = {CellKind::kEmpty,
+                                             Direction::kTop,
+                                             {index / GameManagerConfig::kBoardWidth,
+                                              index % GameManagerConfig::kBoardWidth},
+                                             {}};
+                }
+            }
+            int changedCount;
+            if (!in.GetInt(changedCount, Dataset::kCellCount))
+                return false;
+
+            int index = -1;
+            CellState state{};
+            for (int k = 0; k < changedCount; ++k) {
+                if (!in.GetCell(index, state))
+                    return false;
+                decoded_.cells[index] = state;
+            }
+            next_ = in.GetPosition();
+            return true;
+        }
+
+        std::string prefix_;
+        std::vector<DatasetIndexEntry> entries_;
+        std::vector<std::uint8_t> episode_;
+        std::uint32_t episodeShard_ = ~std::uint32_t{0};
+        std::uint64_t episodeOffset_ = 0;
+        DatasetDecision decoded_{};
+        std::uint32_t decodedCount_ = 0;
+        const std::uint8_t *next_ = nullptr;
+    };
+} // namespace Feis
+#endif
@@ -0,0 +1,188 @@
+#ifndef DIFFERENTIAL_HARNESS_HPP
+#define DIFFERENTIAL_HARNESS_HPP
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <random>
+#include "CellState.hpp"
+#include "PDOGS.hpp"
+
+namespace Feis {
+    // Seeded stream of actions that mostly builds along the rows and columns through the collection center and
+    // points everything at it, so products actually flow, merge and score instead of every game staying empty.
+    class RandomGamePlayer final : public IGamePlayer {
+    public:
+        explicit RandomGamePlayer(const unsigned int seed) : gen_(seed) {}
+
+        PlayerAction GetNextAction(const IGameInfo &info) override {
+            constexpr int kTop = GameManager::CollectionCenterConfig::kTop;
+            constexpr int kLeft = GameManager::CollectionCenterConfig::kLeft;
+            constexpr int kGoalSize = static_cast<int>(GameManagerConfig::kGoalSize);
+
+            const unsigned int roll = gen_() % 16;
+            int row = static_cast<int>(gen_() % GameManagerConfig::kBoardHeight);
+            int col = static_cast<int>(gen_() % GameManagerConfig::kBoardWidth);
+
+            if (roll == 0) {
+                return {PlayerActionType::Clear, {row, col}};
+            }
+            if (roll <= 2) {
+                return {static_cast<PlayerActionType>(1 + gen_() % 12), {row, col}};
+            }
+
+            // Pick a cell in the cross-shaped band around the collection center and aim it at the center. Mining
+            // machines get a few tries to land on a number so that they actually produce something.
+            for (int attempt = 0; attempt < (roll <= 5 ? 8 : 1); ++attempt) {
+                row = static_cast<int>(gen_() % GameManagerConfig::kBoardHeight);
+                col = static_cast<int>(gen_() % GameManagerConfig::kBoardWidth);
+                if (gen_() % 2 == 0) {
+                    row = kTop + static_cast<int>(gen_() % kGoalSize);
+                } else {
+                    col = kLeft + static_cast<int>(gen_() % kGoalSize);
+                }
+                if (info.GetLayeredCell({row, col}).GetBackground() != nullptr) {
+                    break;
+                }
+            }
+
+            const bool rowInBand = row >= kTop && row < kTop + kGoalSize;
+            Direction direction;
+            if (rowInBand) {
+                direction = col < kLeft ? Direction::kRight : Direction::kLeft;
+            } else {
+                direction = row < kTop ? Direction::kBottom : Direction::kTop;
+            }
+
+            if (roll <= 5) {
+                constexpr PlayerActionType kMiners[] = {
+                        PlayerActionType::BuildTopOutMiningMachine, PlayerActionType::BuildRightOutMiningMachine,
+                        PlayerActionType::BuildBottomOutMiningMachine, PlayerActionType::BuildLeftOutMiningMachine};
+                return {kMiners[static_cast<int>(direction)], {row, col}};
+            }
+            if (roll <= 7) {
+                constexpr PlayerActionType kCombiners[] = {
+                        PlayerActionType::BuildTopOutCombiner, PlayerActionType::BuildRightOutCombiner,
+                        PlayerActionType::BuildBottomOutCombiner, PlayerActionType::BuildLeftOutCombiner};
+                return {kCombiners[static_cast<int>(direction)], {row, col}};
+            }
+            constexpr PlayerActionType kConveyors[] = {
+                    PlayerActionType::BuildBottomToTopConveyor, PlayerActionType::BuildLeftToRightConveyor,
+                    PlayerActionType::BuildTopToBottomConveyor, PlayerActionType::BuildRightToLeftConveyor};
+            return {kConveyors[static_cast<int>(direction)], {row, col}};
+        }
+
+    private:
+        std::mt19937 gen_;
+    };
+
+    struct Divergence {
+        unsigned int seed;
+        int commonDivisor;
+        int tick;
+        CellPosition cellPosition;
+        CellState referenceState;
+        CellState candidateState;
+        int referenceScores;
+        int candidateScores;
+    };
+
+    inline void PrintDivergence(std::ostream &out, const Divergence &divergence) {
+        const auto print = [&out](const char *name, const CellState &state) {
+            out << "  " << name << ": kind " << static_cast<int>(state.kind) << " dir "
+                << static_cast<int>(state.direction) << " top-left (" << state.topLeft.row << ", "
+                << state.topLeft.col << ") products";
+            for (const int product: state.products) {
+                out << " " << product;
+            }
+            out << "\n";
+        };
+
+        out << "divergence: seed " << divergence.seed << " divisor " << divergence.commonDivisor << " tick "
+            << divergence.tick << " scores " << divergence.referenceScores << " vs " << divergence.candidateScores;
+        if (divergence.cellPosition.row < 0) {
+            out << " (board identical)\n";
+            return;
+        }
+        out << " cell (" << divergence.cellPosition.row << ", " << divergence.cellPosition.col << ")\n";
+        print("reference", divergence.referenceState);
+        print("candidate", divergence.candidateState);
+    }
+
+    // Runs today's GameManager and TCandidate side by side, each driven by its own RandomGamePlayer with the same
+    // seed, and compares the state hash after every tick. TCandidate is constructed like GameManager and must
+    // provide Update, IsGameOver, GetScores, GetElapsedTime and a CaptureCellState overload found by lookup.
+    template<typename TCandidate>
+    class DifferentialHarness {
+    public:
+        std::optional<Divergence> RunGame(const int commonDivisor, const unsigned int seed,
+                                          const unsigned int actionSeed) {
+            RandomGamePlayer referencePlayer(actionSeed);
+            RandomGamePlayer candidatePlayer(actionSeed);
+            const auto reference = std::make_unique<GameManager>(&referencePlayer, commonDivisor, seed);
+            const auto candidate = std::make_unique<TCandidate>(&candidatePlayer, commonDivisor, seed);
+
+            if (auto divergence = Compare(*reference, *candidate, commonDivisor, seed)) {
+                return divergence;
+            }
+
+            while (!reference->IsGameOver() || !candidate->IsGameOver()) {
+                reference->Update();
+                candidate->Update();
+                ticks_ += 1;
+
+                if (auto divergence = Compare(*reference, *candidate, commonDivisor, seed)) {
+                    return divergence;
+                }
+            }
+            return std::nullopt;
+        }
+
+        // Seeds firstSeed .. firstSeed + seedCount - 1, cycling the common divisor through 1 .. 14.
+        std::optional<Divergence> Run(const unsigned int firstSeed, const int seedCount) {
+            for (int k = 0; k < seedCount; ++k) {
+                const unsigned int seed = firstSeed + static_cast<unsigned int>(k);
+                if (auto divergence = RunGame(1 + static_cast<int>(seed % 14), seed, seed * 7919u + 1)) {
+                    return divergence;
+                }
+                games_ += 1;
+            }
+            return std::nullopt;
+        }
+
+        [[nodiscard]] int GetGamesCompared() const { return games_; }
+
+        [[nodiscard]] long long GetTicksCompared() const { return ticks_; }
+
+    private:
+        static std::optional<Divergence> Compare(const GameManager &reference, const TCandidate &candidate,
+                                                 const int commonDivisor, const unsigned int seed) {
+            if (reference.GetScores() == candidate.GetScores() &&
+                reference.GetElapsedTime() == candidate.GetElapsedTime() &&
+                HashGameState(reference) == HashGameState(candidate)) {
+                return std::nullopt;
+            }
+
+            Divergence divergence{seed, commonDivisor, reference.GetElapsedTime(), {-1, -1}, {}, {},
+                                  reference.GetScores(), candidate.GetScores()};
+
+            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                    const CellState referenceState = CaptureCellState(reference, {row, col});
+                    const CellState candidateState = CaptureCellState(candidate, {row, col});
+
+                    if (referenceState != candidateState) {
+                        divergence.cellPosition = {row, col};
+                        divergence.referenceState = referenceState;
+                        divergence.candidateState = candidateState;
+                        return divergence;
+                    }
+                }
+            }
+            return divergence;
+        }
+
+        int games_ = 0;
+        long long ticks_ = 0;
+    };
+} // namespace Feis
+#endif
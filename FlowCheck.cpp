@@ -0,0 +1,69 @@
+#include <iostream>
+#include "PDOGS.hpp"
+
+namespace {
+    class IdleGamePlayer final : public Feis::IGamePlayer {
+    public:
+        Feis::PlayerAction GetNextAction(const Feis::IGameInfo &info) override { return {}; }
+    };
+
+    struct CombinerCase {
+        const char *name;
+        Feis::Direction direction;
+        Feis::CellPosition topLeft;
+        Feis::CellPosition mainCell;
+        Feis::CellPosition secondCell;
+        Feis::CellPosition miner;
+    };
+} // namespace
+
+// Checks GameBoard's flow status around combiners: for each of the four output directions a combiner is built
+// against the collection center with a mining machine feeding its second cell, and both combiner cells and the
+// mining machine must come out connected. Usage: flow_check. Exits with 1 if any of them does not.
+int main() {
+    using Feis::CellPosition;
+    using Feis::Direction;
+    constexpr int kTop = Feis::GameManager::CollectionCenterConfig::kTop;
+    constexpr int kLeft = Feis::GameManager::CollectionCenterConfig::kLeft;
+    constexpr int kGoalSize = static_cast<int>(Feis::GameManagerConfig::kGoalSize);
+
+    const CombinerCase cases[] = {
+            {"top", Direction::kTop, {kTop + kGoalSize, kLeft - 1}, {kTop + kGoalSize, kLeft},
+             {kTop + kGoalSize, kLeft - 1}, {kTop + kGoalSize + 1, kLeft - 1}},
+            {"right", Direction::kRight, {kTop - 1, kLeft - 1}, {kTop, kLeft - 1}, {kTop - 1, kLeft - 1},
+             {kTop - 1, kLeft - 2}},
+            {"bottom", Direction::kBottom, {kTop - 1, kLeft}, {kTop - 1, kLeft}, {kTop - 1, kLeft + 1},
+             {kTop - 2, kLeft + 1}},
+            {"left", Direction::kLeft, {kTop, kLeft + kGoalSize}, {kTop, kLeft + kGoalSize},
+             {kTop + 1, kLeft + kGoalSize}, {kTop + 1, kLeft + kGoalSize + 1}},
+    };
+
+    int failures = 0;
+    for (const CombinerCase &combinerCase: cases) {
+        IdleGamePlayer player;
+        Feis::GameManager gameManager(&player, 1, 1);
+        Feis::GameBoard &board = gameManager.GetBoard();
+
+        for (const CellPosition position: {combinerCase.mainCell, combinerCase.secondCell, combinerCase.miner}) {
+            board.Clear(position);
+        }
+
+        const bool built = board.Build<Feis::CombinerCell>(combinerCase.topLeft, combinerCase.direction) &&
+                           board.Build<Feis::MiningMachineCell>(combinerCase.miner, combinerCase.direction);
+        const bool connected = built &&
+                               board.GetFlowStatus(combinerCase.mainCell) == Feis::FlowStatus::kConnected &&
+                               board.GetFlowStatus(combinerCase.secondCell) == Feis::FlowStatus::kConnected &&
+                               board.GetFlowStatus(combinerCase.miner) == Feis::FlowStatus::kConnected;
+        if (!connected) {
+            std::cout << combinerCase.name << " combiner: " << (built ? "not connected" : "could not be built")
+                      << "\n";
+            failures += 1;
+        }
+    }
+
+    if (failures != 0) {
+        return 1;
+    }
+    std::cout << "4 combiner directions: every cell connected\n";
+    return 0;
+}
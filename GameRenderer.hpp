@@ -11,24 +11,37 @@ public:
 
     explicit GameRenderer(sf::RenderWindow *window) : renderer_(window) {}
 
-    void Render(const Feis::IGameInfo &gameManagerInfo) {
+    // productMotion and interpolation slide conveyor products between ticks when the game runs slower than frames.
+    void Render(const Feis::IGameInfo &gameManagerInfo, const Feis::ProductMotion *productMotion = nullptr,
+                const float interpolation = 1.0f) {
+        PDOGS_PROFILE_SCOPE(Feis::ProfilePhase::kRender);
         renderer_.Clear();
 
-        for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
-            for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
-                layeredCellRenderer_.RenderPassOne(gameManagerInfo, renderer_, {row, col});
+        {
+            PDOGS_PROFILE_SCOPE(Feis::ProfilePhase::kRenderPassOne);
+            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                    layeredCellRenderer_.RenderPassOne(gameManagerInfo, renderer_, {row, col});
+                }
             }
         }
 
-        for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
-            for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
-                layeredCellRenderer_.RenderPassTwo(gameManagerInfo, renderer_, {row, col});
+        {
+            PDOGS_PROFILE_SCOPE(Feis::ProfilePhase::kRenderPassTwo);
+            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                    layeredCellRenderer_.RenderPassTwo(gameManagerInfo, renderer_, {row, col}, productMotion,
+                                                       interpolation);
+                }
             }
         }
 
-        for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
-            for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
-                layeredCellRenderer_.RenderPassThree(gameManagerInfo, renderer_, {row, col});
+        {
+            PDOGS_PROFILE_SCOPE(Feis::ProfilePhase::kRenderPassThree);
+            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                    layeredCellRenderer_.RenderPassThree(gameManagerInfo, renderer_, {row, col});
+                }
             }
         }
 
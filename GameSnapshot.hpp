@@ -0,0 +1,277 @@
+#ifndef GAME_SNAPSHOT_HPP
+#define GAME_SNAPSHOT_HPP
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "PDOGS.hpp"
+
+namespace Feis {
+    // For every conveyor slot, the slot its product sat in one tick earlier: kConveyorBufferSize means it has just
+    // come in from behind. Lets the renderer slide products between ticks instead of letting them jump.
+    struct ProductMotion {
+        static constexpr std::int8_t kEntered = static_cast<std::int8_t>(GameManagerConfig::kConveyorBufferSize);
+
+        bool valid = false;
+        std::array<std::array<std::int8_t, GameManagerConfig::kConveyorBufferSize>,
+                   GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight>
+                sourceSlots{};
+
+        // Fractional slot of the product now in slot, interpolation (0 to 1) along its way from where it was.
+        [[nodiscard]] float GetSlot(const CellPosition cellPosition, const std::size_t slot,
+                                    const float interpolation) const {
+            if (!valid) {
+                return static_cast<float>(slot);
+            }
+            const float source = sourceSlots[cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col][slot];
+            return source + (static_cast<float>(slot) - source) * interpolation;
+        }
+    };
+
+    // Works out ProductMotion from one tick to the next. Products never overtake each other on a conveyor: in one
+    // tick at most one leaves at the front and one enters at the back, and every other product moves forward by
+    // at most one slot, so lining up the two orders is enough to know where each product came from.
+    class ProductMotionTracker {
+    public:
+        // Call after every tick whose motion may be shown.
+        void Update(const GameManager &gameManager, ProductMotion *motion) {
+            for (int row = 0, index = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col, ++index) {
+                    const auto &foreground = gameManager.GetLayeredCell({row, col}).GetForeground();
+                    const auto *conveyor = dynamic_cast<const ConveyorCell *>(foreground.get());
+                    auto &sourceSlots = motion->sourceSlots[index];
+
+                    if (conveyor == nullptr) {
+                        previous_[index] = nullptr;
+                        continue;
+                    }
+
+                    std::array<int, kSize> products{};
+                    for (std::size_t slot = 0; slot < kSize; ++slot) {
+                        products[slot] = conveyor->GetProduct(slot);
+                        sourceSlots[slot] = static_cast<std::int8_t>(slot);
+                    }
+                    if (previous_[index] == foreground) {
+                        Match(previousProducts_[index], products, &sourceSlots);
+                    } else {
+                        previous_[index] = foreground;
+                    }
+                    previousProducts_[index] = products;
+                }
+            }
+            motion->valid = true;
+        }
+
+    private:
+        static constexpr int kCellCount = GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight;
+        static constexpr std::size_t kSize = GameManagerConfig::kConveyorBufferSize;
+
+        static void Match(const std::array<int, kSize> &before, const std::array<int, kSize> &after,
+                          std::array<std::int8_t, kSize> *sourceSlots) {
+            std::array<int, kSize> beforeSlots{};
+            std::array<int, kSize> afterSlots{};
+            int beforeCount = 0;
+            int afterCount = 0;
+            for (std::size_t slot = 0; slot < kSize; ++slot) {
+                if (before[slot] != 0) {
+                    beforeSlots[beforeCount++] = static_cast<int>(slot);
+                }
+                if (after[slot] != 0) {
+                    afterSlots[afterCount++] = static_cast<int>(slot);
+                }
+            }
+
+            for (int left = 0; left <= 1; ++left) {
+                const int kept = beforeCount - left;
+                if (kept < 0 || afterCount - kept < 0 || afterCount - kept > 1) {
+                    continue;
+                }
+
+                bool consistent = true;
+                for (int k = 0; k < kept && consistent; ++k) {
+                    const int from = beforeSlots[k + left];
+                    const int to = afterSlots[k];
+                    consistent = before[from] == after[to] && to <= from && from - to <= 1;
+                }
+                if (!consistent) {
+                    continue;
+                }
+
+                for (int k = 0; k < kept; ++k) {
+                    (*sourceSlots)[afterSlots[k]] = static_cast<std::int8_t>(beforeSlots[k + left]);
+                }
+                if (afterCount > kept) {
+                    (*sourceSlots)[afterSlots[kept]] = ProductMotion::kEntered;
+                }
+                return;
+            }
+        }
+
+        // Holding on to the cells keeps their addresses from being reused by a new conveyor.
+        std::array<std::shared_ptr<ForegroundCell>, kCellCount> previous_;
+        std::array<std::array<int, kSize>, kCellCount> previousProducts_{};
+    };
+
+    // A read-only copy of a game that another thread can render while the simulation keeps going. It owns its own
+    // cell objects: a cell is cloned the first time it shows up and from then on only its state is copied over,
+    // so once the board stops changing, Capture does not allocate.
+    class GameSnapshot final : public IGameManager {
+    public:
+        GameSnapshot() = default;
+
+        GameSnapshot(const GameSnapshot &) = delete;
+
+        GameSnapshot &operator=(const GameSnapshot &) = delete;
+
+        ~GameSnapshot() override = default;
+
+        // Must run on the thread that updates gameManager, while nobody reads this snapshot.
+        void Capture(const GameManager &gameManager) {
+            for (int row = 0, index = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col, ++index) {
+                    const LayeredCell &source = gameManager.GetLayeredCell({row, col});
+                    LayeredCell &target = layeredCells_[row][col];
+
+                    if (target.GetBackground() != source.GetBackground()) {
+                        // Background cells never change once placed, so sharing them is safe.
+                        target.SetBackground(source.GetBackground());
+                    }
+                    CaptureForeground(source.GetForeground(), {row, col}, index);
+
+                    distances_[index] = gameManager.GetDistanceToCollectionCenter({row, col});
+                    flowStatuses_[index] = gameManager.GetFlowStatus({row, col});
+                }
+            }
+
+            elapsedTime_ = gameManager.GetElapsedTime();
+            endTime_ = gameManager.GetEndTime();
+            scores_ = gameManager.GetScores();
+            if (levelInfo_.empty() || commonDivisor_ != gameManager.GetCommonDivisor()) {
+                commonDivisor_ = gameManager.GetCommonDivisor();
+                levelInfo_ = gameManager.GetLevelInfo();
+            }
+        }
+
+        [[nodiscard]] std::string GetLevelInfo() const override { return levelInfo_; }
+
+        [[nodiscard]] const LayeredCell &GetLayeredCell(const CellPosition cellPosition) const override {
+            return layeredCells_[cellPosition.row][cellPosition.col];
+        }
+
+        [[nodiscard]] bool IsScoredProduct(const int number) const override { return number % commonDivisor_ == 0; }
+
+        [[nodiscard]] int GetScores() const override { return scores_; }
+
+        [[nodiscard]] int GetEndTime() const override { return endTime_; }
+
+        [[nodiscard]] int GetElapsedTime() const override { return elapsedTime_; }
+
+        [[nodiscard]] bool IsGameOver() const override { return elapsedTime_ >= endTime_; }
+
+        [[nodiscard]] int GetDistanceToCollectionCenter(const CellPosition cellPosition) const override {
+            return distances_[cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col];
+        }
+
+        [[nodiscard]] FlowStatus GetFlowStatus(const CellPosition cellPosition) const override {
+            return flowStatuses_[cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col];
+        }
+
+        void OnProductReceived(int number, ProductTag tag) override {}
+
+        [[nodiscard]] const ProductMotion &GetProductMotion() const { return productMotion_; }
+
+        // Filled by the simulation thread, next to Capture, when motion should be interpolated.
+        [[nodiscard]] ProductMotion &GetProductMotion() { return productMotion_; }
+
+    private:
+        static constexpr int kCellCount = GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight;
+
+        // Clones a cell the snapshot has not seen yet, or copies the state of one it has into its existing clone.
+        class CopyVisitor final : public CellVisitor {
+        public:
+            CopyVisitor(GameSnapshot *snapshot, ForegroundCell *target) : snapshot_(snapshot), target_(target) {}
+
+            [[nodiscard]] std::shared_ptr<ForegroundCell> TakeClone() { return std::move(clone_); }
+
+            void Visit(const CollectionCenterCell *cell) const override {
+                if (!target_) {
+                    clone_ = std::make_shared<CollectionCenterCell>(cell->GetTopLeftCellPosition(), snapshot_);
+                }
+            }
+
+            void Visit(const MiningMachineCell *cell) const override { Copy(cell); }
+
+            void Visit(const ConveyorCell *cell) const override { Copy(cell); }
+
+            void Visit(const CombinerCell *cell) const override { Copy(cell); }
+
+            void Visit(const WallCell *cell) const override {
+                if (!target_) {
+                    clone_ = std::make_shared<WallCell>(*cell);
+                }
+            }
+
+        private:
+            template<typename TCell>
+            void Copy(const TCell *cell) const {
+                if (target_) {
+                    *static_cast<TCell *>(target_) = *cell;
+                } else {
+                    clone_ = std::make_shared<TCell>(*cell);
+                }
+            }
+
+            GameSnapshot *snapshot_;
+            ForegroundCell *target_;
+            mutable std::shared_ptr<ForegroundCell> clone_;
+        };
+
+        void CaptureForeground(const std::shared_ptr<ForegroundCell> &source, const CellPosition cellPosition,
+                               const int index) {
+            LayeredCell &target = layeredCells_[cellPosition.row][cellPosition.col];
+
+            if (source == nullptr) {
+                if (sources_[index] != nullptr) {
+                    sources_[index] = nullptr;
+                    target.SetForeground(nullptr);
+                }
+                return;
+            }
+
+            const CellPosition topLeft = source->GetTopLeftCellPosition();
+            if (topLeft != cellPosition) {
+                // The top-left cell comes first in row-major order and already holds this cell's clone.
+                if (sources_[index] != source) {
+                    sources_[index] = source;
+                    target.SetForeground(layeredCells_[topLeft.row][topLeft.col].GetForeground());
+                }
+                return;
+            }
+
+            // sources_ keeps the live cell alive, so a new cell can never reuse the address of one we cloned.
+            const bool seen = sources_[index] == source;
+            CopyVisitor visitor(this, seen ? target.GetForeground().get() : nullptr);
+            source->Accept(&visitor);
+
+            if (!seen) {
+                sources_[index] = source;
+                target.SetForeground(visitor.TakeClone());
+                assert(target.GetForeground() != nullptr);
+            }
+        }
+
+        std::array<std::array<LayeredCell, GameManagerConfig::kBoardWidth>, GameManagerConfig::kBoardHeight>
+                layeredCells_;
+        std::array<std::shared_ptr<ForegroundCell>, kCellCount> sources_;
+        std::array<int, kCellCount> distances_{};
+        std::array<FlowStatus, kCellCount> flowStatuses_{};
+        int elapsedTime_ = 0;
+        int endTime_ = 0;
+        int scores_ = 0;
+        int commonDivisor_ = 1;
+        std::string levelInfo_;
+        ProductMotion productMotion_;
+    };
+} // namespace Feis
+#endif
@@ -0,0 +1,530 @@
+#ifndef GAME_STATE_FILE_HPP
+#define GAME_STATE_FILE_HPP
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "CellState.hpp"
+#include "PDOGS.hpp"
+
+namespace Feis {
+    // On-disk layout, integers in host byte order like ReplayFile:
+    //
+    // uint32 magic, version and GameManagerConfig::kEngineVersion, then varints: elapsed time, last board change
+    // time, end time, zigzag common divisor, scores, delivered and scored product counts, board tick, zigzag
+    // products in flight, then a byte for the skip-dead setting.
+    // Backgrounds: varint count of number cells, then per cell a varint gap from the previous cell index and the
+    // number as a varint.
+    // Entities: varint count, then per entity a varint gap from the previous entity's top-left cell index, a tag
+    // byte (kind | direction << 3) and its contents: a conveyor's 10 products and their tags as varint pairs, a
+    // combiner's first and second slot product then their tags, a mining machine's cycle counter and the zigzag
+    // tick it went idle at (-1 when running). Walls and the collection center have no contents.
+    // Last, a uint64 FNV-1a checksum of every byte before it.
+    //
+    // Product tags refer to an attached LineageTracer; the tracer itself is not part of the state.
+    namespace GameState {
+        constexpr std::uint32_t kMagic = 0x53474450; // "PDGS"
+        constexpr std::uint32_t kVersion = 1;
+        constexpr int kCellCount = GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight;
+        constexpr std::size_t kBufferSize = 4096;
+        constexpr std::uint64_t kChecksumSeed = 14695981039346656037ull;
+
+        inline std::uint64_t AddToChecksum(std::uint64_t checksum, const std::uint8_t *data, const std::size_t size) {
+            for (std::size_t i = 0; i < size; ++i) {
+                checksum = (checksum ^ data[i]) * 1099511628211ull;
+            }
+            return checksum;
+        }
+
+        inline CellPosition GetCellPosition(const int index) {
+            return {index / GameManagerConfig::kBoardWidth, index % GameManagerConfig::kBoardWidth};
+        }
+    } // namespace GameState
+
+    // Writes a game's complete state through a fixed buffer, so the size of the game never decides how much memory
+    // a save takes. One writer can be reused for any number of saves.
+    class GameStateWriter {
+    public:
+        bool Write(std::ostream &out, const GameManager &gameManager) {
+            out_ = &out;
+            size_ = 0;
+            checksum_ = GameState::kChecksumSeed;
+
+            const GameBoard &board = gameManager.GetBoard();
+            PutRaw(GameState::kMagic);
+            PutRaw(GameState::kVersion);
+            PutRaw(GameManagerConfig::kEngineVersion);
+            PutVarint(static_cast<std::uint32_t>(gameManager.GetElapsedTime()));
+            PutVarint(static_cast<std::uint32_t>(gameManager.GetLastBoardChangeTime()));
+            PutVarint(static_cast<std::uint32_t>(gameManager.GetEndTime()));
+            PutSigned(gameManager.GetCommonDivisor());
+            PutVarint(static_cast<std::uint32_t>(gameManager.GetScores()));
+            PutVarint(static_cast<std::uint64_t>(gameManager.GetDeliveredProductCount()));
+            PutVarint(static_cast<std::uint64_t>(gameManager.GetScoredProductCount()));
+            PutVarint(static_cast<std::uint64_t>(board.GetTick()));
+            PutSigned(board.GetProductsInFlight());
+            PutByte(board.GetSkipDeadEntities() ? 1 : 0);
+
+            int count = 0;
+            for (int index = 0; index < GameState::kCellCount; ++index) {
+                count += GetNumber(board, index) != 0 ? 1 : 0;
+            }
+            PutVarint(static_cast<std::uint64_t>(count));
+            for (int index = 0, previous = -1; index < GameState::kCellCount; ++index) {
+                if (const int number = GetNumber(board, index); number != 0) {
+                    PutVarint(static_cast<std::uint64_t>(index - previous - 1));
+                    PutVarint(static_cast<std::uint32_t>(number));
+                    previous = index;
+                }
+            }
+
+            count = 0;
+            for (int index = 0; index < GameState::kCellCount; ++index) {
+                count += IsTopLeft(board, index) ? 1 : 0;
+            }
+            PutVarint(static_cast<std::uint64_t>(count));
+            for (int index = 0, previous = -1; index < GameState::kCellCount; ++index) {
+                if (IsTopLeft(board, index)) {
+                    PutVarint(static_cast<std::uint64_t>(index - previous - 1));
+                    PutEntity(board, index);
+                    previous = index;
+                }
+            }
+
+            Flush();
+            const std::uint64_t checksum = checksum_;
+            out.write(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+            return static_cast<bool>(out);
+        }
+
+    private:
+        static int GetNumber(const GameBoard &board, const int index) {
+            const auto *numberCell = dynamic_cast<const NumberCell *>(
+                    board.GetLayeredCell(GameState::GetCellPosition(index)).GetBackground().get());
+            return numberCell ? numberCell->GetNumber() : 0;
+        }
+
+        static bool IsTopLeft(const GameBoard &board, const int index) {
+            const auto &foreground = board.GetLayeredCell(GameState::GetCellPosition(index)).GetForeground();
+            return foreground && foreground->GetTopLeftCellPosition() == GameState::GetCellPosition(index);
+        }
+
+        void PutEntity(const GameBoard &board, const int index) {
+            const CellPosition position = GameState::GetCellPosition(index);
+            const CellState state = CaptureCellState(board.GetLayeredCell(position), position);
+            ForegroundCell *cell = board.GetLayeredCell(position).GetForeground().get();
+            PutByte(static_cast<std::uint8_t>(static_cast<int>(state.kind) | static_cast<int>(state.direction) << 3));
+
+            switch (state.kind) {
+                case CellKind::kConveyor:
+                    for (std::size_t i = 0; i < GameManagerConfig::kConveyorBufferSize; ++i) {
+                        PutVarint(static_cast<std::uint32_t>(state.products[i]));
+                        PutVarint(static_cast<ConveyorCell *>(cell)->GetProductTag(i));
+                    }
+                    break;
+                case CellKind::kCombiner:
+                    PutVarint(static_cast<std::uint32_t>(state.products[0]));
+                    PutVarint(static_cast<std::uint32_t>(state.products[1]));
+                    PutVarint(static_cast<CombinerCell *>(cell)->GetFirstSlotTag());
+                    PutVarint(static_cast<CombinerCell *>(cell)->GetSecondSlotTag());
+                    break;
+                case CellKind::kMiningMachine:
+                    PutVarint(static_cast<std::uint32_t>(state.products[0]));
+                    PutSigned(board.GetIdleSince(index));
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        template<typename T>
+        void PutRaw(const T value) {
+            Reserve(sizeof(value));
+            std::memcpy(buffer_.data() + size_, &value, sizeof(value));
+            size_ += sizeof(value);
+        }
+
+        void PutByte(const std::uint8_t value) {
+            Reserve(1);
+            buffer_[size_++] = value;
+        }
+
+        void PutVarint(std::uint64_t value) {
+            Reserve(10);
+            while (value >= 0x80) {
+                buffer_[size_++] = static_cast<std::uint8_t>(value | 0x80);
+                value >>= 7;
+            }
+            buffer_[size_++] = static_cast<std::uint8_t>(value);
+        }
+
+        void PutSigned(const std::int64_t value) {
+            PutVarint((static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+        }
+
+        void Reserve(const std::size_t size) {
+            if (size_ + size > buffer_.size()) {
+                Flush();
+            }
+        }
+
+        void Flush() {
+            checksum_ = GameState::AddToChecksum(checksum_, buffer_.data(), size_);
+            out_->write(reinterpret_cast<const char *>(buffer_.data()), static_cast<std::streamsize>(size_));
+            size_ = 0;
+        }
+
+        std::ostream *out_ = nullptr;
+        std::array<std::uint8_t, GameState::kBufferSize> buffer_{};
+        std::size_t size_ = 0;
+        std::uint64_t checksum_ = GameState::kChecksumSeed;
+    };
+
+    // Restores what GameStateWriter wrote into an existing game, whatever it held before; the game keeps its player
+    // and anything attached to it. The stream is read to its end and the whole state is decoded and checked before
+    // the game is touched, so a load that returns false leaves the game exactly as it was. Applying it keeps cells
+    // that already hold the right entity, shares one NumberCell per number, and reuses the loader's own buffers from
+    // one load to the next, so a load allocates only for entities it actually has to build.
+    class GameStateLoader {
+    public:
+        GameStateLoader() = default;
+
+        GameStateLoader(const GameStateLoader &) = delete;
+
+        GameStateLoader &operator=(const GameStateLoader &) = delete;
+
+        bool Load(std::istream &in, GameManager &gameManager) {
+            if (!Read(in) || !Decode())
+                return false;
+            Apply(gameManager);
+            return true;
+        }
+
+    private:
+        struct Entity {
+            int index;
+            CellState state;
+            std::array<ProductTag, GameManagerConfig::kConveyorBufferSize> tags;
+            long long idleSince;
+        };
+
+        // Reads everything left in the stream and checks the trailing checksum.
+        bool Read(std::istream &in) {
+            payload_.clear();
+            while (in) {
+                in.read(reinterpret_cast<char *>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+                payload_.insert(payload_.end(), buffer_.begin(), buffer_.begin() + in.gcount());
+            }
+            if (payload_.size() < sizeof(std::uint64_t))
+                return false;
+
+            end_ = payload_.size() - sizeof(std::uint64_t);
+            std::uint64_t expected;
+            std::memcpy(&expected, payload_.data() + end_, sizeof(expected));
+            return GameState::AddToChecksum(GameState::kChecksumSeed, payload_.data(), end_) == expected;
+        }
+
+        bool Decode() {
+            position_ = 0;
+            std::uint32_t magic = 0, version = 0, engineVersion = 0;
+            if (!GetRaw(magic) || !GetRaw(version) || !GetRaw(engineVersion) || magic != GameState::kMagic ||
+                version != GameState::kVersion || engineVersion != GameManagerConfig::kEngineVersion)
+                return false;
+
+            std::int64_t commonDivisor, productsInFlight;
+            std::uint64_t deliveredProducts, scoredProducts, tick;
+            std::uint8_t skipDeadEntities;
+            if (!GetInt(elapsedTime_) || !GetInt(lastBoardChangeTime_) || !GetInt(endTime_) ||
+                !GetSigned(commonDivisor) || commonDivisor == 0 || commonDivisor < INT_MIN || commonDivisor > INT_MAX ||
+                !GetInt(scores_) || !GetVarint(deliveredProducts) || !GetVarint(scoredProducts) || !GetVarint(tick) ||
+                !GetSigned(productsInFlight) || productsInFlight < INT_MIN || productsInFlight > INT_MAX ||
+                !GetByte(skipDeadEntities) || skipDeadEntities > 1)
+                return false;
+
+            commonDivisor_ = static_cast<int>(commonDivisor);
+            deliveredProducts_ = static_cast<long long>(deliveredProducts);
+            scoredProducts_ = static_cast<long long>(scoredProducts);
+            tick_ = static_cast<long long>(tick);
+            productsInFlight_ = static_cast<int>(productsInFlight);
+            skipDeadEntities_ = skipDeadEntities != 0;
+            return DecodeBackgrounds() && DecodeEntities() && position_ == end_;
+        }
+
+        bool DecodeBackgrounds() {
+            int count;
+            if (!GetInt(count, GameState::kCellCount))
+                return false;
+
+            numbers_.fill(0);
+            for (int k = 0, index = -1; k < count; ++k) {
+                int number;
+                if (!GetNextIndex(index) || !GetInt(number, 255) || number == 0)
+                    return false;
+                numbers_[index] = static_cast<std::uint8_t>(number);
+            }
+            return true;
+        }
+
+        bool DecodeEntities() {
+            int count;
+            if (!GetInt(count, GameState::kCellCount))
+                return false;
+
+            covered_.fill(false);
+            entities_.clear();
+            for (int k = 0, index = -1; k < count; ++k) {
+                if (!GetNextIndex(index) || !DecodeEntity(index))
+                    return false;
+            }
+            return true;
+        }
+
+        bool DecodeEntity(const int index) {
+            std::uint8_t tag;
+            if (!GetByte(tag))
+                return false;
+
+            const CellPosition position = GameState::GetCellPosition(index);
+            Entity entity{index, {static_cast<CellKind>(tag & 7), static_cast<Direction>(tag >> 3 & 3), position, {}},
+                          {}, -1};
+            const auto [height, width] = GetFootprint(entity.state);
+            if (entity.state.kind == CellKind::kEmpty || entity.state.kind > CellKind::kWall || tag >> 5 != 0 ||
+                position.row + height > GameManagerConfig::kBoardHeight ||
+                position.col + width > GameManagerConfig::kBoardWidth)
+                return false;
+
+            for (int i = 0; i < height; ++i) {
+                for (int j = 0; j < width; ++j) {
+                    const int cellIndex = index + i * GameManagerConfig::kBoardWidth + j;
+                    if (covered_[cellIndex])
+                        return false;
+                    covered_[cellIndex] = true;
+                }
+            }
+
+            switch (entity.state.kind) {
+                case CellKind::kConveyor:
+                    for (std::size_t i = 0; i < GameManagerConfig::kConveyorBufferSize; ++i) {
+                        if (!GetInt(entity.state.products[i]) || !GetTag(entity.tags[i]))
+                            return false;
+                    }
+                    break;
+                case CellKind::kCombiner:
+                    if (!GetInt(entity.state.products[0]) || !GetInt(entity.state.products[1]) ||
+                        !GetTag(entity.tags[0]) || !GetTag(entity.tags[1]))
+                        return false;
+                    break;
+                case CellKind::kMiningMachine: {
+                    std::int64_t idleSince;
+                    if (!GetInt(entity.state.products[0]) || !GetSigned(idleSince))
+                        return false;
+                    entity.idleSince = idleSince;
+                    break;
+                }
+                default:
+                    break;
+            }
+            entities_.push_back(entity);
+            return true;
+        }
+
+        void Apply(GameManager &gameManager) {
+            // Skipped mining machines would have their counters moved by every build next to them, so nothing is
+            // skipped until the board is complete.
+            GameBoard &board = gameManager.GetBoard();
+            board.SetSkipDeadEntities(false);
+            ApplyBackgrounds(board);
+            ApplyEntities(board, gameManager);
+
+            gameManager.SetLevel(commonDivisor_, endTime_);
+            gameManager.SetProgress(elapsedTime_, lastBoardChangeTime_, scores_, deliveredProducts_, scoredProducts_);
+            board.SetTick(tick_);
+            board.AddProductsInFlight(productsInFlight_ - board.GetProductsInFlight());
+            board.SetSkipDeadEntities(skipDeadEntities_);
+            for (const Entity &entity: entities_) {
+                if (entity.idleSince >= 0) {
+                    board.SetIdleSince(entity.index, entity.idleSince);
+                }
+            }
+            if (ObservationPlanes *observationPlanes = board.GetObservationPlanes()) {
+                board.SetObservationPlanes(observationPlanes);
+            }
+        }
+
+        void ApplyBackgrounds(GameBoard &board) {
+            for (int index = 0; index < GameState::kCellCount; ++index) {
+                const CellPosition position = GameState::GetCellPosition(index);
+                const auto &background = board.GetLayeredCell(position).GetBackground();
+                const int number = numbers_[index];
+                if (number == 0) {
+                    if (background) {
+                        board.SetBackground(position, nullptr);
+                    }
+                    continue;
+                }
+
+                const auto *current = dynamic_cast<const NumberCell *>(background.get());
+                if (!current || current->GetNumber() != number) {
+                    if (!numberCells_[number]) {
+                        numberCells_[number] = std::make_shared<NumberCell>(number);
+                    }
+                    board.SetBackground(position, numberCells_[number]);
+                }
+            }
+        }
+
+        // Walks the board once in row-major order. Every cell no entity of the state covers is cleared on the way;
+        // an entity is only built where the board holds something of another shape.
+        void ApplyEntities(GameBoard &board, GameManager &gameManager) {
+            auto entity = entities_.begin();
+            for (int index = 0; index < GameState::kCellCount; ++index) {
+                if (entity != entities_.end() && entity->index == index) {
+                    ApplyEntity(board, gameManager, *entity++);
+                } else if (!covered_[index]) {
+                    board.Clear(GameState::GetCellPosition(index));
+                }
+            }
+        }
+
+        static void ApplyEntity(GameBoard &board, GameManager &gameManager, const Entity &entity) {
+            const CellState &target = entity.state;
+            const auto [height, width] = GetFootprint(target);
+            for (int i = 0; i < height; ++i) {
+                for (int j = 0; j < width; ++j) {
+                    const CellPosition cellPosition = target.topLeft + CellPosition{i, j};
+                    const CellState current = CaptureCellState(board.GetLayeredCell(cellPosition), cellPosition);
+                    if (current.kind != CellKind::kEmpty &&
+                        (current.kind != target.kind || current.direction != target.direction ||
+                         current.topLeft != target.topLeft)) {
+                        board.Clear(cellPosition);
+                    }
+                }
+            }
+            // Decode checked the footprint against the board and every other entity, so the build always succeeds.
+            if (!board.GetLayeredCell(target.topLeft).GetForeground()) {
+                CellStates::Build(board, &gameManager, target.topLeft, target);
+            }
+
+            ForegroundCell *cell = board.GetLayeredCell(target.topLeft).GetForeground().get();
+            switch (target.kind) {
+                case CellKind::kConveyor:
+                    for (std::size_t i = 0; i < GameManagerConfig::kConveyorBufferSize; ++i) {
+                        static_cast<ConveyorCell *>(cell)->SetProduct(i, target.products[i], entity.tags[i]);
+                    }
+                    break;
+                case CellKind::kCombiner:
+                    static_cast<CombinerCell *>(cell)->SetSlotProducts(target.products[0], target.products[1],
+                                                                       entity.tags[0], entity.tags[1]);
+                    break;
+                case CellKind::kMiningMachine:
+                    static_cast<MiningMachineCell *>(cell)->SetElapsedTime(
+                            static_cast<std::size_t>(target.products[0]));
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // Height and width of the cells an entity covers.
+        static std::pair<int, int> GetFootprint(const CellState &state) {
+            if (state.kind == CellKind::kCollectionCenter) {
+                return {static_cast<int>(GameManagerConfig::kGoalSize), static_cast<int>(GameManagerConfig::kGoalSize)};
+            }
+            if (state.kind == CellKind::kCombiner) {
+                const bool horizontal = state.direction == Direction::kTop || state.direction == Direction::kBottom;
+                return {horizontal ? 1 : 2, horizontal ? 2 : 1};
+            }
+            return {1, 1};
+        }
+
+        bool GetByte(std::uint8_t &value) {
+            if (position_ == end_)
+                return false;
+            value = payload_[position_++];
+            return true;
+        }
+
+        template<typename T>
+        bool GetRaw(T &value) {
+            if (end_ - position_ < sizeof(T))
+                return false;
+            std::memcpy(&value, payload_.data() + position_, sizeof(T));
+            position_ += sizeof(T);
+            return true;
+        }
+
+        bool GetVarint(std::uint64_t &value) {
+            value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                std::uint8_t byte;
+                if (!GetByte(byte))
+                    return false;
+                value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                    return true;
+            }
+            return false;
+        }
+
+        bool GetSigned(std::int64_t &value) {
+            std::uint64_t zigzag;
+            if (!GetVarint(zigzag))
+                return false;
+            value = static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+            return true;
+        }
+
+        bool GetTag(ProductTag &tag) {
+            std::uint64_t raw;
+            if (!GetVarint(raw) || raw > std::numeric_limits<ProductTag>::max())
+                return false;
+            tag = static_cast<ProductTag>(raw);
+            return true;
+        }
+
+        // Reads a varint gap and moves index past it, to a cell that must be on the board.
+        bool GetNextIndex(int &index) {
+            std::uint64_t gap;
+            if (!GetVarint(gap) || gap >= static_cast<std::uint64_t>(GameState::kCellCount - index - 1))
+                return false;
+            index += static_cast<int>(gap) + 1;
+            return true;
+        }
+
+        // Values written from a uint32 cast of an int, which includes the occasional negative product.
+        bool GetInt(int &value, const std::uint64_t limit = 0xffffffffu) {
+            std::uint64_t raw;
+            if (!GetVarint(raw) || raw > limit)
+                return false;
+            value = static_cast<int>(static_cast<std::uint32_t>(raw));
+            return true;
+        }
+
+        std::array<std::uint8_t, GameState::kBufferSize> buffer_{};
+        std::vector<std::uint8_t> payload_;
+        std::size_t position_ = 0;
+        std::size_t end_ = 0;
+
+        int elapsedTime_ = 0;
+        int lastBoardChangeTime_ = 0;
+        int endTime_ = 0;
+        int commonDivisor_ = 1;
+        int scores_ = 0;
+        long long deliveredProducts_ = 0;
+        long long scoredProducts_ = 0;
+        long long tick_ = 0;
+        int productsInFlight_ = 0;
+        bool skipDeadEntities_ = false;
+        std::array<std::uint8_t, GameState::kCellCount> numbers_{};
+        std::array<bool, GameState::kCellCount> covered_{};
+        std::vector<Entity> entities_;
+        std::array<std::shared_ptr<NumberCell>, 256> numberCells_;
+    };
+} // namespace Feis
+#endif
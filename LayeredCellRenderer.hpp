@@ -34,11 +34,13 @@ public:
         renderer.DrawBorder(position);
     }
 
-    void RenderPassTwo(const IGameInfo &info, Drawer<TGameRendererConfig> &drawer, CellPosition cellPosition) const {
+    void RenderPassTwo(const IGameInfo &info, Drawer<TGameRendererConfig> &drawer, CellPosition cellPosition,
+                       const Feis::ProductMotion *productMotion = nullptr, const float interpolation = 1.0f) const {
         auto &layeredCell = info.GetLayeredCell(cellPosition);
 
         if (const auto foreground = layeredCell.GetForeground()) {
-            CellRendererSecondPassVisitor<TGameRendererConfig> cellRenderer(&info, &drawer, cellPosition);
+            CellRendererSecondPassVisitor<TGameRendererConfig> cellRenderer(&info, &drawer, cellPosition,
+                                                                            productMotion, interpolation);
             foreground->Accept(&cellRenderer);
         }
     }
@@ -0,0 +1,67 @@
+#ifndef LINEAGE_REPORT_HPP
+#define LINEAGE_REPORT_HPP
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+#include "PDOGS.hpp"
+
+namespace Feis {
+    // Upper bound of the latency histogram bucket that contains the given fraction of deliveries.
+    inline long long GetLatencyPercentile(const LineageTracer::MinerStatistics &statistics, const double fraction) {
+        const auto target = static_cast<std::uint32_t>(fraction * statistics.delivered);
+        std::uint32_t seen = 0;
+        for (std::size_t bucket = 0; bucket < LineageTracer::kLatencyBucketCount; ++bucket) {
+            seen += statistics.latencyHistogram[bucket];
+            if (seen > target) {
+                return bucket == 0 ? 0 : (1LL << bucket) - 1;
+            }
+        }
+        return (1LL << (LineageTracer::kLatencyBucketCount - 1)) - 1;
+    }
+
+    // Mining machines ordered by mean time from mining to delivery, slowest first, followed by the combiners that
+    // sampled products passed through.
+    inline void PrintLineageReport(std::ostream &out, const LineageTracer &tracer) {
+        struct Row {
+            CellPosition position;
+            const LineageTracer::MinerStatistics *statistics;
+            double meanLatency;
+        };
+
+        std::vector<Row> rows;
+        for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+            for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                const auto &statistics = tracer.GetMinerStatistics({row, col});
+                if (statistics.delivered != 0) {
+                    rows.push_back({{row, col},
+                                    &statistics,
+                                    static_cast<double>(statistics.totalLatency) / statistics.delivered});
+                }
+            }
+        }
+        std::sort(rows.begin(), rows.end(), [](const Row &lhs, const Row &rhs) {
+            return lhs.meanLatency > rhs.meanLatency;
+        });
+
+        out << "lineage: 1 in " << tracer.GetSampleInterval() << " mined products sampled, "
+            << tracer.GetSampledCount() << " sampled, " << tracer.GetDeliveredCount() << " delivered\n";
+        out << "  miner      delivered  scored  mean-latency  p50<=  p90<=  mean-hops\n";
+        for (const auto &[position, statistics, meanLatency]: rows) {
+            out << "  (" << std::setw(2) << position.row << ", " << std::setw(2) << position.col << ")"
+                << std::setw(11) << statistics->delivered << std::setw(8) << statistics->scored << std::setw(14)
+                << std::fixed << std::setprecision(1) << meanLatency << std::setw(7)
+                << GetLatencyPercentile(*statistics, 0.5) << std::setw(7) << GetLatencyPercentile(*statistics, 0.9)
+                << std::setw(11) << static_cast<double>(statistics->totalHops) / statistics->delivered << "\n";
+        }
+
+        for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+            for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                if (const auto deliveries = tracer.GetCombinerDeliveries({row, col})) {
+                    out << "  combiner (" << row << ", " << col << "): " << deliveries << " sampled deliveries\n";
+                }
+            }
+        }
+    }
+} // namespace Feis
+#endif
@@ -0,0 +1,440 @@
+#ifndef LOCKSTEP_SESSION_HPP
+#define LOCKSTEP_SESSION_HPP
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include <SFML/Network.hpp>
+#include "CellState.hpp"
+#include "PDOGS.hpp"
+
+// Link with sfml-network (and sfml-system) when including this header.
+
+namespace Feis {
+    // Wire format of LockstepSession. Peers only ever exchange player actions and, now and then, a state hash; the
+    // board itself never crosses the wire. A datagram is
+    //
+    //   uint8 kMagic, uint8 sender,
+    //   varint turnAck     how many of the receiver's turns the sender holds,
+    //   varint hashAck     the newest of the receiver's checkpoints the sender has seen, 0 for none,
+    //   varint firstTurn, varint turnCount, then turnCount actions,
+    //   varint checkpoint  0 for none, else followed by the sender's uint64 state hash at that checkpoint.
+    //
+    // An action is its PlayerActionType in one byte, followed by row and column bytes unless it is None. Every
+    // datagram repeats all turns the receiver has not acknowledged yet, so a lost one costs nothing but the wait
+    // for the next.
+    namespace LockstepProtocol {
+        constexpr std::uint8_t kMagic = 0xa7;
+        constexpr int kMaxTurnsPerDatagram = 128;
+        constexpr std::size_t kMaxDatagramSize = 64 + 3 * kMaxTurnsPerDatagram;
+
+        inline void PutVarint(std::vector<std::uint8_t> &out, std::uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<std::uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<std::uint8_t>(value));
+        }
+
+        // Bounds-checked reading of a datagram, which may come from anywhere.
+        class Reader {
+        public:
+            Reader(const std::uint8_t *data, const std::size_t size) : in_(data), end_(data + size) {}
+
+            bool GetByte(std::uint8_t &value) {
+                if (in_ == end_)
+                    return false;
+                value = *in_++;
+                return true;
+            }
+
+            bool GetVarint(std::uint64_t &value) {
+                value = 0;
+                for (int shift = 0; shift < 64; shift += 7) {
+                    std::uint8_t byte;
+                    if (!GetByte(byte))
+                        return false;
+                    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                    if (!(byte & 0x80))
+                        return true;
+                }
+                return false;
+            }
+
+            bool GetInt(int &value, const int limit) {
+                std::uint64_t raw;
+                if (!GetVarint(raw) || raw > static_cast<std::uint64_t>(limit))
+                    return false;
+                value = static_cast<int>(raw);
+                return true;
+            }
+
+            bool GetHash(std::uint64_t &value) {
+                if (end_ - in_ < static_cast<std::ptrdiff_t>(sizeof(value)))
+                    return false;
+                std::memcpy(&value, in_, sizeof(value));
+                in_ += sizeof(value);
+                return true;
+            }
+
+        private:
+            const std::uint8_t *in_;
+            const std::uint8_t *end_;
+        };
+
+        // Unknown types and positions off the board become None, so every peer applies exactly what was sent.
+        inline PlayerAction Normalize(const PlayerAction &action) {
+            if (action.type == PlayerActionType::None || static_cast<int>(action.type) < 0 ||
+                static_cast<int>(action.type) > static_cast<int>(PlayerActionType::Clear) ||
+                !IsWithinBoard(action.cellPosition))
+                return {PlayerActionType::None, {0, 0}};
+            return action;
+        }
+
+        inline void PutAction(std::vector<std::uint8_t> &out, const PlayerAction &action) {
+            out.push_back(static_cast<std::uint8_t>(action.type));
+            if (action.type != PlayerActionType::None) {
+                out.push_back(static_cast<std::uint8_t>(action.cellPosition.row));
+                out.push_back(static_cast<std::uint8_t>(action.cellPosition.col));
+            }
+        }
+
+        inline bool GetAction(Reader &in, PlayerAction &action) {
+            std::uint8_t type, row = 0, col = 0;
+            if (!in.GetByte(type))
+                return false;
+            if (type != static_cast<std::uint8_t>(PlayerActionType::None) && (!in.GetByte(row) || !in.GetByte(col)))
+                return false;
+            action = Normalize({static_cast<PlayerActionType>(type), {row, col}});
+            return true;
+        }
+    } // namespace LockstepProtocol
+
+    struct LockstepPeer {
+        sf::IpAddress address;
+        unsigned short port;
+    };
+
+    struct LockstepConfig {
+        int inputDelay = 4;   // decisions between asking a player for an action and applying it
+        int hashInterval = 20; // decisions between state hash comparisons
+        std::chrono::milliseconds resendInterval{20};
+        std::chrono::milliseconds peerTimeout{5000};
+    };
+
+    enum class LockstepStatus {
+        kAdvanced,
+        kWaiting,
+        kGameOver,
+        kDesynced,
+        kPeerLost,
+    };
+
+    // One peer of a game shared by several processes over UDP. Every peer runs its own GameManager on the same seed
+    // and divisor and feeds it the same actions, so the games stay identical without sending any board state.
+    //
+    // Decisions are taken in turn: decision d belongs to peer (d - inputDelay) % peerCount, whose player is asked
+    // for it inputDelay decisions ahead of time, while decision d - inputDelay is being played; that lead hides the
+    // round trip. The first inputDelay decisions play None. Every hashInterval decisions each peer hashes its game
+    // and sends the hash along; peers that disagree are desynced.
+    //
+    // Nothing here blocks or starts threads: call Update as often as ticks should run; it plays at most one tick.
+    class LockstepSession {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        LockstepSession(IGamePlayer *localPlayer, const int localPeer, std::vector<LockstepPeer> peers,
+                        const int commonDivisor, const unsigned int seed, const LockstepConfig config = {}) :
+            localPlayer_(localPlayer), localPeer_(localPeer), peers_(std::move(peers)), config_(config),
+            scheduledPlayer_(*this), gameManager_(&scheduledPlayer_, commonDivisor, seed), turns_(peers_.size()),
+            remotes_(peers_.size()) {
+            config_.inputDelay = std::max(config_.inputDelay, 1);
+            config_.hashInterval = std::max(config_.hashInterval, 1);
+        }
+
+        LockstepSession(const LockstepSession &) = delete;
+
+        LockstepSession &operator=(const LockstepSession &) = delete;
+
+        // Binds the local peer's port; false when it is taken.
+        bool Start() {
+            if (socket_.bind(peers_[localPeer_].port) != sf::Socket::Status::Done)
+                return false;
+
+            socket_.setBlocking(false);
+            const auto now = Clock::now();
+            for (auto &remote: remotes_) {
+                remote.lastHeard = now;
+            }
+            return true;
+        }
+
+        // Exchanges datagrams and plays the next tick if every action it needs has arrived. kGameOver only comes
+        // once the game has ended and every peer holds all of this peer's turns; until then keep calling.
+        LockstepStatus Update() {
+            if (status_ == LockstepStatus::kDesynced || status_ == LockstepStatus::kPeerLost)
+                return status_;
+
+            const auto now = Clock::now();
+            Receive(now);
+            if (status_ != LockstepStatus::kDesynced) {
+                // Advance may find the desync itself, at a checkpoint.
+                if (const LockstepStatus status = Advance(now); status_ != LockstepStatus::kDesynced) {
+                    status_ = status;
+                }
+            }
+            Send(now);
+
+            for (int peer = 0; peer < GetPeerCount(); ++peer) {
+                if (peer != localPeer_ && now - remotes_[peer].lastHeard > config_.peerTimeout &&
+                    status_ != LockstepStatus::kGameOver && status_ != LockstepStatus::kDesynced) {
+                    status_ = LockstepStatus::kPeerLost;
+                    failedPeer_ = peer;
+                }
+            }
+            return status_;
+        }
+
+        [[nodiscard]] const GameManager &GetGameManager() const { return gameManager_; }
+
+        [[nodiscard]] int GetPeerCount() const { return static_cast<int>(peers_.size()); }
+
+        // The peer whose turn is holding the game up, or who disagreed or went quiet; -1 when there is none.
+        [[nodiscard]] int GetFailedPeer() const { return failedPeer_; }
+
+        // The first decision after which the hashes disagreed, or -1.
+        [[nodiscard]] int GetDesyncDecision() const { return desyncDecision_; }
+
+        [[nodiscard]] long long GetBytesSent() const { return bytesSent_; }
+
+    private:
+        // Hands the GameManager whatever action the session has lined up for the decision being played.
+        class ScheduledPlayer final : public IGamePlayer {
+        public:
+            explicit ScheduledPlayer(LockstepSession &session) : session_(session) {}
+
+            PlayerAction GetNextAction(const IGameInfo &) override { return session_.nextAction_; }
+
+        private:
+            LockstepSession &session_;
+        };
+
+        struct Remote {
+            int turnsAcked = 0;      // of the local turns
+            int turnsSent = 0;       // of the local turns, in the newest datagram
+            int checkpointAcked = 0; // of the local checkpoints
+            int checkpointSent = 0;
+            int checkpointSeen = 0;  // of its checkpoints
+            std::map<int, std::uint64_t> pendingHashes; // its hashes for checkpoints not played here yet
+            bool needsAck = false;
+            Clock::time_point lastSent{};
+            Clock::time_point lastHeard{};
+        };
+
+        static constexpr int kKeptCheckpoints = 16;
+
+        [[nodiscard]] int GetDecisionCount() const { return gameManager_.GetEndTime() / 3; }
+
+        [[nodiscard]] int GetOwner(const int decision) const {
+            return (decision - config_.inputDelay) % GetPeerCount();
+        }
+
+        [[nodiscard]] int GetTurn(const int decision) const {
+            return (decision - config_.inputDelay) / GetPeerCount();
+        }
+
+        LockstepStatus Advance(const Clock::time_point now) {
+            if (gameManager_.IsGameOver()) {
+                // A peer that went quiet has either finished too or crashed; this game is complete either way.
+                for (int peer = 0; peer < GetPeerCount(); ++peer) {
+                    if (peer != localPeer_ &&
+                        remotes_[peer].turnsAcked < static_cast<int>(turns_[localPeer_].size()) &&
+                        now - remotes_[peer].lastHeard <= config_.peerTimeout)
+                        return LockstepStatus::kWaiting;
+                }
+                return LockstepStatus::kGameOver;
+            }
+
+            const int tick = gameManager_.GetElapsedTime() + 1;
+            const int decision = tick % 3 == 0 ? tick / 3 - 1 : -1;
+            if (decision >= 0) {
+                if (decision < config_.inputDelay) {
+                    nextAction_ = {PlayerActionType::None, {0, 0}};
+                } else {
+                    const auto &turns = turns_[GetOwner(decision)];
+                    if (GetTurn(decision) >= static_cast<int>(turns.size())) {
+                        failedPeer_ = GetOwner(decision);
+                        return LockstepStatus::kWaiting;
+                    }
+                    nextAction_ = turns[GetTurn(decision)];
+                }
+
+                const int ahead = decision + config_.inputDelay;
+                if (ahead < GetDecisionCount() && GetOwner(ahead) == localPeer_) {
+                    const PlayerAction action = localPlayer_->GetNextAction(gameManager_);
+                    turns_[localPeer_].push_back(LockstepProtocol::Normalize(action));
+                }
+            }
+
+            failedPeer_ = -1;
+            gameManager_.Update();
+            if (decision >= 0 && (decision + 1) % config_.hashInterval == 0) {
+                Checkpoint((decision + 1) / config_.hashInterval);
+            }
+            return LockstepStatus::kAdvanced;
+        }
+
+        void Checkpoint(const int checkpoint) {
+            localCheckpoint_ = checkpoint;
+            localHashes_[checkpoint] = HashGameState(gameManager_);
+            localHashes_.erase(localHashes_.begin(), localHashes_.lower_bound(checkpoint - kKeptCheckpoints));
+
+            for (int peer = 0; peer < GetPeerCount(); ++peer) {
+                auto &pending = remotes_[peer].pendingHashes;
+                if (const auto it = pending.find(checkpoint); it != pending.end()) {
+                    Compare(peer, checkpoint, it->second);
+                    pending.erase(it);
+                }
+            }
+        }
+
+        void Compare(const int peer, const int checkpoint, const std::uint64_t hash) {
+            if (const auto it = localHashes_.find(checkpoint); it != localHashes_.end() && it->second != hash &&
+                                                                  status_ != LockstepStatus::kDesynced) {
+                status_ = LockstepStatus::kDesynced;
+                failedPeer_ = peer;
+                desyncDecision_ = checkpoint * config_.hashInterval - 1;
+            }
+        }
+
+        void Receive(const Clock::time_point now) {
+            while (true) {
+                std::size_t size = 0;
+                std::optional<sf::IpAddress> address;
+                unsigned short port = 0;
+                // Errors here are mostly a peer's port refusing an earlier datagram; the timeout handles real loss.
+                if (socket_.receive(buffer_.data(), buffer_.size(), size, address, port) != sf::Socket::Status::Done)
+                    return;
+                Parse(buffer_.data(), size, address, port, now);
+            }
+        }
+
+        void Parse(const std::uint8_t *data, const std::size_t size, const std::optional<sf::IpAddress> &address,
+                   const unsigned short port, const Clock::time_point now) {
+            LockstepProtocol::Reader in(data, size);
+            std::uint8_t magic, sender;
+            if (!in.GetByte(magic) || magic != LockstepProtocol::kMagic || !in.GetByte(sender) ||
+                sender >= peers_.size() || sender == localPeer_ || address != peers_[sender].address ||
+                port != peers_[sender].port)
+                return;
+
+            int turnAck, checkpointAck, firstTurn, turnCount, checkpoint;
+            constexpr int kLimit = GameManagerConfig::kEndTime;
+            if (!in.GetInt(turnAck, kLimit) || !in.GetInt(checkpointAck, kLimit) || !in.GetInt(firstTurn, kLimit) ||
+                !in.GetInt(turnCount, LockstepProtocol::kMaxTurnsPerDatagram))
+                return;
+            std::array<PlayerAction, LockstepProtocol::kMaxTurnsPerDatagram> actions{};
+            for (int k = 0; k < turnCount; ++k) {
+                if (!LockstepProtocol::GetAction(in, actions[k]))
+                    return;
+            }
+            std::uint64_t hash = 0;
+            if (!in.GetInt(checkpoint, kLimit) || (checkpoint != 0 && !in.GetHash(hash)))
+                return;
+
+            Remote &remote = remotes_[sender];
+            remote.lastHeard = now;
+            remote.turnsAcked = std::clamp(turnAck, remote.turnsAcked, static_cast<int>(turns_[localPeer_].size()));
+            remote.checkpointAcked = std::clamp(checkpointAck, remote.checkpointAcked, localCheckpoint_);
+
+            auto &turns = turns_[sender];
+            for (int k = static_cast<int>(turns.size()) - firstTurn; k >= 0 && k < turnCount; ++k) {
+                turns.push_back(actions[k]);
+                remote.needsAck = true;
+            }
+
+            if (checkpoint > remote.checkpointSeen) {
+                remote.checkpointSeen = checkpoint;
+                remote.needsAck = true;
+                if (checkpoint <= localCheckpoint_) {
+                    Compare(sender, checkpoint, hash);
+                } else {
+                    remote.pendingHashes[checkpoint] = hash;
+                }
+            }
+        }
+
+        void Send(const Clock::time_point now) {
+            const auto &localTurns = turns_[localPeer_];
+            for (int peer = 0; peer < GetPeerCount(); ++peer) {
+                if (peer == localPeer_)
+                    continue;
+
+                Remote &remote = remotes_[peer];
+                const int turnCount = std::min(static_cast<int>(localTurns.size()) - remote.turnsAcked,
+                                               LockstepProtocol::kMaxTurnsPerDatagram);
+                const int checkpoint = localCheckpoint_ > remote.checkpointAcked ? localCheckpoint_ : 0;
+                // New turns go out at once. Acknowledgements wait to ride along with them, and resends wait for the
+                // timer; with nothing outstanding either way only an occasional keepalive goes out.
+                const bool hasNews = remote.turnsAcked + turnCount > remote.turnsSent ||
+                                     checkpoint > remote.checkpointSent;
+                const bool hasPending = turnCount > 0 || checkpoint != 0 || remote.needsAck;
+                const auto interval = hasPending ? config_.resendInterval : config_.peerTimeout / 4;
+                if (!hasNews && now - remote.lastSent < interval)
+                    continue;
+
+                datagram_.clear();
+                datagram_.push_back(LockstepProtocol::kMagic);
+                datagram_.push_back(static_cast<std::uint8_t>(localPeer_));
+                LockstepProtocol::PutVarint(datagram_, turns_[peer].size());
+                LockstepProtocol::PutVarint(datagram_, remote.checkpointSeen);
+                LockstepProtocol::PutVarint(datagram_, remote.turnsAcked);
+                LockstepProtocol::PutVarint(datagram_, turnCount);
+                for (int k = 0; k < turnCount; ++k) {
+                    LockstepProtocol::PutAction(datagram_, localTurns[remote.turnsAcked + k]);
+                }
+                LockstepProtocol::PutVarint(datagram_, checkpoint);
+                if (checkpoint != 0) {
+                    const std::uint64_t hash = localHashes_[checkpoint];
+                    const std::size_t offset = datagram_.size();
+                    datagram_.resize(offset + sizeof(hash));
+                    std::memcpy(datagram_.data() + offset, &hash, sizeof(hash));
+                }
+
+                if (socket_.send(datagram_.data(), datagram_.size(), peers_[peer].address, peers_[peer].port) ==
+                    sf::Socket::Status::Done) {
+                    bytesSent_ += static_cast<long long>(datagram_.size());
+                }
+                remote.turnsSent = remote.turnsAcked + turnCount;
+                remote.checkpointSent = std::max(remote.checkpointSent, checkpoint);
+                remote.needsAck = false;
+                remote.lastSent = now;
+            }
+        }
+
+        IGamePlayer *localPlayer_;
+        int localPeer_;
+        std::vector<LockstepPeer> peers_;
+        LockstepConfig config_;
+        ScheduledPlayer scheduledPlayer_;
+        GameManager gameManager_;
+        PlayerAction nextAction_{PlayerActionType::None, {0, 0}};
+        std::vector<std::vector<PlayerAction>> turns_; // by peer, in turn order
+        std::vector<Remote> remotes_;                   // by peer; the local entry is unused
+        std::map<int, std::uint64_t> localHashes_;
+        int localCheckpoint_ = 0;
+        sf::UdpSocket socket_;
+        std::array<std::uint8_t, LockstepProtocol::kMaxDatagramSize> buffer_{};
+        std::vector<std::uint8_t> datagram_;
+        LockstepStatus status_ = LockstepStatus::kWaiting;
+        int failedPeer_ = -1;
+        int desyncDecision_ = -1;
+        long long bytesSent_ = 0;
+    };
+} // namespace Feis
+#endif
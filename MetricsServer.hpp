@@ -0,0 +1,244 @@
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <SFML/Network.hpp>
+#include "AllocationTracker.hpp"
+#include "PDOGS.hpp"
+#include "ProfilePhase.hpp"
+
+// Link with sfml-network (and sfml-system) when including this header.
+
+namespace Feis {
+    // Counters shared between any number of simulation threads and the metrics server. Writers only do relaxed
+    // atomic increments, so a scrape never makes a simulation thread wait and a busy simulation never delays one.
+    // Phase latencies are kept for GameManager::Update, timed by Update, and for GetNextAction, timed by
+    // MetricsGamePlayer; the cell update passes and rendering are only broken out by Profiler.
+    class SimulationMetrics {
+    public:
+        // Latencies go into power-of-two nanosecond buckets: bucket b holds [2^b, 2^(b+1)).
+        static constexpr std::size_t kLatencyBucketCount = 40;
+
+        void AddTicks(const std::uint64_t ticks) { ticks_.fetch_add(ticks, std::memory_order_relaxed); }
+
+        void OnGameCompleted(const int scores) {
+            gamesCompleted_.fetch_add(1, std::memory_order_relaxed);
+            totalScores_.fetch_add(static_cast<std::uint64_t>(scores), std::memory_order_relaxed);
+            lastScores_.store(scores, std::memory_order_relaxed);
+
+            int best = bestScores_.load(std::memory_order_relaxed);
+            while (scores > best && !bestScores_.compare_exchange_weak(best, scores, std::memory_order_relaxed)) {
+            }
+        }
+
+        void RecordLatency(const ProfilePhase phase, const std::uint64_t nanoseconds) {
+            std::size_t bucket = 0;
+            while (bucket + 1 < kLatencyBucketCount && (nanoseconds >> (bucket + 1)) != 0) {
+                bucket += 1;
+            }
+            latencies_[static_cast<int>(phase)][bucket].fetch_add(1, std::memory_order_relaxed);
+            latencySums_[static_cast<int>(phase)].fetch_add(nanoseconds, std::memory_order_relaxed);
+        }
+
+        // One GameManager::Update, timed and counted, with the final score reported when the game ends.
+        void Update(GameManager &gameManager) {
+            if (gameManager.IsGameOver()) {
+                return;
+            }
+            const auto begin = std::chrono::steady_clock::now();
+            gameManager.Update();
+            RecordLatency(ProfilePhase::kGameUpdate,
+                          static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                             std::chrono::steady_clock::now() - begin)
+                                                             .count()));
+            AddTicks(1);
+            if (gameManager.IsGameOver()) {
+                OnGameCompleted(gameManager.GetScores());
+            }
+        }
+
+        [[nodiscard]] std::uint64_t GetTicks() const { return ticks_.load(std::memory_order_relaxed); }
+
+        // Prometheus text exposition format, version 0.0.4.
+        void WritePrometheus(std::ostream &out, const double ticksPerSecond) const {
+            out << "# TYPE pdogs_ticks_total counter\npdogs_ticks_total " << GetTicks() << "\n";
+            out << "# TYPE pdogs_ticks_per_second gauge\npdogs_ticks_per_second " << ticksPerSecond << "\n";
+            out << "# TYPE pdogs_games_completed_total counter\npdogs_games_completed_total "
+                << gamesCompleted_.load(std::memory_order_relaxed) << "\n";
+            out << "# TYPE pdogs_scores_total counter\npdogs_scores_total "
+                << totalScores_.load(std::memory_order_relaxed) << "\n";
+            out << "# TYPE pdogs_last_game_scores gauge\npdogs_last_game_scores "
+                << lastScores_.load(std::memory_order_relaxed) << "\n";
+            out << "# TYPE pdogs_best_game_scores gauge\npdogs_best_game_scores "
+                << bestScores_.load(std::memory_order_relaxed) << "\n";
+            out << "# TYPE pdogs_allocations_total counter\npdogs_allocations_total "
+                << AllocationCounters::allocations.load(std::memory_order_relaxed) << "\n";
+            out << "# TYPE pdogs_allocated_bytes_total counter\npdogs_allocated_bytes_total "
+                << AllocationCounters::bytes.load(std::memory_order_relaxed) << "\n";
+
+            out << "# TYPE pdogs_phase_latency_seconds summary\n";
+            for (int phase = 0; phase < static_cast<int>(ProfilePhase::kCount); ++phase) {
+                std::array<std::uint64_t, kLatencyBucketCount> counts{};
+                std::uint64_t total = 0;
+                for (std::size_t bucket = 0; bucket < kLatencyBucketCount; ++bucket) {
+                    counts[bucket] = latencies_[phase][bucket].load(std::memory_order_relaxed);
+                    total += counts[bucket];
+                }
+                if (total == 0) {
+                    continue;
+                }
+
+                const char *name = GetProfilePhaseName(static_cast<ProfilePhase>(phase));
+                for (const double quantile: {0.5, 0.9, 0.99}) {
+                    out << "pdogs_phase_latency_seconds{phase=\"" << name << "\",quantile=\"" << quantile << "\"} "
+                        << GetQuantileUpperBound(counts, total, quantile) * 1e-9 << "\n";
+                }
+                out << "pdogs_phase_latency_seconds_sum{phase=\"" << name << "\"} "
+                    << static_cast<double>(latencySums_[phase].load(std::memory_order_relaxed)) * 1e-9 << "\n";
+                out << "pdogs_phase_latency_seconds_count{phase=\"" << name << "\"} " << total << "\n";
+            }
+        }
+
+    private:
+        using Histogram = std::array<std::atomic<std::uint64_t>, kLatencyBucketCount>;
+
+        // Upper edge of the bucket holding the quantile; coarse, but monotone and cheap to keep.
+        static double GetQuantileUpperBound(const std::array<std::uint64_t, kLatencyBucketCount> &counts,
+                                            const std::uint64_t total, const double quantile) {
+            const auto target = static_cast<std::uint64_t>(quantile * static_cast<double>(total));
+            std::uint64_t seen = 0;
+            for (std::size_t bucket = 0; bucket < kLatencyBucketCount; ++bucket) {
+                seen += counts[bucket];
+                if (seen > target) {
+                    return static_cast<double>(2ULL << bucket);
+                }
+            }
+            return static_cast<double>(1ULL << kLatencyBucketCount);
+        }
+
+        std::atomic<std::uint64_t> ticks_{0};
+        std::atomic<std::uint64_t> gamesCompleted_{0};
+        std::atomic<std::uint64_t> totalScores_{0};
+        std::atomic<int> lastScores_{0};
+        std::atomic<int> bestScores_{0};
+        std::array<Histogram, static_cast<int>(ProfilePhase::kCount)> latencies_{};
+        std::array<std::atomic<std::uint64_t>, static_cast<int>(ProfilePhase::kCount)> latencySums_{};
+    };
+
+    // Wraps a player and records how long each of its decisions takes as the GetNextAction phase.
+    class MetricsGamePlayer final : public IGamePlayer {
+    public:
+        MetricsGamePlayer(IGamePlayer *player, SimulationMetrics *metrics) : player_(player), metrics_(metrics) {}
+
+        PlayerAction GetNextAction(const IGameInfo &info) override {
+            const auto begin = std::chrono::steady_clock::now();
+            const PlayerAction action = player_->GetNextAction(info);
+            metrics_->RecordLatency(ProfilePhase::kGetNextAction,
+                                    static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                                       std::chrono::steady_clock::now() - begin)
+                                                                       .count()));
+            return action;
+        }
+
+    private:
+        IGamePlayer *player_;
+        SimulationMetrics *metrics_;
+    };
+
+    // Serves SimulationMetrics as a Prometheus page on localhost from its own thread. Every request gets the page,
+    // whatever its path; the connection is closed after each response.
+    class MetricsServer {
+    public:
+        explicit MetricsServer(const SimulationMetrics *metrics) : metrics_(metrics) {}
+
+        MetricsServer(const MetricsServer &) = delete;
+
+        MetricsServer &operator=(const MetricsServer &) = delete;
+
+        ~MetricsServer() { Stop(); }
+
+        bool Start(const unsigned short port) {
+            if (thread_.joinable() || listener_.listen(port, sf::IpAddress::LocalHost) != sf::Socket::Status::Done) {
+                return false;
+            }
+            running_.store(true);
+            thread_ = std::thread([this] { Run(); });
+            return true;
+        }
+
+        void Stop() {
+            if (!thread_.joinable()) {
+                return;
+            }
+            running_.store(false);
+            thread_.join();
+            listener_.close();
+        }
+
+        [[nodiscard]] unsigned short GetPort() const { return listener_.getLocalPort(); }
+
+    private:
+        void Run() {
+            sf::SocketSelector selector;
+            selector.add(listener_);
+
+            auto rateBegin = std::chrono::steady_clock::now();
+            std::uint64_t rateTicks = metrics_->GetTicks();
+
+            while (running_.load()) {
+                if (selector.wait(sf::milliseconds(250)) && selector.isReady(listener_)) {
+                    sf::TcpSocket client;
+                    if (listener_.accept(client) == sf::Socket::Status::Done) {
+                        Serve(client);
+                    }
+                }
+
+                // The rate is refreshed about once a second here rather than per scrape, so scrape frequency
+                // does not change what it means.
+                const auto now = std::chrono::steady_clock::now();
+                if (now - rateBegin >= std::chrono::seconds(1)) {
+                    const std::uint64_t ticks = metrics_->GetTicks();
+                    ticksPerSecond_ = static_cast<double>(ticks - rateTicks) /
+                                      std::chrono::duration<double>(now - rateBegin).count();
+                    rateBegin = now;
+                    rateTicks = ticks;
+                }
+            }
+        }
+
+        void Serve(sf::TcpSocket &client) const {
+            // Give the client a moment to send its request line; the contents do not matter.
+            sf::SocketSelector selector;
+            selector.add(client);
+            if (selector.wait(sf::milliseconds(500))) {
+                char request[1024];
+                std::size_t received = 0;
+                static_cast<void>(client.receive(request, sizeof(request), received));
+            }
+
+            std::ostringstream body;
+            metrics_->WritePrometheus(body, ticksPerSecond_);
+            const std::string page = body.str();
+
+            const std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                         "Content-Length: " + std::to_string(page.size()) +
+                                         "\r\nConnection: close\r\n\r\n" + page;
+            static_cast<void>(client.send(response.data(), response.size()));
+            client.disconnect();
+        }
+
+        const SimulationMetrics *metrics_;
+        sf::TcpListener listener_;
+        std::atomic<bool> running_{false};
+        std::thread thread_;
+        double ticksPerSecond_ = 0;
+    };
+} // namespace Feis
+#endif
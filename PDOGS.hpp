@@ -2,10 +2,18 @@
 #define PDOGS_HPP
 #include <array>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include <memory>
+#include <optional>
 #include <random>
 #include <set>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Profiler.hpp"
 
 namespace Feis {
     struct GameManagerConfig {
@@ -15,6 +23,8 @@ namespace Feis {
         static constexpr std::size_t kConveyorBufferSize = 10;
         static constexpr int kNumberOfWalls = 100;
         static constexpr std::size_t kEndTime = 9000;
+        // Bump whenever a change makes the same seed and actions play out differently; recorded replays carry it.
+        static constexpr std::uint32_t kEngineVersion = 1;
     };
 
     struct CellPosition {
@@ -39,6 +49,15 @@ namespace Feis {
 
     enum class Direction : int { kTop = 0, kRight = 1, kBottom = 2, kLeft = 3 };
 
+    enum class FlowStatus : std::uint8_t { kNone, kConnected, kDead, kInCycle };
+
+    enum class FlowNodeKind : std::uint8_t { kNone, kSink, kTransport, kSource };
+
+    // Identifies a sampled product for lineage tracing; 0 means the product is not traced.
+    using ProductTag = std::uint32_t;
+
+    enum class FlowEvent : std::uint8_t { kForwarded, kBlocked, kMiningCycleLost };
+
     class GameBoard;
 
     class LayeredCell;
@@ -53,6 +72,8 @@ namespace Feis {
         [[nodiscard]] virtual int GetEndTime() const = 0;
         [[nodiscard]] virtual int GetElapsedTime() const = 0;
         [[nodiscard]] virtual bool IsGameOver() const = 0;
+        [[nodiscard]] virtual int GetDistanceToCollectionCenter(CellPosition cellPosition) const = 0;
+        [[nodiscard]] virtual FlowStatus GetFlowStatus(CellPosition cellPosition) const = 0;
     };
 
     class IGameManager : public IGameInfo {
@@ -65,7 +86,9 @@ namespace Feis {
         [[nodiscard]] int GetEndTime() const override = 0;
         [[nodiscard]] int GetElapsedTime() const override = 0;
         [[nodiscard]] bool IsGameOver() const override = 0;
-        virtual void OnProductReceived(int number) = 0;
+        [[nodiscard]] int GetDistanceToCollectionCenter(CellPosition cellPosition) const override = 0;
+        [[nodiscard]] FlowStatus GetFlowStatus(CellPosition cellPosition) const override = 0;
+        virtual void OnProductReceived(int number, ProductTag tag) = 0;
     };
 
     class Cell;
@@ -111,13 +134,29 @@ namespace Feis {
 
         [[nodiscard]] virtual bool CanRemove() const { return false; }
 
+        [[nodiscard]] virtual bool IsPassable() const { return false; }
+
+        [[nodiscard]] virtual FlowNodeKind GetFlowNodeKind() const { return FlowNodeKind::kNone; }
+
+        [[nodiscard]] virtual std::optional<CellPosition> GetOutputCellPosition(CellPosition cellPosition) const {
+            return std::nullopt;
+        }
+
         [[nodiscard]] virtual std::size_t GetCapacity(CellPosition cellPosition) const { return 0; }
 
-        virtual void ReceiveProduct(CellPosition cellPosition, int number) {}
+        [[nodiscard]] virtual std::size_t GetHeldProductCount() const { return 0; }
+
+        virtual void ReceiveProduct(CellPosition cellPosition, int number, ProductTag tag) {}
+
+        virtual void AdvanceIdleTicks(std::size_t ticks) {}
 
-        virtual void UpdatePassOne(CellPosition cellPosition, GameBoard &board) {}
+        virtual void UpdatePassOne(CellPosition cellPosition, GameBoard &board) {
+            PDOGS_PROFILE_COUNT(ProfileCounter::kOtherPassOne);
+        }
 
-        virtual void UpdatePassTwo(CellPosition cellPosition, GameBoard &board) {}
+        virtual void UpdatePassTwo(CellPosition cellPosition, GameBoard &board) {
+            PDOGS_PROFILE_COUNT(ProfileCounter::kOtherPassTwo);
+        }
 
         ~ForegroundCell() override = default;
 
@@ -148,23 +187,50 @@ namespace Feis {
 
     std::size_t GetNeighborCapacity(const GameBoard &board, CellPosition cellPosition, Direction direction);
 
-    void SendProduct(const GameBoard &board, CellPosition cellPosition, Direction direction, int product);
+    void SendProduct(const GameBoard &board, CellPosition cellPosition, Direction direction, int product,
+                     ProductTag tag);
+
+    ProductTag CombineProductTags(const GameBoard &board, CellPosition cellPosition, ProductTag first,
+                                  ProductTag second);
+
+    void CountFlowEvent(const GameBoard &board, CellPosition cellPosition, FlowEvent event);
+
+    void AddProductsInFlight(GameBoard &board, int delta);
+
+    void OnHeldProductsChanged(const GameBoard &board, CellPosition cellPosition);
 
     class ConveyorCell final : public ForegroundCell {
     public:
         ConveyorCell(const CellPosition topLeftCellPosition, const Direction direction) :
-            ForegroundCell(topLeftCellPosition), products_{}, direction_{direction} {}
+            ForegroundCell(topLeftCellPosition), products_{}, tags_{}, direction_{direction} {}
 
         [[nodiscard]] int GetProduct(const std::size_t i) const { return products_[i]; }
 
+        [[nodiscard]] ProductTag GetProductTag(const std::size_t i) const { return tags_[i]; }
+
         [[nodiscard]] std::size_t GetProductCount() const { return products_.size(); }
 
         [[nodiscard]] Direction GetDirection() const { return direction_; }
 
+        // For rebuilding a conveyor from recorded state.
+        void SetProduct(const std::size_t i, const int number, const ProductTag tag = 0) {
+            products_[i] = number;
+            tags_[i] = tag;
+        }
+
         void Accept(const CellVisitor *visitor) const override { visitor->Visit(this); }
 
         [[nodiscard]] bool CanRemove() const override { return true; }
 
+        [[nodiscard]] bool IsPassable() const override { return true; }
+
+        [[nodiscard]] FlowNodeKind GetFlowNodeKind() const override { return FlowNodeKind::kTransport; }
+
+        [[nodiscard]] std::optional<CellPosition>
+        GetOutputCellPosition(const CellPosition cellPosition) const override {
+            return GetNeighborCellPosition(cellPosition, direction_);
+        }
+
         [[nodiscard]] std::size_t GetCapacity(CellPosition cellPosition) const override {
             for (std::size_t i = 0; i < products_.size(); ++i) {
                 if (products_[products_.size() - 1 - i] != 0) {
@@ -174,45 +240,63 @@ namespace Feis {
             return products_.size();
         }
 
-        void ReceiveProduct(CellPosition cellPosition, const int number) override {
+        [[nodiscard]] std::size_t GetHeldProductCount() const override {
+            return static_cast<std::size_t>(std::count_if(products_.begin(), products_.end(),
+                                                          [](const int product) { return product != 0; }));
+        }
+
+        void ReceiveProduct(CellPosition cellPosition, const int number, const ProductTag tag) override {
             assert(number != 0);
             assert(products_.back() == 0);
             products_.back() = number;
+            tags_.back() = tag;
         }
 
         void UpdatePassOne(const CellPosition cellPosition, GameBoard &board) override {
+            PDOGS_PROFILE_COUNT(ProfileCounter::kConveyorPassOne);
             const std::size_t capacity = GetNeighborCapacity(board, cellPosition, direction_);
 
+            if (products_[0] != 0) {
+                CountFlowEvent(board, cellPosition, capacity >= 3 ? FlowEvent::kForwarded : FlowEvent::kBlocked);
+            }
+
             if (capacity >= 3) {
                 if (products_[0] != 0) {
-                    SendProduct(board, cellPosition, direction_, products_[0]);
+                    SendProduct(board, cellPosition, direction_, products_[0], tags_[0]);
                     products_[0] = 0;
+                    tags_[0] = 0;
+                    OnHeldProductsChanged(board, cellPosition);
                 }
             }
 
             if (capacity >= 2) {
                 if (products_[0] == 0 && products_[1] != 0) {
                     std::swap(products_[0], products_[1]);
+                    std::swap(tags_[0], tags_[1]);
                 }
             }
 
             if (capacity >= 1) {
                 if (products_[0] == 0 && products_[1] == 0 && products_[2] != 0) {
                     std::swap(products_[1], products_[2]);
+                    std::swap(tags_[1], tags_[2]);
                 }
             }
         }
 
         void UpdatePassTwo(CellPosition cellPosition, GameBoard &board) override {
+            PDOGS_PROFILE_COUNT(ProfileCounter::kConveyorPassTwo);
             for (std::size_t k = 3; k < products_.size(); ++k) {
                 if (products_[k] != 0 && products_[k - 1] == 0 && products_[k - 2] == 0 && products_[k - 3] == 0) {
                     std::swap(products_[k], products_[k - 1]);
+                    std::swap(tags_[k], tags_[k - 1]);
                 }
             }
         }
 
     protected:
         std::array<int, GameManagerConfig::kConveyorBufferSize> products_;
+        std::array<ProductTag, GameManagerConfig::kConveyorBufferSize> tags_;
 
     private:
         Direction direction_;
@@ -221,7 +305,8 @@ namespace Feis {
     class CombinerCell final : public ForegroundCell {
     public:
         CombinerCell(const CellPosition topLeft, const Direction direction) :
-            ForegroundCell(topLeft), direction_{direction}, firstSlotProduct_{}, secondSlotProduct_{} {}
+            ForegroundCell(topLeft), direction_{direction}, firstSlotProduct_{}, secondSlotProduct_{}, firstSlotTag_{},
+            secondSlotTag_{} {}
 
         [[nodiscard]] Direction GetDirection() const { return direction_; }
 
@@ -229,6 +314,19 @@ namespace Feis {
 
         [[nodiscard]] int GetSecondSlotProduct() const { return secondSlotProduct_; }
 
+        [[nodiscard]] ProductTag GetFirstSlotTag() const { return firstSlotTag_; }
+
+        [[nodiscard]] ProductTag GetSecondSlotTag() const { return secondSlotTag_; }
+
+        // For rebuilding a combiner from recorded state.
+        void SetSlotProducts(const int first, const int second, const ProductTag firstTag = 0,
+                             const ProductTag secondTag = 0) {
+            firstSlotProduct_ = first;
+            secondSlotProduct_ = second;
+            firstSlotTag_ = firstTag;
+            secondSlotTag_ = secondTag;
+        }
+
         void Accept(const CellVisitor *visitor) const override { visitor->Visit(this); }
 
         [[nodiscard]] std::size_t GetWidth() const override {
@@ -241,18 +339,34 @@ namespace Feis {
 
         [[nodiscard]] bool CanRemove() const override { return true; }
 
-        [[nodiscard]] bool IsMainCell(const CellPosition cellPosition) const {
+        // The cell that holds the first slot and sends the sum on; the other cell only feeds it.
+        [[nodiscard]] CellPosition GetMainCellPosition() const {
             switch (direction_) {
                 case Direction::kTop:
+                    return topLeftCellPosition_ + CellPosition{0, 1};
                 case Direction::kRight:
-                    return cellPosition != topLeftCellPosition_;
+                    return topLeftCellPosition_ + CellPosition{1, 0};
                 case Direction::kBottom:
                 case Direction::kLeft:
-                    return cellPosition == topLeftCellPosition_;
+                    return topLeftCellPosition_;
             }
             assert(false);
         }
 
+        [[nodiscard]] bool IsMainCell(const CellPosition cellPosition) const {
+            return cellPosition == GetMainCellPosition();
+        }
+
+        [[nodiscard]] FlowNodeKind GetFlowNodeKind() const override { return FlowNodeKind::kTransport; }
+
+        [[nodiscard]] std::optional<CellPosition>
+        GetOutputCellPosition(const CellPosition cellPosition) const override {
+            if (IsMainCell(cellPosition)) {
+                return GetNeighborCellPosition(cellPosition, direction_);
+            }
+            return GetMainCellPosition();
+        }
+
         [[nodiscard]] std::size_t GetCapacity(const CellPosition cellPosition) const override {
             if (IsMainCell(cellPosition)) {
                 if (firstSlotProduct_ == 0) {
@@ -267,25 +381,40 @@ namespace Feis {
             return 0;
         }
 
-        void ReceiveProduct(const CellPosition cellPosition, const int number) override {
+        [[nodiscard]] std::size_t GetHeldProductCount() const override {
+            return (firstSlotProduct_ != 0 ? 1 : 0) + (secondSlotProduct_ != 0 ? 1 : 0);
+        }
+
+        void ReceiveProduct(const CellPosition cellPosition, const int number, const ProductTag tag) override {
             assert(number != 0);
 
             if (IsMainCell(cellPosition)) {
                 firstSlotProduct_ = number;
+                firstSlotTag_ = tag;
             } else {
                 secondSlotProduct_ = number;
+                secondSlotTag_ = tag;
             }
         }
 
         void UpdatePassOne(const CellPosition cellPosition, GameBoard &board) override {
+            PDOGS_PROFILE_COUNT(ProfileCounter::kCombinerPassOne);
             if (!IsMainCell(cellPosition))
                 return;
 
             if (firstSlotProduct_ != 0 && secondSlotProduct_ != 0) {
-                if (GetNeighborCapacity(board, cellPosition, direction_) >= 3) {
-                    SendProduct(board, cellPosition, direction_, firstSlotProduct_ + secondSlotProduct_);
+                const bool canSend = GetNeighborCapacity(board, cellPosition, direction_) >= 3;
+                CountFlowEvent(board, cellPosition, canSend ? FlowEvent::kForwarded : FlowEvent::kBlocked);
+
+                if (canSend) {
+                    SendProduct(board, cellPosition, direction_, firstSlotProduct_ + secondSlotProduct_,
+                                CombineProductTags(board, cellPosition, firstSlotTag_, secondSlotTag_));
+                    AddProductsInFlight(board, -1);
                     firstSlotProduct_ = 0;
                     secondSlotProduct_ = 0;
+                    firstSlotTag_ = 0;
+                    secondSlotTag_ = 0;
+                    OnHeldProductsChanged(board, cellPosition);
                 }
             }
         }
@@ -294,6 +423,8 @@ namespace Feis {
         Direction direction_;
         int firstSlotProduct_;
         int secondSlotProduct_;
+        ProductTag firstSlotTag_;
+        ProductTag secondSlotTag_;
     };
 
     class WallCell final : public ForegroundCell {
@@ -316,14 +447,16 @@ namespace Feis {
 
         [[nodiscard]] std::size_t GetHeight() const override { return GameManagerConfig::kGoalSize; }
 
+        [[nodiscard]] FlowNodeKind GetFlowNodeKind() const override { return FlowNodeKind::kSink; }
+
         [[nodiscard]] std::size_t GetCapacity(CellPosition cellPosition) const override {
             return GameManagerConfig::kConveyorBufferSize;
         }
 
-        void ReceiveProduct(CellPosition cellPosition, const int number) override {
+        void ReceiveProduct(CellPosition cellPosition, const int number, const ProductTag tag) override {
             assert(number != 0);
 
-            gameManager_->OnProductReceived(number);
+            gameManager_->OnProductReceived(number, tag);
         }
 
         [[nodiscard]] int GetScores() const { return gameManager_->GetScores(); }
@@ -332,11 +465,563 @@ namespace Feis {
         IGameManager *gameManager_;
     };
 
+    // Shortest walking distance from every cell to the collection center, where empty cells and conveyors can be
+    // walked over and everything else blocks. Kept up to date one cell at a time: opening a cell relaxes outwards
+    // from it, blocking a cell only recomputes the cells whose every shortest path went through it.
+    class DistanceField {
+    public:
+        static constexpr int kUnreachable = -1;
+
+        DistanceField() :
+            passability_{}, distances_{}, affected_{}, queue_{}, seeds_{}, changed_{}, isChanged_{} {
+            passability_.fill(Passability::kPassable);
+            distances_.fill(kUnreachable);
+        }
+
+        [[nodiscard]] int Get(const CellPosition cellPosition) const { return distances_[ToIndex(cellPosition)]; }
+
+        // Cells whose distance was written since the last ClearChanged(), each listed once.
+        [[nodiscard]] int GetChangedCount() const { return changedCount_; }
+
+        [[nodiscard]] int GetChanged(const int k) const { return changed_[k]; }
+
+        void ClearChanged() {
+            for (int k = 0; k < changedCount_; ++k) {
+                isChanged_[changed_[k]] = false;
+            }
+            changedCount_ = 0;
+        }
+
+        void SetSource(const CellPosition cellPosition) {
+            const int index = ToIndex(cellPosition);
+            passability_[index] = Passability::kSource;
+            SetDistance(index, 0);
+            PropagateDecrease(index);
+        }
+
+        void SetPassable(const CellPosition cellPosition) {
+            const int index = ToIndex(cellPosition);
+            if (passability_[index] == Passability::kPassable)
+                return;
+
+            passability_[index] = Passability::kPassable;
+            SetDistance(index, GetDistanceThroughNeighbors(index));
+            if (distances_[index] != kUnreachable) {
+                PropagateDecrease(index);
+            }
+        }
+
+        void SetBlocked(const CellPosition cellPosition) {
+            const int index = ToIndex(cellPosition);
+            if (passability_[index] == Passability::kBlocked)
+                return;
+
+            passability_[index] = Passability::kBlocked;
+            const int oldDistance = distances_[index];
+            SetDistance(index, kUnreachable);
+            if (oldDistance != kUnreachable) {
+                Repair(index, oldDistance);
+            }
+        }
+
+    private:
+        enum class Passability : std::uint8_t { kPassable, kBlocked, kSource };
+
+        static constexpr int kCellCount = GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight;
+
+        static int ToIndex(const CellPosition cellPosition) {
+            return cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col;
+        }
+
+        void SetDistance(const int index, const int distance) {
+            distances_[index] = distance;
+            if (!isChanged_[index]) {
+                isChanged_[index] = true;
+                changed_[changedCount_++] = index;
+            }
+        }
+
+        template<typename TFunction>
+        static void ForEachNeighbor(const int index, TFunction function) {
+            const int row = index / GameManagerConfig::kBoardWidth;
+            const int col = index % GameManagerConfig::kBoardWidth;
+            if (row > 0)
+                function(index - GameManagerConfig::kBoardWidth);
+            if (col + 1 < GameManagerConfig::kBoardWidth)
+                function(index + 1);
+            if (row + 1 < GameManagerConfig::kBoardHeight)
+                function(index + GameManagerConfig::kBoardWidth);
+            if (col > 0)
+                function(index - 1);
+        }
+
+        [[nodiscard]] int GetDistanceThroughNeighbors(const int index) const {
+            int best = kUnreachable;
+            ForEachNeighbor(index, [&](const int neighbor) {
+                if (distances_[neighbor] != kUnreachable && (best == kUnreachable || distances_[neighbor] + 1 < best)) {
+                    best = distances_[neighbor] + 1;
+                }
+            });
+            return best;
+        }
+
+        void PropagateDecrease(const int origin) {
+            int head = 0;
+            int tail = 0;
+            queue_[tail++] = origin;
+
+            while (head < tail) {
+                const int index = queue_[head++];
+                ForEachNeighbor(index, [&](const int neighbor) {
+                    if (passability_[neighbor] == Passability::kPassable &&
+                        (distances_[neighbor] == kUnreachable || distances_[neighbor] > distances_[index] + 1)) {
+                        SetDistance(neighbor, distances_[index] + 1);
+                        queue_[tail++] = neighbor;
+                    }
+                });
+            }
+        }
+
+        [[nodiscard]] bool HasSupport(const int index) const {
+            bool supported = false;
+            ForEachNeighbor(index, [&](const int neighbor) {
+                if (!affected_[neighbor] && distances_[neighbor] != kUnreachable &&
+                    distances_[neighbor] == distances_[index] - 1) {
+                    supported = true;
+                }
+            });
+            return supported;
+        }
+
+        void Repair(const int blocked, const int oldDistance) {
+            // Collect every cell that lost all of its shortest-path parents. A cell is re-checked each time one of
+            // its parents turns out to be affected, so the last such parent decides it.
+            int tail = 0;
+            const auto consider = [&](const int index, const int parentDistance) {
+                if (passability_[index] == Passability::kPassable && !affected_[index] &&
+                    distances_[index] == parentDistance + 1 && !HasSupport(index)) {
+                    affected_[index] = true;
+                    queue_[tail++] = index;
+                }
+            };
+
+            ForEachNeighbor(blocked, [&](const int neighbor) { consider(neighbor, oldDistance); });
+            for (int head = 0; head < tail; ++head) {
+                const int index = queue_[head];
+                ForEachNeighbor(index, [&](const int neighbor) { consider(neighbor, distances_[index]); });
+            }
+
+            for (int k = 0; k < tail; ++k) {
+                SetDistance(queue_[k], kUnreachable);
+            }
+
+            // Re-seed the affected region from its unaffected border, then run a breadth-first search that merges
+            // the seeds in distance order so every cell is settled once.
+            int seedCount = 0;
+            for (int k = 0; k < tail; ++k) {
+                const int index = queue_[k];
+                affected_[index] = false;
+                if (const int distance = GetDistanceThroughNeighbors(index); distance != kUnreachable) {
+                    SetDistance(index, distance);
+                    seeds_[seedCount++] = {distance, index};
+                }
+            }
+            std::sort(seeds_.begin(), seeds_.begin() + seedCount);
+
+            int seedHead = 0;
+            int head = 0;
+            tail = 0;
+            while (seedHead < seedCount || head < tail) {
+                int index;
+                if (head == tail || (seedHead < seedCount && seeds_[seedHead].first <= distances_[queue_[head]])) {
+                    const auto [distance, seed] = seeds_[seedHead++];
+                    if (distances_[seed] != distance)
+                        continue;
+                    index = seed;
+                } else {
+                    index = queue_[head++];
+                }
+
+                ForEachNeighbor(index, [&](const int neighbor) {
+                    if (passability_[neighbor] == Passability::kPassable &&
+                        (distances_[neighbor] == kUnreachable || distances_[neighbor] > distances_[index] + 1)) {
+                        SetDistance(neighbor, distances_[index] + 1);
+                        queue_[tail++] = neighbor;
+                    }
+                });
+            }
+        }
+
+        std::array<Passability, kCellCount> passability_;
+        std::array<int, kCellCount> distances_;
+        std::array<bool, kCellCount> affected_;
+        std::array<int, kCellCount> queue_;
+        std::array<std::pair<int, int>, kCellCount> seeds_;
+        std::array<int, kCellCount> changed_;
+        std::array<bool, kCellCount> isChanged_;
+        int changedCount_ = 0;
+    };
+
+    // Where every conveyor, combiner and mining machine ultimately sends its products. Each footprint cell has at
+    // most one output cell, so following outputs from any cell ends at the collection center (connected), at
+    // something that cannot take products (dead) or in a loop (in cycle; cells feeding a loop are dead).
+    // Build and Remove re-resolve only the changed cells and the cells upstream of them.
+    class FlowNetwork {
+    public:
+        FlowNetwork() : kinds_{}, outputs_{}, statuses_{}, pending_{}, onPath_{}, touched_{}, path_{} {
+            kinds_.fill(FlowNodeKind::kNone);
+            outputs_.fill(-1);
+            statuses_.fill(FlowStatus::kNone);
+        }
+
+        [[nodiscard]] FlowStatus GetStatus(const CellPosition cellPosition) const {
+            return statuses_[ToIndex(cellPosition)];
+        }
+
+        // Mining machines whose products currently reach the collection center.
+        [[nodiscard]] int GetConnectedSourceCount() const { return connectedSourceCount_; }
+
+        void SetNode(const CellPosition cellPosition, const FlowNodeKind kind,
+                     const std::optional<CellPosition> outputCellPosition) {
+            const int index = ToIndex(cellPosition);
+            if (statuses_[index] == FlowStatus::kConnected) {
+                connectedSourceCount_ += (kind == FlowNodeKind::kSource) - (kinds_[index] == FlowNodeKind::kSource);
+            }
+            kinds_[index] = kind;
+            outputs_[index] = outputCellPosition && IsInside(*outputCellPosition) ? ToIndex(*outputCellPosition) : -1;
+        }
+
+        // A mining machine whose output cell can never take a product does nothing but count its cycle.
+        [[nodiscard]] bool IsIdleSource(const int index) const {
+            return kinds_[index] == FlowNodeKind::kSource && (outputs_[index] < 0 || !Accepts(outputs_[index]));
+        }
+
+        void Resolve(const CellPosition topLeft, const std::size_t height, const std::size_t width) {
+            touchedCount_ = 0;
+            for (std::size_t i = 0; i < height; ++i) {
+                for (std::size_t j = 0; j < width; ++j) {
+                    Touch(ToIndex(topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)}));
+                }
+            }
+
+            for (int head = 0; head < touchedCount_; ++head) {
+                const int index = touched_[head];
+                ForEachNeighbor(index, [&](const int neighbor) {
+                    if (outputs_[neighbor] == index && kinds_[neighbor] != FlowNodeKind::kNone && !pending_[neighbor]) {
+                        Touch(neighbor);
+                    }
+                });
+            }
+
+            for (int k = 0; k < touchedCount_; ++k) {
+                if (pending_[touched_[k]]) {
+                    ResolvePath(touched_[k]);
+                }
+            }
+        }
+
+        [[nodiscard]] int GetTouchedCount() const { return touchedCount_; }
+
+        [[nodiscard]] int GetTouched(const int k) const { return touched_[k]; }
+
+    private:
+        static constexpr int kCellCount = GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight;
+
+        static int ToIndex(const CellPosition cellPosition) {
+            return cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col;
+        }
+
+        static bool IsInside(const CellPosition cellPosition) {
+            return cellPosition.row >= 0 && cellPosition.row < GameManagerConfig::kBoardHeight &&
+                   cellPosition.col >= 0 && cellPosition.col < GameManagerConfig::kBoardWidth;
+        }
+
+        template<typename TFunction>
+        static void ForEachNeighbor(const int index, TFunction function) {
+            const int row = index / GameManagerConfig::kBoardWidth;
+            const int col = index % GameManagerConfig::kBoardWidth;
+            if (row > 0)
+                function(index - GameManagerConfig::kBoardWidth);
+            if (col + 1 < GameManagerConfig::kBoardWidth)
+                function(index + 1);
+            if (row + 1 < GameManagerConfig::kBoardHeight)
+                function(index + GameManagerConfig::kBoardWidth);
+            if (col > 0)
+                function(index - 1);
+        }
+
+        [[nodiscard]] bool Accepts(const int index) const {
+            return kinds_[index] == FlowNodeKind::kSink || kinds_[index] == FlowNodeKind::kTransport;
+        }
+
+        void SetStatus(const int index, const FlowStatus status) {
+            if (kinds_[index] == FlowNodeKind::kSource) {
+                connectedSourceCount_ +=
+                        (status == FlowStatus::kConnected) - (statuses_[index] == FlowStatus::kConnected);
+            }
+            statuses_[index] = status;
+        }
+
+        void Touch(const int index) {
+            pending_[index] = true;
+            touched_[touchedCount_++] = index;
+        }
+
+        void ResolvePath(const int start) {
+            int length = 0;
+            int cycleStart = -1;
+            FlowStatus result = FlowStatus::kDead;
+
+            for (int index = start;;) {
+                if (!pending_[index]) {
+                    result = statuses_[index] == FlowStatus::kConnected ? FlowStatus::kConnected : FlowStatus::kDead;
+                    break;
+                }
+                if (onPath_[index]) {
+                    cycleStart = index;
+                    break;
+                }
+                if (kinds_[index] == FlowNodeKind::kNone) {
+                    pending_[index] = false;
+                    SetStatus(index, FlowStatus::kNone);
+                    break;
+                }
+
+                onPath_[index] = true;
+                path_[length++] = index;
+
+                if (kinds_[index] == FlowNodeKind::kSink) {
+                    result = FlowStatus::kConnected;
+                    break;
+                }
+                if (outputs_[index] < 0 || !Accepts(outputs_[index])) {
+                    break;
+                }
+                index = outputs_[index];
+            }
+
+            bool inCycle = false;
+            for (int k = 0; k < length; ++k) {
+                const int index = path_[k];
+                inCycle = inCycle || index == cycleStart;
+                SetStatus(index, inCycle ? FlowStatus::kInCycle : result);
+                pending_[index] = false;
+                onPath_[index] = false;
+            }
+        }
+
+        std::array<FlowNodeKind, kCellCount> kinds_;
+        std::array<int, kCellCount> outputs_;
+        std::array<FlowStatus, kCellCount> statuses_;
+        std::array<bool, kCellCount> pending_;
+        std::array<bool, kCellCount> onPath_;
+        std::array<int, kCellCount> touched_;
+        std::array<int, kCellCount> path_;
+        int touchedCount_ = 0;
+        int connectedSourceCount_ = 0;
+    };
+
+    // Follows a sample of products from the mining machine that made them to the collection center. Disabled
+    // unless attached to a GameManager; while disabled every tag stays 0 and the engine never calls in here.
+    // Records live in a fixed ring, so a product that is lost or outlives capacity newer samples simply stops
+    // being traced.
+    class LineageTracer {
+    public:
+        static constexpr std::size_t kLatencyBucketCount = 16;
+
+        struct Record {
+            ProductTag tag;
+            std::array<CellPosition, 2> origins;
+            std::array<long long, 2> minedAt;
+            CellPosition combiner;
+            int hops;
+        };
+
+        struct MinerStatistics {
+            std::array<std::uint32_t, kLatencyBucketCount> latencyHistogram;
+            std::uint32_t delivered;
+            std::uint32_t scored;
+            long long totalLatency;
+            long long totalHops;
+        };
+
+        explicit LineageTracer(const std::size_t sampleInterval, const std::size_t capacity = 4096) :
+            sampleInterval_(sampleInterval == 0 ? 1 : sampleInterval), records_(capacity == 0 ? 1 : capacity),
+            minerStatistics_(kCellCount), combinerDeliveries_(kCellCount) {}
+
+        // Bucket 0 holds latency 0, bucket k holds [2^(k-1), 2^k), the last bucket everything longer.
+        static std::size_t GetLatencyBucket(const long long latency) {
+            std::size_t bucket = 0;
+            for (long long value = latency; value > 0 && bucket + 1 < kLatencyBucketCount; value >>= 1) {
+                bucket += 1;
+            }
+            return bucket;
+        }
+
+        ProductTag OnMined(const CellPosition origin, const long long tick) {
+            if (minedCount_++ % sampleInterval_ != 0)
+                return 0;
+
+            constexpr CellPosition kNowhere{-1, -1};
+            Record &record = Allocate();
+            record.origins = {origin, kNowhere};
+            record.minedAt = {tick, tick};
+            record.combiner = kNowhere;
+            record.hops = 0;
+            sampledCount_ += 1;
+            return record.tag;
+        }
+
+        ProductTag OnCombined(const CellPosition combiner, const ProductTag first, const ProductTag second) {
+            const Record *firstRecord = Find(first);
+            const Record *secondRecord = Find(second);
+            if (firstRecord == nullptr && secondRecord == nullptr)
+                return 0;
+
+            if (firstRecord == nullptr || secondRecord == nullptr) {
+                const Record parent = firstRecord ? *firstRecord : *secondRecord;
+                Record &record = Allocate();
+                record.origins = parent.origins;
+                record.minedAt = parent.minedAt;
+                record.combiner = combiner;
+                record.hops = parent.hops;
+                return record.tag;
+            }
+
+            const Record firstParent = *firstRecord;
+            const Record secondParent = *secondRecord;
+            Record &record = Allocate();
+            record.origins = {firstParent.origins[0], secondParent.origins[0]};
+            record.minedAt = {firstParent.minedAt[0], secondParent.minedAt[0]};
+            record.combiner = combiner;
+            record.hops = std::max(firstParent.hops, secondParent.hops);
+            return record.tag;
+        }
+
+        void OnHop(const ProductTag tag) {
+            if (Record *record = Find(tag)) {
+                record->hops += 1;
+            }
+        }
+
+        void OnDelivered(const ProductTag tag, const bool scored, const long long tick) {
+            Record *record = Find(tag);
+            if (record == nullptr)
+                return;
+
+            for (std::size_t k = 0; k < record->origins.size(); ++k) {
+                const CellPosition origin = record->origins[k];
+                if (origin.row < 0)
+                    continue;
+
+                MinerStatistics &statistics = minerStatistics_[ToIndex(origin)];
+                const long long latency = tick - record->minedAt[k];
+                statistics.latencyHistogram[GetLatencyBucket(latency)] += 1;
+                statistics.delivered += 1;
+                statistics.scored += scored ? 1 : 0;
+                statistics.totalLatency += latency;
+                statistics.totalHops += record->hops;
+            }
+            if (record->combiner.row >= 0) {
+                combinerDeliveries_[ToIndex(record->combiner)] += 1;
+            }
+            deliveredCount_ += 1;
+            record->tag = 0;
+        }
+
+        [[nodiscard]] const MinerStatistics &GetMinerStatistics(const CellPosition cellPosition) const {
+            return minerStatistics_[ToIndex(cellPosition)];
+        }
+
+        [[nodiscard]] std::uint32_t GetCombinerDeliveries(const CellPosition cellPosition) const {
+            return combinerDeliveries_[ToIndex(cellPosition)];
+        }
+
+        [[nodiscard]] std::size_t GetSampleInterval() const { return sampleInterval_; }
+
+        [[nodiscard]] std::size_t GetSampledCount() const { return sampledCount_; }
+
+        [[nodiscard]] std::size_t GetDeliveredCount() const { return deliveredCount_; }
+
+    private:
+        static constexpr int kCellCount = GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight;
+
+        static int ToIndex(const CellPosition cellPosition) {
+            return cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col;
+        }
+
+        Record &Allocate() {
+            nextTag_ += 1;
+            if (nextTag_ == 0) {
+                nextTag_ = 1;
+            }
+            Record &record = records_[nextTag_ % records_.size()];
+            record.tag = nextTag_;
+            return record;
+        }
+
+        Record *Find(const ProductTag tag) {
+            if (tag == 0)
+                return nullptr;
+            Record &record = records_[tag % records_.size()];
+            return record.tag == tag ? &record : nullptr;
+        }
+
+        std::size_t sampleInterval_;
+        std::size_t minedCount_ = 0;
+        std::size_t sampledCount_ = 0;
+        std::size_t deliveredCount_ = 0;
+        ProductTag nextTag_ = 0;
+        std::vector<Record> records_;
+        std::vector<MinerStatistics> minerStatistics_;
+        std::vector<std::uint32_t> combinerDeliveries_;
+    };
+
+    // Per-cell side table of how often each entity moved a product on, sat with a product it could not pass on,
+    // or, for mining machines, finished a cycle with nowhere to put the product. Attached like LineageTracer;
+    // mining machines left out by SetSkipDeadEntities are not counted while skipped.
+    class FlowCounters {
+    public:
+        struct Counters {
+            std::uint32_t forwarded;
+            std::uint32_t ticksBlocked;
+            std::uint32_t miningCyclesLost;
+        };
+
+        FlowCounters() : counters_(kCellCount) {}
+
+        void Add(const CellPosition cellPosition, const FlowEvent event) {
+            Counters &counters = counters_[cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col];
+            switch (event) {
+                case FlowEvent::kForwarded:
+                    counters.forwarded += 1;
+                    break;
+                case FlowEvent::kBlocked:
+                    counters.ticksBlocked += 1;
+                    break;
+                case FlowEvent::kMiningCycleLost:
+                    counters.miningCyclesLost += 1;
+                    break;
+            }
+        }
+
+        [[nodiscard]] const Counters &Get(const CellPosition cellPosition) const {
+            return counters_[cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col];
+        }
+
+        void Reset() { std::fill(counters_.begin(), counters_.end(), Counters{}); }
+
+    private:
+        static constexpr int kCellCount = GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight;
+
+        std::vector<Counters> counters_;
+    };
+
     class LayeredCell {
     public:
-        [[nodiscard]] std::shared_ptr<ForegroundCell> GetForeground() const { return foreground_; }
+        [[nodiscard]] const std::shared_ptr<ForegroundCell> &GetForeground() const { return foreground_; }
 
-        [[nodiscard]] std::shared_ptr<IBackgroundCell> GetBackground() const { return background_; }
+        [[nodiscard]] const std::shared_ptr<IBackgroundCell> &GetBackground() const { return background_; }
 
         [[nodiscard]] bool CanBuild() const {
             return foreground_ == nullptr && (background_ == nullptr || background_->CanBuild());
@@ -351,26 +1036,141 @@ namespace Feis {
         std::shared_ptr<IBackgroundCell> background_;
     };
 
+    enum class ObservationChannel : int {
+        kWall,
+        kNumber1,
+        kNumber2,
+        kNumber3,
+        kNumber5,
+        kNumber7,
+        kNumber11,
+        kNumber13,
+        kCollectionCenter,
+        kMiningMachine,
+        kConveyor,
+        kCombiner,
+        kFacingTop,
+        kFacingRight,
+        kFacingBottom,
+        kFacingLeft,
+        kConveyorFill,
+        kCombinerSlot,
+        kDistance,
+        kCount
+    };
+
+    // The board as one float tensor of kChannelCount planes of kBoardHeight x kBoardWidth, row-major, for agents
+    // that would otherwise walk every LayeredCell each decision. Attached like LineageTracer: the board rewrites
+    // only the cells a Build, Remove or product move touched, so reading it is a single copy of GetData().
+    // Conveyor fill is the number of products held; a combiner slot is the product waiting in that cell's slot;
+    // distance is GetDistanceToCollectionCenter, -1 where unreachable. Every other plane is 0 or 1.
+    class ObservationPlanes {
+    public:
+        static constexpr int kChannelCount = static_cast<int>(ObservationChannel::kCount);
+        static constexpr int kPlaneSize = GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight;
+        static constexpr std::size_t kSize = static_cast<std::size_t>(kChannelCount) * kPlaneSize;
+
+        ObservationPlanes() : ownedValues_(kSize), values_(ownedValues_.data()) {}
+
+        // Writes into kSize floats the caller keeps alive instead, e.g. a shared memory mapping.
+        explicit ObservationPlanes(float *storage) : values_(storage) { std::fill(values_, values_ + kSize, 0.0f); }
+
+        ObservationPlanes(const ObservationPlanes &) = delete;
+
+        ObservationPlanes &operator=(const ObservationPlanes &) = delete;
+
+        [[nodiscard]] const float *GetData() const { return values_; }
+
+        [[nodiscard]] float Get(const ObservationChannel channel, const CellPosition cellPosition) const {
+            return values_[GetOffset(channel, ToIndex(cellPosition))];
+        }
+
+        void CopyTo(float *out) const { std::memcpy(out, values_, kSize * sizeof(float)); }
+
+        // Zeroes every plane of one cell but the distance, which the board keeps separately.
+        void ClearCell(const CellPosition cellPosition) {
+            const int index = ToIndex(cellPosition);
+            for (int channel = 0; channel < kChannelCount; ++channel) {
+                if (channel != static_cast<int>(ObservationChannel::kDistance)) {
+                    values_[static_cast<std::size_t>(channel) * kPlaneSize + index] = 0;
+                }
+            }
+        }
+
+        void Set(const ObservationChannel channel, const CellPosition cellPosition, const float value) {
+            values_[GetOffset(channel, ToIndex(cellPosition))] = value;
+        }
+
+        void SetDistance(const int index, const int distance) {
+            values_[GetOffset(ObservationChannel::kDistance, index)] = static_cast<float>(distance);
+        }
+
+        [[nodiscard]] static std::optional<ObservationChannel> GetNumberChannel(const int number) {
+            switch (number) {
+                case 1:
+                    return ObservationChannel::kNumber1;
+                case 2:
+                    return ObservationChannel::kNumber2;
+                case 3:
+                    return ObservationChannel::kNumber3;
+                case 5:
+                    return ObservationChannel::kNumber5;
+                case 7:
+                    return ObservationChannel::kNumber7;
+                case 11:
+                    return ObservationChannel::kNumber11;
+                case 13:
+                    return ObservationChannel::kNumber13;
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        [[nodiscard]] static ObservationChannel GetFacingChannel(const Direction direction) {
+            return static_cast<ObservationChannel>(static_cast<int>(ObservationChannel::kFacingTop) +
+                                                   static_cast<int>(direction));
+        }
+
+    private:
+        static int ToIndex(const CellPosition cellPosition) {
+            return cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col;
+        }
+
+        static std::size_t GetOffset(const ObservationChannel channel, const int index) {
+            return static_cast<std::size_t>(channel) * kPlaneSize + index;
+        }
+
+        std::vector<float> ownedValues_;
+        float *values_;
+    };
+
+    // Rewrites the observation of every cell covered by whatever occupies cellPosition, or of that cell alone when
+    // it is empty. Defined after the last cell type.
+    void RefreshObservation(ObservationPlanes &observationPlanes, const GameBoard &board, CellPosition cellPosition);
+
 
     class GameBoard {
     public:
+        GameBoard() : idleSince_{} { idleSince_.fill(-1); }
+
         [[nodiscard]] const LayeredCell &GetLayeredCell(const CellPosition cellPosition) const {
             return layeredCells_[cellPosition.row][cellPosition.col];
         }
 
         [[nodiscard]] bool CanBuild(const std::shared_ptr<ForegroundCell> &cell) const {
-            if (cell == nullptr)
-                return false;
+            return cell != nullptr && CanBuild(*cell);
+        }
 
-            const auto [row, col] = cell->GetTopLeftCellPosition();
+        [[nodiscard]] bool CanBuild(const ForegroundCell &cell) const {
+            const auto [row, col] = cell.GetTopLeftCellPosition();
 
-            if (col < 0 || col + cell->GetWidth() > GameManagerConfig::kBoardWidth || row < 0 ||
-                row + cell->GetHeight() > GameManagerConfig::kBoardHeight) {
+            if (col < 0 || col + cell.GetWidth() > GameManagerConfig::kBoardWidth || row < 0 ||
+                row + cell.GetHeight() > GameManagerConfig::kBoardHeight) {
                 return false;
             }
 
-            for (std::size_t i = 0; i < cell->GetHeight(); ++i) {
-                for (std::size_t j = 0; j < cell->GetWidth(); ++j) {
+            for (std::size_t i = 0; i < cell.GetHeight(); ++i) {
+                for (std::size_t j = 0; j < cell.GetWidth(); ++j) {
                     if (!layeredCells_[row + i][col + j].CanBuild()) {
                         return false;
                     }
@@ -381,61 +1181,234 @@ namespace Feis {
 
         template<typename TCell, typename... TArgs>
         bool Build(CellPosition cellPosition, TArgs... args) {
-            auto cell = std::make_shared<TCell>(cellPosition, args...);
+            // The footprint is checked on a stack copy first, so a build that fails never touches the heap.
+            const TCell candidate(cellPosition, args...);
 
-            if (!CanBuild(cell))
+            if (!CanBuild(candidate))
                 return false;
 
+            auto cell = std::make_shared<TCell>(candidate);
             const CellPosition topLeft = cell->GetTopLeftCellPosition();
 
             for (std::size_t i = 0; i < cell->GetHeight(); ++i) {
                 for (std::size_t j = 0; j < cell->GetWidth(); ++j) {
                     layeredCells_[topLeft.row + i][topLeft.col + j].SetForeground(cell);
+
+                    const CellPosition position{topLeft.row + static_cast<int>(i), topLeft.col + static_cast<int>(j)};
+                    if constexpr (std::is_same_v<TCell, CollectionCenterCell>) {
+                        distanceField_.SetSource(position);
+                    } else if (!cell->IsPassable()) {
+                        distanceField_.SetBlocked(position);
+                    }
+                    flowNetwork_.SetNode(position, cell->GetFlowNodeKind(), cell->GetOutputCellPosition(position));
                 }
             }
+            OnFlowChanged(topLeft, cell->GetHeight(), cell->GetWidth());
+            OnObservationChanged(topLeft);
             return true;
         }
 
-        void Remove(const CellPosition cellPosition) {
+        bool Remove(const CellPosition cellPosition) {
+            const auto &foreground = layeredCells_[cellPosition.row][cellPosition.col].GetForeground();
+            return foreground && foreground->CanRemove() && Clear(cellPosition);
+        }
+
+        // Like Remove, but takes away walls and the collection center too; for rebuilding a board from recorded
+        // state.
+        bool Clear(const CellPosition cellPosition) {
             if (const auto foreground = layeredCells_[cellPosition.row][cellPosition.col].GetForeground()) {
-                if (foreground->CanRemove()) {
-                    const auto [row, col] = foreground->GetTopLeftCellPosition();
+                const auto [row, col] = foreground->GetTopLeftCellPosition();
+                productsInFlight_ -= static_cast<long long>(foreground->GetHeldProductCount());
 
-                    for (std::size_t i = 0; i < foreground->GetHeight(); ++i) {
-                        for (std::size_t j = 0; j < foreground->GetWidth(); ++j) {
-                            layeredCells_[row + i][col + j].SetForeground(nullptr);
-                        }
+                for (std::size_t i = 0; i < foreground->GetHeight(); ++i) {
+                    for (std::size_t j = 0; j < foreground->GetWidth(); ++j) {
+                        layeredCells_[row + i][col + j].SetForeground(nullptr);
+
+                        const CellPosition position{row + static_cast<int>(i), col + static_cast<int>(j)};
+                        distanceField_.SetPassable(position);
+                        flowNetwork_.SetNode(position, FlowNodeKind::kNone, std::nullopt);
+                    }
+                }
+                OnFlowChanged({row, col}, foreground->GetHeight(), foreground->GetWidth());
+                for (std::size_t i = 0; i < foreground->GetHeight(); ++i) {
+                    for (std::size_t j = 0; j < foreground->GetWidth(); ++j) {
+                        OnObservationChanged({row + static_cast<int>(i), col + static_cast<int>(j)});
+                    }
+                }
+                return true;
+            }
+            return false;
+        }
+
+        [[nodiscard]] int GetDistanceToCollectionCenter(const CellPosition cellPosition) const {
+            return distanceField_.Get(cellPosition);
+        }
+
+        [[nodiscard]] FlowStatus GetFlowStatus(const CellPosition cellPosition) const {
+            return flowNetwork_.GetStatus(cellPosition);
+        }
+
+        [[nodiscard]] long long GetTick() const { return tick_; }
+
+        void SetTick(const long long tick) { tick_ = tick; }
+
+        // The tick a skipped mining machine went idle at, or -1 for every other cell.
+        [[nodiscard]] long long GetIdleSince(const int index) const { return idleSince_[index]; }
+
+        // For restoring recorded state onto a cell SetSkipDeadEntities has already found idle.
+        void SetIdleSince(const int index, const long long tick) { idleSince_[index] = tick; }
+
+        // Products mined but not yet delivered, i.e. everything sitting on conveyors and in combiner slots.
+        [[nodiscard]] long long GetProductsInFlight() const { return productsInFlight_; }
+
+        void AddProductsInFlight(const int delta) { productsInFlight_ += delta; }
+
+        // For after contents were set directly, as when rebuilding a board from recorded state.
+        void RecountProductsInFlight() {
+            productsInFlight_ = 0;
+            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
+                    const auto &foreground = layeredCells_[row][col].GetForeground();
+                    if (foreground && foreground->GetTopLeftCellPosition() == CellPosition{row, col}) {
+                        productsInFlight_ += static_cast<long long>(foreground->GetHeldProductCount());
                     }
                 }
             }
         }
 
+        [[nodiscard]] int GetConnectedMiningMachineCount() const { return flowNetwork_.GetConnectedSourceCount(); }
+
+        [[nodiscard]] LineageTracer *GetLineageTracer() const { return lineageTracer_; }
+
+        void SetLineageTracer(LineageTracer *lineageTracer) { lineageTracer_ = lineageTracer; }
+
+        [[nodiscard]] FlowCounters *GetFlowCounters() const { return flowCounters_; }
+
+        void SetFlowCounters(FlowCounters *flowCounters) { flowCounters_ = flowCounters; }
+
+        [[nodiscard]] ObservationPlanes *GetObservationPlanes() const { return observationPlanes_; }
+
+        // Attaching writes the whole board once; from then on only changed cells are rewritten.
+        void SetObservationPlanes(ObservationPlanes *observationPlanes) {
+            observationPlanes_ = observationPlanes;
+            if (observationPlanes_ == nullptr)
+                return;
+
+            for (int row = 0, index = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col, ++index) {
+                    RefreshObservation(*observationPlanes_, *this, {row, col});
+                    observationPlanes_->SetDistance(index, distanceField_.Get({row, col}));
+                }
+            }
+            distanceField_.ClearChanged();
+        }
+
+        // Off by default. When on, mining machines that can never deliver anything are left out of Update() and
+        // have their cycle counter caught up as soon as their output cell changes.
+        [[nodiscard]] bool GetSkipDeadEntities() const { return skipDeadEntities_; }
+
+        void SetSkipDeadEntities(const bool enabled) {
+            skipDeadEntities_ = enabled;
+            for (int index = 0; index < kCellCount; ++index) {
+                SetIdle(index, enabled && flowNetwork_.IsIdleSource(index));
+            }
+        }
+
         void SetBackground(const CellPosition cellPosition, const std::shared_ptr<IBackgroundCell> &value) {
             layeredCells_[cellPosition.row][cellPosition.col].SetBackground(value);
+            if (observationPlanes_) {
+                RefreshObservation(*observationPlanes_, *this, cellPosition);
+            }
         }
 
         void Update() {
-            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
-                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
-                    auto &layeredCell = layeredCells_[row][col];
-                    if (const auto foreground = layeredCell.GetForeground()) {
-                        foreground->UpdatePassOne({row, col}, *this);
+            tick_ += 1;
+
+            {
+                PDOGS_PROFILE_SCOPE(ProfilePhase::kUpdatePassOne);
+                for (int row = 0, index = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                    for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col, ++index) {
+                        auto &layeredCell = layeredCells_[row][col];
+                        if (const auto &foreground = layeredCell.GetForeground();
+                            foreground && idleSince_[index] < 0) {
+                            foreground->UpdatePassOne({row, col}, *this);
+                        }
                     }
                 }
             }
-            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row) {
-                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col) {
-                    auto &layeredCell = layeredCells_[row][col];
-                    if (const auto foreground = layeredCell.GetForeground()) {
-                        foreground->UpdatePassTwo({row, col}, *this);
+            {
+                PDOGS_PROFILE_SCOPE(ProfilePhase::kUpdatePassTwo);
+                for (int row = 0, index = 0; row < GameManagerConfig::kBoardHeight; ++row) {
+                    for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col, ++index) {
+                        auto &layeredCell = layeredCells_[row][col];
+                        if (const auto &foreground = layeredCell.GetForeground();
+                            foreground && idleSince_[index] < 0) {
+                            foreground->UpdatePassTwo({row, col}, *this);
+                        }
                     }
                 }
             }
         }
 
     private:
+        static constexpr int kCellCount = GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight;
+
+        void OnFlowChanged(const CellPosition topLeft, const std::size_t height, const std::size_t width) {
+            flowNetwork_.Resolve(topLeft, height, width);
+            if (!skipDeadEntities_)
+                return;
+
+            for (int k = 0; k < flowNetwork_.GetTouchedCount(); ++k) {
+                const int index = flowNetwork_.GetTouched(k);
+                SetIdle(index, flowNetwork_.IsIdleSource(index));
+            }
+        }
+
+        // Rewrites the cells covered by whatever now occupies cellPosition, and every distance the change moved.
+        void OnObservationChanged(const CellPosition cellPosition) {
+            if (observationPlanes_ == nullptr) {
+                distanceField_.ClearChanged();
+                return;
+            }
+
+            RefreshObservation(*observationPlanes_, *this, cellPosition);
+            for (int k = 0; k < distanceField_.GetChangedCount(); ++k) {
+                const int index = distanceField_.GetChanged(k);
+                observationPlanes_->SetDistance(index, distanceField_.Get({index / GameManagerConfig::kBoardWidth,
+                                                                           index % GameManagerConfig::kBoardWidth}));
+            }
+            distanceField_.ClearChanged();
+        }
+
+        void SetIdle(const int index, const bool idle) {
+            if (idle == (idleSince_[index] >= 0))
+                return;
+
+            if (idle) {
+                idleSince_[index] = tick_;
+                return;
+            }
+
+            const auto &foreground =
+                    layeredCells_[index / GameManagerConfig::kBoardWidth][index % GameManagerConfig::kBoardWidth]
+                            .GetForeground();
+            if (foreground) {
+                foreground->AdvanceIdleTicks(static_cast<std::size_t>(tick_ - idleSince_[index]));
+            }
+            idleSince_[index] = -1;
+        }
+
         std::array<std::array<LayeredCell, GameManagerConfig::kBoardWidth>, GameManagerConfig::kBoardHeight>
                 layeredCells_;
+        DistanceField distanceField_;
+        FlowNetwork flowNetwork_;
+        std::array<long long, kCellCount> idleSince_;
+        long long tick_ = 0;
+        long long productsInFlight_ = 0;
+        bool skipDeadEntities_ = false;
+        LineageTracer *lineageTracer_ = nullptr;
+        FlowCounters *flowCounters_ = nullptr;
+        ObservationPlanes *observationPlanes_ = nullptr;
     };
 
     inline bool IsWithinBoard(const CellPosition cellPosition) {
@@ -443,16 +1416,63 @@ namespace Feis {
                cellPosition.col < GameManagerConfig::kBoardWidth;
     }
 
+    // Next step of the gradient walk down the distance field, or nothing on the collection center itself and on
+    // cells that cannot reach it.
+    inline std::optional<Direction> GetDirectionTowardCollectionCenter(const IGameInfo &info,
+                                                                       const CellPosition cellPosition) {
+        const int distance = info.GetDistanceToCollectionCenter(cellPosition);
+        if (distance <= 0)
+            return std::nullopt;
+
+        for (const auto direction: {Direction::kTop, Direction::kRight, Direction::kBottom, Direction::kLeft}) {
+            const CellPosition neighborCellPosition = GetNeighborCellPosition(cellPosition, direction);
+            if (IsWithinBoard(neighborCellPosition) &&
+                info.GetDistanceToCollectionCenter(neighborCellPosition) == distance - 1) {
+                return direction;
+            }
+        }
+        return std::nullopt;
+    }
+
     inline void SendProduct(const GameBoard &board, const CellPosition cellPosition, const Direction direction,
-                            const int product) {
+                            const int product, const ProductTag tag) {
 
         const CellPosition targetCellPosition = GetNeighborCellPosition(cellPosition, direction);
 
         if (!IsWithinBoard(targetCellPosition))
             return;
 
-        if (const auto foregroundCell = board.GetLayeredCell(targetCellPosition).GetForeground()) {
-            foregroundCell->ReceiveProduct(targetCellPosition, product);
+        if (tag != 0 && board.GetLineageTracer()) {
+            board.GetLineageTracer()->OnHop(tag);
+        }
+
+        if (const auto &foregroundCell = board.GetLayeredCell(targetCellPosition).GetForeground()) {
+            foregroundCell->ReceiveProduct(targetCellPosition, product, tag);
+            if (foregroundCell->GetFlowNodeKind() == FlowNodeKind::kTransport) {
+                OnHeldProductsChanged(board, targetCellPosition);
+            }
+        }
+    }
+
+    inline ProductTag CombineProductTags(const GameBoard &board, const CellPosition cellPosition,
+                                         const ProductTag first, const ProductTag second) {
+        if ((first == 0 && second == 0) || board.GetLineageTracer() == nullptr)
+            return 0;
+
+        return board.GetLineageTracer()->OnCombined(cellPosition, first, second);
+    }
+
+    inline void AddProductsInFlight(GameBoard &board, const int delta) { board.AddProductsInFlight(delta); }
+
+    inline void OnHeldProductsChanged(const GameBoard &board, const CellPosition cellPosition) {
+        if (ObservationPlanes *observationPlanes = board.GetObservationPlanes()) {
+            RefreshObservation(*observationPlanes, board, cellPosition);
+        }
+    }
+
+    inline void CountFlowEvent(const GameBoard &board, const CellPosition cellPosition, const FlowEvent event) {
+        if (FlowCounters *flowCounters = board.GetFlowCounters()) {
+            flowCounters->Add(cellPosition, event);
         }
     }
 
@@ -463,7 +1483,7 @@ namespace Feis {
         if (!IsWithinBoard(neighborCellPosition))
             return 0;
 
-        if (const auto foregroundCell = board.GetLayeredCell(neighborCellPosition).GetForeground()) {
+        if (const auto &foregroundCell = board.GetLayeredCell(neighborCellPosition).GetForeground()) {
             return foregroundCell->GetCapacity(neighborCellPosition);
         }
         return 0;
@@ -507,22 +1527,48 @@ namespace Feis {
 
         [[nodiscard]] Direction GetDirection() const { return direction_; }
 
+        [[nodiscard]] std::size_t GetElapsedTime() const { return elapsedTime_; }
+
+        void SetElapsedTime(const std::size_t elapsedTime) { elapsedTime_ = elapsedTime % kInterval; }
+
         void Accept(const CellVisitor *visitor) const override { visitor->Visit(this); }
 
         [[nodiscard]] bool CanRemove() const override { return true; }
 
+        [[nodiscard]] FlowNodeKind GetFlowNodeKind() const override { return FlowNodeKind::kSource; }
+
+        [[nodiscard]] std::optional<CellPosition>
+        GetOutputCellPosition(const CellPosition cellPosition) const override {
+            return GetNeighborCellPosition(cellPosition, direction_);
+        }
+
         [[nodiscard]] std::size_t GetCapacity(CellPosition cellPosition) const override { return 0; }
 
-        void ReceiveProduct(CellPosition cellPosition, int number) override {}
+        void ReceiveProduct(CellPosition cellPosition, int number, ProductTag tag) override {}
+
+        // The cycle counter wraps whether or not the product could be sent, so skipped ticks fold in exactly.
+        void AdvanceIdleTicks(const std::size_t ticks) override { elapsedTime_ = GetElapsedTimeAfter(ticks); }
+
+        // The cycle counter AdvanceIdleTicks(ticks) would leave, without changing it.
+        [[nodiscard]] std::size_t GetElapsedTimeAfter(const std::size_t ticks) const {
+            return (elapsedTime_ + ticks) % kInterval;
+        }
 
         void UpdatePassOne(const CellPosition cellPosition, GameBoard &board) override {
+            PDOGS_PROFILE_COUNT(ProfileCounter::kMiningMachinePassOne);
             elapsedTime_ += 1;
-            if (elapsedTime_ >= 100) {
-                const auto numberCell =
-                        std::dynamic_pointer_cast<const NumberCell>(board.GetLayeredCell(cellPosition).GetBackground());
+            if (elapsedTime_ >= kInterval) {
+                const auto *numberCell =
+                        dynamic_cast<const NumberCell *>(board.GetLayeredCell(cellPosition).GetBackground().get());
 
                 if (numberCell && GetNeighborCapacity(board, cellPosition, direction_) >= 3) {
-                    SendProduct(board, cellPosition, direction_, numberCell->GetNumber());
+                    LineageTracer *lineageTracer = board.GetLineageTracer();
+                    const ProductTag tag = lineageTracer ? lineageTracer->OnMined(cellPosition, board.GetTick()) : 0;
+                    SendProduct(board, cellPosition, direction_, numberCell->GetNumber(), tag);
+                    AddProductsInFlight(board, 1);
+                    CountFlowEvent(board, cellPosition, FlowEvent::kForwarded);
+                } else if (numberCell) {
+                    CountFlowEvent(board, cellPosition, FlowEvent::kMiningCycleLost);
                 }
 
                 elapsedTime_ = 0;
@@ -530,10 +1576,81 @@ namespace Feis {
         }
 
     private:
+        static constexpr std::size_t kInterval = 100;
+
         Direction direction_{};
         std::size_t elapsedTime_;
     };
 
+    // Writes one cell's planes from the background and foreground it is visited with.
+    class ObservationWriter final : public CellVisitor {
+    public:
+        ObservationWriter(ObservationPlanes &observationPlanes, const CellPosition cellPosition) :
+            observationPlanes_(observationPlanes), cellPosition_(cellPosition) {}
+
+        void Visit(const NumberCell *cell) const override {
+            if (const auto channel = ObservationPlanes::GetNumberChannel(cell->GetNumber())) {
+                observationPlanes_.Set(*channel, cellPosition_, 1);
+            }
+        }
+
+        void Visit(const CollectionCenterCell *cell) const override {
+            observationPlanes_.Set(ObservationChannel::kCollectionCenter, cellPosition_, 1);
+        }
+
+        void Visit(const MiningMachineCell *cell) const override {
+            observationPlanes_.Set(ObservationChannel::kMiningMachine, cellPosition_, 1);
+            observationPlanes_.Set(ObservationPlanes::GetFacingChannel(cell->GetDirection()), cellPosition_, 1);
+        }
+
+        void Visit(const ConveyorCell *cell) const override {
+            observationPlanes_.Set(ObservationChannel::kConveyor, cellPosition_, 1);
+            observationPlanes_.Set(ObservationPlanes::GetFacingChannel(cell->GetDirection()), cellPosition_, 1);
+            observationPlanes_.Set(ObservationChannel::kConveyorFill, cellPosition_,
+                                   static_cast<float>(cell->GetHeldProductCount()));
+        }
+
+        void Visit(const CombinerCell *cell) const override {
+            observationPlanes_.Set(ObservationChannel::kCombiner, cellPosition_, 1);
+            observationPlanes_.Set(ObservationPlanes::GetFacingChannel(cell->GetDirection()), cellPosition_, 1);
+            observationPlanes_.Set(ObservationChannel::kCombinerSlot, cellPosition_,
+                                   static_cast<float>(cell->IsMainCell(cellPosition_) ? cell->GetFirstSlotProduct()
+                                                                                      : cell->GetSecondSlotProduct()));
+        }
+
+        void Visit(const WallCell *cell) const override {
+            observationPlanes_.Set(ObservationChannel::kWall, cellPosition_, 1);
+        }
+
+    private:
+        ObservationPlanes &observationPlanes_;
+        CellPosition cellPosition_;
+    };
+
+    inline void RefreshObservation(ObservationPlanes &observationPlanes, const GameBoard &board,
+                                   const CellPosition cellPosition) {
+        const auto &foreground = board.GetLayeredCell(cellPosition).GetForeground();
+        const CellPosition topLeft = foreground ? foreground->GetTopLeftCellPosition() : cellPosition;
+        const std::size_t height = foreground ? foreground->GetHeight() : 1;
+        const std::size_t width = foreground ? foreground->GetWidth() : 1;
+
+        for (std::size_t i = 0; i < height; ++i) {
+            for (std::size_t j = 0; j < width; ++j) {
+                const CellPosition position = topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)};
+                const LayeredCell &layeredCell = board.GetLayeredCell(position);
+                const ObservationWriter writer(observationPlanes, position);
+
+                observationPlanes.ClearCell(position);
+                if (layeredCell.GetBackground()) {
+                    layeredCell.GetBackground()->Accept(&writer);
+                }
+                if (layeredCell.GetForeground()) {
+                    layeredCell.GetForeground()->Accept(&writer);
+                }
+            }
+        }
+    }
+
     enum class PlayerActionType {
         None,
         BuildLeftOutMiningMachine,
@@ -570,7 +1687,7 @@ namespace Feis {
         };
 
         GameManager(IGamePlayer *player, const int commonDivisor, const unsigned int seed) :
-            elapsedTime_{}, endTime_{GameManagerConfig::kEndTime}, player_(player),
+            elapsedTime_{}, lastBoardChangeTime_{}, endTime_{GameManagerConfig::kEndTime}, player_(player),
             commonDivisor_{commonDivisor}, scores_{} {
             static_assert(GameManagerConfig::kBoardWidth % 2 == 0, "WIDTH must be even");
 
@@ -609,16 +1726,75 @@ namespace Feis {
 
         [[nodiscard]] int GetElapsedTime() const override { return elapsedTime_; }
 
+        [[nodiscard]] int GetLastBoardChangeTime() const { return lastBoardChangeTime_; }
+
+        [[nodiscard]] long long GetDeliveredProductCount() const { return deliveredProducts_; }
+
+        [[nodiscard]] long long GetScoredProductCount() const { return scoredProducts_; }
+
+        [[nodiscard]] long long GetProductsInFlight() const { return board_.GetProductsInFlight(); }
+
+        [[nodiscard]] int GetConnectedMiningMachineCount() const { return board_.GetConnectedMiningMachineCount(); }
+
+        [[nodiscard]] int GetDistanceToCollectionCenter(const CellPosition cellPosition) const override {
+            return board_.GetDistanceToCollectionCenter(cellPosition);
+        }
+
+        [[nodiscard]] FlowStatus GetFlowStatus(const CellPosition cellPosition) const override {
+            return board_.GetFlowStatus(cellPosition);
+        }
+
+        [[nodiscard]] bool GetSkipDeadEntities() const { return board_.GetSkipDeadEntities(); }
+
+        void SetSkipDeadEntities(const bool enabled) { board_.SetSkipDeadEntities(enabled); }
+
+        void SetLineageTracer(LineageTracer *lineageTracer) { board_.SetLineageTracer(lineageTracer); }
+
+        void SetFlowCounters(FlowCounters *flowCounters) { board_.SetFlowCounters(flowCounters); }
+
+        void SetObservationPlanes(ObservationPlanes *observationPlanes) {
+            board_.SetObservationPlanes(observationPlanes);
+        }
+
+        [[nodiscard]] int GetCommonDivisor() const { return commonDivisor_; }
+
+        // For restoring a recorded state onto a game started from the same seed: the board is rebuilt in place
+        // (see ApplyCellStates) and the counters around it are set here.
+        [[nodiscard]] GameBoard &GetBoard() { return board_; }
+
+        [[nodiscard]] const GameBoard &GetBoard() const { return board_; }
+
+        void SetLevel(const int commonDivisor, const int endTime) {
+            commonDivisor_ = commonDivisor;
+            endTime_ = endTime;
+        }
+
+        void SetProgress(const int elapsedTime, const int lastBoardChangeTime, const int scores,
+                         const long long deliveredProducts, const long long scoredProducts) {
+            elapsedTime_ = elapsedTime;
+            lastBoardChangeTime_ = lastBoardChangeTime;
+            scores_ = scores;
+            deliveredProducts_ = deliveredProducts;
+            scoredProducts_ = scoredProducts;
+        }
+
         [[nodiscard]] std::string GetLevelInfo() const override { return "(" + std::to_string(commonDivisor_) + ")"; }
 
         [[nodiscard]] bool IsScoredProduct(const int number) const override { return number % commonDivisor_ == 0; }
 
-        void OnProductReceived(const int number) override {
+        void OnProductReceived(const int number, const ProductTag tag) override {
             assert(number != 0);
 
+            board_.AddProductsInFlight(-1);
+            deliveredProducts_ += 1;
             if (number % commonDivisor_ == 0) {
+                scoredProducts_ += 1;
                 AddScore();
             }
+
+            if (tag != 0 && board_.GetLineageTracer()) {
+                board_.GetLineageTracer()->OnDelivered(tag, number % commonDivisor_ == 0, board_.GetTick());
+            }
         }
 
         [[nodiscard]] int GetScores() const override { return scores_; }
@@ -633,52 +1809,17 @@ namespace Feis {
             if (elapsedTime_ >= endTime_)
                 return;
 
+            PDOGS_PROFILE_SCOPE(ProfilePhase::kGameUpdate);
             elapsedTime_ += 1;
 
             if (elapsedTime_ % 3 == 0) {
-
-                switch (const PlayerAction playerAction = player_->GetNextAction(*this); playerAction.type) {
-                    case PlayerActionType::None:
-                        break;
-                    case PlayerActionType::BuildLeftOutMiningMachine:
-                        board_.Build<MiningMachineCell>(playerAction.cellPosition, Direction::kLeft);
-                        break;
-                    case PlayerActionType::BuildTopOutMiningMachine:
-                        board_.Build<MiningMachineCell>(playerAction.cellPosition, Direction::kTop);
-                        break;
-                    case PlayerActionType::BuildRightOutMiningMachine:
-                        board_.Build<MiningMachineCell>(playerAction.cellPosition, Direction::kRight);
-                        break;
-                    case PlayerActionType::BuildBottomOutMiningMachine:
-                        board_.Build<MiningMachineCell>(playerAction.cellPosition, Direction::kBottom);
-                        break;
-                    case PlayerActionType::BuildLeftToRightConveyor:
-                        board_.Build<ConveyorCell>(playerAction.cellPosition, Direction::kRight);
-                        break;
-                    case PlayerActionType::BuildTopToBottomConveyor:
-                        board_.Build<ConveyorCell>(playerAction.cellPosition, Direction::kBottom);
-                        break;
-                    case PlayerActionType::BuildRightToLeftConveyor:
-                        board_.Build<ConveyorCell>(playerAction.cellPosition, Direction::kLeft);
-                        break;
-                    case PlayerActionType::BuildBottomToTopConveyor:
-                        board_.Build<ConveyorCell>(playerAction.cellPosition, Direction::kTop);
-                        break;
-                    case PlayerActionType::BuildTopOutCombiner:
-                        board_.Build<CombinerCell>(playerAction.cellPosition, Direction::kTop);
-                        break;
-                    case PlayerActionType::BuildRightOutCombiner:
-                        board_.Build<CombinerCell>(playerAction.cellPosition, Direction::kRight);
-                        break;
-                    case PlayerActionType::BuildBottomOutCombiner:
-                        board_.Build<CombinerCell>(playerAction.cellPosition, Direction::kBottom);
-                        break;
-                    case PlayerActionType::BuildLeftOutCombiner:
-                        board_.Build<CombinerCell>(playerAction.cellPosition, Direction::kLeft);
-                        break;
-                    case PlayerActionType::Clear:
-                        board_.Remove(playerAction.cellPosition);
-                        break;
+                PlayerAction playerAction{};
+                {
+                    PDOGS_PROFILE_SCOPE(ProfilePhase::kGetNextAction);
+                    playerAction = player_->GetNextAction(*this);
+                }
+                if (ApplyPlayerAction(playerAction)) {
+                    lastBoardChangeTime_ = elapsedTime_;
                 }
             }
 
@@ -686,12 +1827,49 @@ namespace Feis {
         }
 
     private:
+        bool ApplyPlayerAction(const PlayerAction &playerAction) {
+            switch (playerAction.type) {
+                case PlayerActionType::None:
+                    return false;
+                case PlayerActionType::BuildLeftOutMiningMachine:
+                    return board_.Build<MiningMachineCell>(playerAction.cellPosition, Direction::kLeft);
+                case PlayerActionType::BuildTopOutMiningMachine:
+                    return board_.Build<MiningMachineCell>(playerAction.cellPosition, Direction::kTop);
+                case PlayerActionType::BuildRightOutMiningMachine:
+                    return board_.Build<MiningMachineCell>(playerAction.cellPosition, Direction::kRight);
+                case PlayerActionType::BuildBottomOutMiningMachine:
+                    return board_.Build<MiningMachineCell>(playerAction.cellPosition, Direction::kBottom);
+                case PlayerActionType::BuildLeftToRightConveyor:
+                    return board_.Build<ConveyorCell>(playerAction.cellPosition, Direction::kRight);
+                case PlayerActionType::BuildTopToBottomConveyor:
+                    return board_.Build<ConveyorCell>(playerAction.cellPosition, Direction::kBottom);
+                case PlayerActionType::BuildRightToLeftConveyor:
+                    return board_.Build<ConveyorCell>(playerAction.cellPosition, Direction::kLeft);
+                case PlayerActionType::BuildBottomToTopConveyor:
+                    return board_.Build<ConveyorCell>(playerAction.cellPosition, Direction::kTop);
+                case PlayerActionType::BuildTopOutCombiner:
+                    return board_.Build<CombinerCell>(playerAction.cellPosition, Direction::kTop);
+                case PlayerActionType::BuildRightOutCombiner:
+                    return board_.Build<CombinerCell>(playerAction.cellPosition, Direction::kRight);
+                case PlayerActionType::BuildBottomOutCombiner:
+                    return board_.Build<CombinerCell>(playerAction.cellPosition, Direction::kBottom);
+                case PlayerActionType::BuildLeftOutCombiner:
+                    return board_.Build<CombinerCell>(playerAction.cellPosition, Direction::kLeft);
+                case PlayerActionType::Clear:
+                    return board_.Remove(playerAction.cellPosition);
+            }
+            return false;
+        }
+
         int elapsedTime_;
+        int lastBoardChangeTime_;
         int endTime_;
         IGamePlayer *player_;
         GameBoard board_;
         int commonDivisor_;
         int scores_;
+        long long deliveredProducts_ = 0;
+        long long scoredProducts_ = 0;
     };
 
 
@@ -0,0 +1,146 @@
+#include "PDOGSEnv.h"
+
+#include <algorithm>
+#include <new>
+#include <vector>
+#include "BatchEnvironment.hpp"
+
+namespace {
+    using Feis::BatchEnvironment;
+    using Feis::GameManagerConfig;
+
+    static_assert(PDOGS_BOARD_WIDTH == GameManagerConfig::kBoardWidth &&
+                  PDOGS_BOARD_HEIGHT == GameManagerConfig::kBoardHeight);
+
+    constexpr int kPlaneSize = PDOGS_BOARD_WIDTH * PDOGS_BOARD_HEIGHT;
+
+    std::int32_t *GetPlane(std::int32_t *observation, const int channel) {
+        return observation + PDOGS_OBSERVATION_HEADER_SIZE + channel * kPlaneSize;
+    }
+} // namespace
+
+struct PdogsEnvBatch {
+    explicit PdogsEnvBatch(const int count) : environment(count), actions(count), lastScores(count) {}
+
+    // The background never changes after a reset, so its plane is only written then.
+    void WriteBackground(const int game) {
+        if (observations == nullptr) {
+            return;
+        }
+        std::int32_t *numbers = GetPlane(GetObservation(game), PDOGS_CHANNEL_NUMBER);
+        for (int row = 0; row < PDOGS_BOARD_HEIGHT; ++row) {
+            for (int col = 0; col < PDOGS_BOARD_WIDTH; ++col) {
+                numbers[row * PDOGS_BOARD_WIDTH + col] = environment.GetNumber(game, {row, col});
+            }
+        }
+    }
+
+    // Writes the observations of games [begin, end) that changed since they were last written, or all of them when
+    // forced; games that are over keep the observation of their last tick.
+    void WriteObservations(const int begin, const int end, const bool force) {
+        if (observations == nullptr) {
+            return;
+        }
+        int changedBegin = end;
+        int changedEnd = begin;
+        for (int game = begin; game < end; ++game) {
+            std::int32_t *observation = GetObservation(game);
+            if (force || observation[PDOGS_HEADER_ELAPSED_TIME] != environment.GetElapsedTime(game)) {
+                changedBegin = std::min(changedBegin, game);
+                changedEnd = game + 1;
+                observation[PDOGS_HEADER_ELAPSED_TIME] = environment.GetElapsedTime(game);
+                observation[PDOGS_HEADER_SCORES] = environment.GetScores(game);
+                observation[PDOGS_HEADER_COMMON_DIVISOR] = environment.GetCommonDivisor(game);
+                observation[PDOGS_HEADER_GAME_OVER] = environment.IsGameOver(game) ? 1 : 0;
+            }
+        }
+
+        // Rewriting a finished game in the middle of the range is harmless: nothing in it moves any more.
+        environment.ForEachCellSummary(
+                changedBegin, changedEnd,
+                [this](const int game, const int i, const Feis::CellKind kind, const int direction,
+                       const int heldProducts, const int firstProduct, const int secondProduct) {
+                    std::int32_t *observation = GetObservation(game);
+                    GetPlane(observation, PDOGS_CHANNEL_KIND)[i] = static_cast<std::int32_t>(kind);
+                    GetPlane(observation, PDOGS_CHANNEL_DIRECTION)[i] = direction;
+                    GetPlane(observation, PDOGS_CHANNEL_HELD_PRODUCTS)[i] = heldProducts;
+                    GetPlane(observation, PDOGS_CHANNEL_FIRST_PRODUCT)[i] = firstProduct;
+                    GetPlane(observation, PDOGS_CHANNEL_SECOND_PRODUCT)[i] = secondProduct;
+                });
+    }
+
+    std::int32_t *GetObservation(const int game) const {
+        return observations + static_cast<std::size_t>(game) * PDOGS_OBSERVATION_SIZE;
+    }
+
+    BatchEnvironment environment;
+    std::vector<Feis::PlayerAction> actions;
+    std::vector<int> lastScores;
+    std::int32_t *observations = nullptr;
+};
+
+extern "C" {
+PdogsEnvBatch *pdogs_create(const int32_t count, const uint32_t *seeds, const int32_t *divisors,
+                            int32_t *observations) {
+    if (count <= 0 || !std::all_of(divisors, divisors + count, [](const int32_t divisor) { return divisor > 0; })) {
+        return nullptr;
+    }
+    auto *batch = new (std::nothrow) PdogsEnvBatch(count);
+    if (batch == nullptr) {
+        return nullptr;
+    }
+    for (int game = 0; game < count; ++game) {
+        batch->environment.Reset(game, divisors[game], seeds[game]);
+    }
+    pdogs_set_observations(batch, observations);
+    return batch;
+}
+
+void pdogs_destroy(PdogsEnvBatch *batch) { delete batch; }
+
+int32_t pdogs_get_count(const PdogsEnvBatch *batch) { return batch->environment.GetGameCount(); }
+
+void pdogs_set_observations(PdogsEnvBatch *batch, int32_t *observations) {
+    batch->observations = observations;
+    for (int game = 0; game < batch->environment.GetGameCount(); ++game) {
+        batch->WriteBackground(game);
+    }
+    batch->WriteObservations(0, batch->environment.GetGameCount(), true);
+}
+
+void pdogs_reset(PdogsEnvBatch *batch, const int32_t index, const uint32_t seed, const int32_t divisor) {
+    if (index < 0 || index >= batch->environment.GetGameCount() || divisor <= 0) {
+        return;
+    }
+    batch->environment.Reset(index, divisor, seed);
+    batch->lastScores[index] = 0;
+    batch->WriteBackground(index);
+    batch->WriteObservations(index, index + 1, true);
+}
+
+void pdogs_step(PdogsEnvBatch *batch, const PdogsAction *actions, int32_t *rewards, uint8_t *dones) {
+    BatchEnvironment &environment = batch->environment;
+    const int count = environment.GetGameCount();
+    for (int game = 0; game < count; ++game) {
+        batch->actions[game] = {static_cast<Feis::PlayerActionType>(actions[game].type),
+                                {actions[game].row, actions[game].col}};
+    }
+
+    // Exactly one of any three consecutive ticks is one where a game takes an action.
+    for (int tick = 0; tick < 3; ++tick) {
+        environment.StepAll(batch->actions.data());
+    }
+
+    for (int game = 0; game < count; ++game) {
+        const int scores = environment.GetScores(game);
+        if (rewards != nullptr) {
+            rewards[game] = scores - batch->lastScores[game];
+        }
+        if (dones != nullptr) {
+            dones[game] = environment.IsGameOver(game) ? 1 : 0;
+        }
+        batch->lastScores[game] = scores;
+    }
+    batch->WriteObservations(0, count, false);
+}
+}
@@ -0,0 +1,78 @@
+#ifndef PDOGS_ENV_H
+#define PDOGS_ENV_H
+#include <stdint.h>
+
+/* C interface to a batch of PDOGS games, for driving them from other languages. Build it as a shared library from
+ * PDOGSEnv.cpp (see compile.ps1). Every call works on the whole batch, so one crossing covers all of its games.
+ *
+ * A step plays one decision: three ticks, with each game's action applied on the tick its GameManager would ask
+ * for one. Observations are written straight into a buffer the caller owns, PDOGS_OBSERVATION_SIZE int32 values
+ * per game, laid out as PDOGS_OBSERVATION_HEADER_SIZE header values followed by PDOGS_CHANNEL_COUNT planes of
+ * PDOGS_BOARD_HEIGHT x PDOGS_BOARD_WIDTH cells, row-major. */
+
+#if defined(_WIN32)
+#define PDOGS_ENV_API __declspec(dllexport)
+#else
+#define PDOGS_ENV_API __attribute__((visibility("default")))
+#endif
+
+#define PDOGS_BOARD_WIDTH 62
+#define PDOGS_BOARD_HEIGHT 36
+
+/* Header values. */
+#define PDOGS_HEADER_ELAPSED_TIME 0
+#define PDOGS_HEADER_SCORES 1
+#define PDOGS_HEADER_COMMON_DIVISOR 2
+#define PDOGS_HEADER_GAME_OVER 3
+#define PDOGS_OBSERVATION_HEADER_SIZE 4
+
+/* Planes. Kinds are those of CellKind in CellState.hpp and directions those of Direction; the two product planes
+ * hold CellState::products[0] and [1]: a conveyor's front slots, a combiner's two slots, or a mining machine's
+ * cycle counter in the first. */
+#define PDOGS_CHANNEL_KIND 0
+#define PDOGS_CHANNEL_DIRECTION 1
+#define PDOGS_CHANNEL_NUMBER 2
+#define PDOGS_CHANNEL_HELD_PRODUCTS 3
+#define PDOGS_CHANNEL_FIRST_PRODUCT 4
+#define PDOGS_CHANNEL_SECOND_PRODUCT 5
+#define PDOGS_CHANNEL_COUNT 6
+
+#define PDOGS_OBSERVATION_SIZE \
+    (PDOGS_OBSERVATION_HEADER_SIZE + PDOGS_CHANNEL_COUNT * PDOGS_BOARD_HEIGHT * PDOGS_BOARD_WIDTH)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PdogsEnvBatch PdogsEnvBatch;
+
+/* type is a PlayerActionType value; anything out of range, or off the board, does nothing. */
+typedef struct PdogsAction {
+    int32_t type;
+    int32_t row;
+    int32_t col;
+} PdogsAction;
+
+/* Creates count games, game i on seeds[i] and divisors[i]. observations may be NULL and set later; otherwise it is
+ * filled right away. Returns NULL when count or a divisor is not positive, or when out of memory. */
+PDOGS_ENV_API PdogsEnvBatch *pdogs_create(int32_t count, const uint32_t *seeds, const int32_t *divisors,
+                                          int32_t *observations);
+
+PDOGS_ENV_API void pdogs_destroy(PdogsEnvBatch *batch);
+
+PDOGS_ENV_API int32_t pdogs_get_count(const PdogsEnvBatch *batch);
+
+/* Points the batch at a new buffer of count * PDOGS_OBSERVATION_SIZE values and fills it. NULL stops writing. */
+PDOGS_ENV_API void pdogs_set_observations(PdogsEnvBatch *batch, int32_t *observations);
+
+/* Starts game index over on a new seed and divisor; does nothing when index or divisor is out of range. */
+PDOGS_ENV_API void pdogs_reset(PdogsEnvBatch *batch, int32_t index, uint32_t seed, int32_t divisor);
+
+/* Plays one decision in every game that is not over yet, with actions[i] for game i. rewards (the scores gained)
+ * and dones may each be NULL; otherwise they get count values. */
+PDOGS_ENV_API void pdogs_step(PdogsEnvBatch *batch, const PdogsAction *actions, int32_t *rewards, uint8_t *dones);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
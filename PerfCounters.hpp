@@ -0,0 +1,127 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+#include <array>
+#include <atomic>
+#include <cstdint>
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Feis {
+    enum class PerfEvent : std::uint8_t { kCycles, kInstructions, kCacheMisses, kBranchMisses, kCount };
+
+    using PerfSample = std::array<std::uint64_t, static_cast<int>(PerfEvent::kCount)>;
+
+    inline const char *GetPerfEventName(const PerfEvent event) {
+        static constexpr const char *kNames[] = {"cycles", "instructions", "cache-misses", "branch-misses"};
+        return kNames[static_cast<int>(event)];
+    }
+
+    // Hardware counters for the calling thread, user space only, opened as one group so a single read() returns
+    // all of them. Elsewhere than Linux, or when the kernel refuses (perf_event_paranoid, containers, VMs without
+    // a PMU), IsAvailable() is false and Read() returns zeros. When the kernel has to share the PMU with other
+    // groups it only counts part of the time; Read() then scales the counts up by time enabled over time running,
+    // so they are estimates, and WasMultiplexed() turns true.
+    class PerfCounterGroup {
+    public:
+        PerfCounterGroup() {
+            fds_.fill(-1);
+            Open();
+        }
+
+        PerfCounterGroup(const PerfCounterGroup &) = delete;
+
+        PerfCounterGroup &operator=(const PerfCounterGroup &) = delete;
+
+        ~PerfCounterGroup() {
+#ifdef __linux__
+            for (const int fd: fds_) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+            }
+#endif
+        }
+
+        // One instance per thread, since the counters only follow the thread that opened them.
+        static PerfCounterGroup &ForCurrentThread() {
+            thread_local PerfCounterGroup group;
+            return group;
+        }
+
+        [[nodiscard]] bool IsAvailable() const { return fds_[0] >= 0; }
+
+        // Whether a Read() on any thread so far had to scale its counts.
+        [[nodiscard]] static bool WasMultiplexed() { return multiplexed_.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] PerfSample Read() const {
+            PerfSample sample{};
+#ifdef __linux__
+            if (!IsAvailable()) {
+                return sample;
+            }
+
+            struct {
+                std::uint64_t count;
+                std::uint64_t timeEnabled;
+                std::uint64_t timeRunning;
+                std::uint64_t values[static_cast<int>(PerfEvent::kCount)];
+            } buffer{};
+            if (read(fds_[0], &buffer, sizeof(buffer)) > 0) {
+                // The group is scheduled as a whole, so one ratio scales every counter.
+                const bool scaled = buffer.timeRunning != 0 && buffer.timeRunning < buffer.timeEnabled;
+                if (scaled) {
+                    multiplexed_.store(true, std::memory_order_relaxed);
+                }
+                for (std::uint64_t i = 0; i < buffer.count && i < sample.size(); ++i) {
+                    sample[i] = scaled ? static_cast<std::uint64_t>(static_cast<long double>(buffer.values[i]) *
+                                                                    buffer.timeEnabled / buffer.timeRunning)
+                                       : buffer.values[i];
+                }
+            }
+#endif
+            return sample;
+        }
+
+    private:
+        void Open() {
+#ifdef __linux__
+            static constexpr std::uint64_t kConfigs[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                         PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+            for (std::size_t i = 0; i < fds_.size(); ++i) {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = kConfigs[i];
+                attr.disabled = i == 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format =
+                        PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds_[0], 0));
+                if (fds_[i] < 0) {
+                    // A partial group would make every read ambiguous, so it is all or nothing.
+                    for (std::size_t j = 0; j < i; ++j) {
+                        close(fds_[j]);
+                    }
+                    fds_.fill(-1);
+                    return;
+                }
+            }
+            ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+        }
+
+        std::array<int, static_cast<int>(PerfEvent::kCount)> fds_;
+        static inline std::atomic<bool> multiplexed_{false};
+    };
+} // namespace Feis
+#endif
@@ -0,0 +1,41 @@
+#ifndef PROFILE_PHASE_HPP
+#define PROFILE_PHASE_HPP
+#include <cstdint>
+
+namespace Feis {
+    enum class ProfilePhase : std::uint8_t {
+        kGameUpdate,
+        kGetNextAction,
+        kUpdatePassOne,
+        kUpdatePassTwo,
+        kRender,
+        kRenderPassOne,
+        kRenderPassTwo,
+        kRenderPassThree,
+        kCount
+    };
+
+    enum class ProfileCounter : std::uint8_t {
+        kConveyorPassOne,
+        kConveyorPassTwo,
+        kCombinerPassOne,
+        kMiningMachinePassOne,
+        kOtherPassOne,
+        kOtherPassTwo,
+        kCount
+    };
+
+    inline const char *GetProfilePhaseName(const ProfilePhase phase) {
+        static constexpr const char *kNames[] = {"GameManager::Update", "GetNextAction",    "UpdatePassOne",
+                                                 "UpdatePassTwo",       "Render",           "RenderPassOne",
+                                                 "RenderPassTwo",       "RenderPassThree"};
+        return kNames[static_cast<int>(phase)];
+    }
+
+    inline const char *GetProfileCounterName(const ProfileCounter counter) {
+        static constexpr const char *kNames[] = {"conveyor pass one", "conveyor pass two",     "combiner pass one",
+                                                 "mining machine pass one", "other pass one", "other pass two"};
+        return kNames[static_cast<int>(counter)];
+    }
+} // namespace Feis
+#endif
@@ -0,0 +1,230 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+#include <cstddef>
+#include <cstdint>
+#include "ProfilePhase.hpp"
+
+// Define PDOGS_ENABLE_PROFILING before the first include of PDOGS.hpp to time the phases of a tick and count cell
+// updates per cell kind. Without it PDOGS_PROFILE_SCOPE and PDOGS_PROFILE_COUNT expand to nothing.
+// Additionally define PDOGS_ENABLE_PERF_COUNTERS to have every scope read the hardware counters of PerfCounters.hpp
+// (Linux only; each scope then costs two read() calls, so timings include that overhead). PDOGS_ENABLE_TRACING
+// turns profiling on as well and lets TraceRecorder.hpp export every scope as a Chrome trace span.
+
+#if defined(PDOGS_ENABLE_TRACING) && !defined(PDOGS_ENABLE_PROFILING)
+#define PDOGS_ENABLE_PROFILING
+#endif
+
+#ifdef PDOGS_ENABLE_PROFILING
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+#include "PerfCounters.hpp"
+#ifdef PDOGS_ENABLE_TRACING
+#include "TraceRecorder.hpp"
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+namespace Feis {
+    // Time stamp counter cycles where the CPU has one, steady_clock nanoseconds elsewhere.
+    inline std::uint64_t ReadProfileClock() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    // Keeps the most recent kSampleCapacity durations of every phase for percentiles, plus running totals.
+    // Each phase must only ever be timed from one thread; the counters are plain and meant for the sim thread.
+    class Profiler {
+    public:
+        static constexpr std::size_t kSampleCapacity = 1 << 14;
+
+        struct PhaseSummary {
+            std::uint64_t count;
+            std::uint64_t total;
+            std::uint64_t p50;
+            std::uint64_t p90;
+            std::uint64_t p99;
+            std::uint64_t max;
+        };
+
+        static Profiler &Instance() {
+            static Profiler profiler;
+            return profiler;
+        }
+
+        void Record(const ProfilePhase phase, const std::uint64_t duration, const PerfSample &perfDelta = {}) {
+            Phase &entry = phases_[static_cast<int>(phase)];
+            entry.samples[entry.count % kSampleCapacity] = duration;
+            entry.count += 1;
+            entry.total += duration;
+            entry.max = std::max(entry.max, duration);
+            for (std::size_t i = 0; i < perfDelta.size(); ++i) {
+                entry.perfTotals[i] += perfDelta[i];
+            }
+        }
+
+        [[nodiscard]] const PerfSample &GetPerfTotals(const ProfilePhase phase) const {
+            return phases_[static_cast<int>(phase)].perfTotals;
+        }
+
+        void Count(const ProfileCounter counter) { counters_[static_cast<int>(counter)] += 1; }
+
+        [[nodiscard]] std::uint64_t GetCount(const ProfileCounter counter) const {
+            return counters_[static_cast<int>(counter)];
+        }
+
+        // Percentiles cover the retained samples only; count, total and max cover every call.
+        [[nodiscard]] PhaseSummary Summarize(const ProfilePhase phase) const {
+            const Phase &entry = phases_[static_cast<int>(phase)];
+            std::vector<std::uint64_t> samples(entry.samples.begin(),
+                                               entry.samples.begin() + std::min<std::uint64_t>(entry.count,
+                                                                                               kSampleCapacity));
+            std::sort(samples.begin(), samples.end());
+
+            const auto percentile = [&samples](const double fraction) -> std::uint64_t {
+                return samples.empty() ? 0 : samples[static_cast<std::size_t>(fraction * (samples.size() - 1))];
+            };
+            return {entry.count, entry.total, percentile(0.5), percentile(0.9), percentile(0.99), entry.max};
+        }
+
+        void Reset() {
+            for (auto &entry: phases_) {
+                entry.count = entry.total = entry.max = 0;
+                entry.perfTotals.fill(0);
+            }
+            counters_.fill(0);
+        }
+
+        void PrintSummary(std::ostream &out) const {
+            out << "phase                    calls        mean         p50         p90         p99         max\n";
+            for (int i = 0; i < static_cast<int>(ProfilePhase::kCount); ++i) {
+                const auto phase = static_cast<ProfilePhase>(i);
+                const PhaseSummary summary = Summarize(phase);
+                if (summary.count == 0) {
+                    continue;
+                }
+                out << std::left << std::setw(20) << GetProfilePhaseName(phase) << std::right << std::setw(10)
+                    << summary.count << std::setw(12) << summary.total / summary.count << std::setw(12)
+                    << summary.p50 << std::setw(12) << summary.p90 << std::setw(12) << summary.p99 << std::setw(12)
+                    << summary.max << "\n";
+            }
+#ifdef PDOGS_ENABLE_PERF_COUNTERS
+            PrintPerfSummary(out);
+#endif
+            for (int i = 0; i < static_cast<int>(ProfileCounter::kCount); ++i) {
+                const auto counter = static_cast<ProfileCounter>(i);
+                out << std::left << std::setw(24) << GetProfileCounterName(counter) << std::right << std::setw(12)
+                    << GetCount(counter) << " updates\n";
+            }
+        }
+
+        // Hardware counter means per call; for GameManager::Update that is per tick.
+        void PrintPerfSummary(std::ostream &out) const {
+            if (!PerfCounterGroup::ForCurrentThread().IsAvailable()) {
+                out << "hardware counters unavailable on this thread\n";
+                return;
+            }
+            if (PerfCounterGroup::WasMultiplexed()) {
+                out << "hardware counters were multiplexed; counts are scaled estimates\n";
+            }
+            out << "phase                    cycles  instructions     IPC  cache-misses  branch-misses\n";
+            for (int i = 0; i < static_cast<int>(ProfilePhase::kCount); ++i) {
+                const auto phase = static_cast<ProfilePhase>(i);
+                const Phase &entry = phases_[i];
+                if (entry.count == 0) {
+                    continue;
+                }
+                const auto mean = [&entry](const PerfEvent event) {
+                    return entry.perfTotals[static_cast<int>(event)] / entry.count;
+                };
+                const auto cycles = entry.perfTotals[static_cast<int>(PerfEvent::kCycles)];
+                out << std::left << std::setw(20) << GetProfilePhaseName(phase) << std::right << std::setw(11)
+                    << mean(PerfEvent::kCycles) << std::setw(14) << mean(PerfEvent::kInstructions) << std::setw(8)
+                    << std::fixed << std::setprecision(2)
+                    << (cycles ? static_cast<double>(entry.perfTotals[static_cast<int>(PerfEvent::kInstructions)]) /
+                                         cycles
+                               : 0.0)
+                    << std::setw(14) << mean(PerfEvent::kCacheMisses) << std::setw(15)
+                    << mean(PerfEvent::kBranchMisses) << "\n";
+            }
+        }
+
+    private:
+        struct Phase {
+            std::vector<std::uint64_t> samples = std::vector<std::uint64_t>(kSampleCapacity);
+            std::uint64_t count = 0;
+            std::uint64_t total = 0;
+            std::uint64_t max = 0;
+            PerfSample perfTotals{};
+        };
+
+        Profiler() = default;
+
+        std::array<Phase, static_cast<int>(ProfilePhase::kCount)> phases_;
+        std::array<std::uint64_t, static_cast<int>(ProfileCounter::kCount)> counters_{};
+    };
+
+    class ProfileScope {
+    public:
+        explicit ProfileScope(const ProfilePhase phase) : phase_(phase) {
+#ifdef PDOGS_ENABLE_TRACING
+            traceBegin_ = TraceRecorder::Instance().IsEnabled() ? TraceRecorder::Now() : 0;
+#endif
+#ifdef PDOGS_ENABLE_PERF_COUNTERS
+            perfStart_ = PerfCounterGroup::ForCurrentThread().Read();
+#endif
+            start_ = ReadProfileClock();
+        }
+
+        ProfileScope(const ProfileScope &) = delete;
+
+        ProfileScope &operator=(const ProfileScope &) = delete;
+
+        ~ProfileScope() {
+            const std::uint64_t duration = ReadProfileClock() - start_;
+#ifdef PDOGS_ENABLE_PERF_COUNTERS
+            PerfSample delta = PerfCounterGroup::ForCurrentThread().Read();
+            for (std::size_t i = 0; i < delta.size(); ++i) {
+                delta[i] -= perfStart_[i];
+            }
+            Profiler::Instance().Record(phase_, duration, delta);
+#else
+            Profiler::Instance().Record(phase_, duration);
+#endif
+#ifdef PDOGS_ENABLE_TRACING
+            if (traceBegin_ != 0) {
+                TraceRecorder::Instance().Record(phase_, traceBegin_, TraceRecorder::Now());
+            }
+#endif
+        }
+
+    private:
+        ProfilePhase phase_;
+#ifdef PDOGS_ENABLE_TRACING
+        std::uint64_t traceBegin_;
+#endif
+#ifdef PDOGS_ENABLE_PERF_COUNTERS
+        PerfSample perfStart_;
+#endif
+        std::uint64_t start_;
+    };
+} // namespace Feis
+
+#define PDOGS_PROFILE_CONCAT_INNER(a, b) a##b
+#define PDOGS_PROFILE_CONCAT(a, b) PDOGS_PROFILE_CONCAT_INNER(a, b)
+#define PDOGS_PROFILE_SCOPE(phase) const ::Feis::ProfileScope PDOGS_PROFILE_CONCAT(profileScope, __LINE__)(phase)
+#define PDOGS_PROFILE_COUNT(counter) ::Feis::Profiler::Instance().Count(counter)
+#else
+#define PDOGS_PROFILE_SCOPE(phase) static_cast<void>(0)
+#define PDOGS_PROFILE_COUNT(counter) static_cast<void>(0)
+#endif
+#endif
@@ -0,0 +1,194 @@
+#ifndef REPLAY_ENGINE_HPP
+#define REPLAY_ENGINE_HPP
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "CellState.hpp"
+#include "DatasetRecorder.hpp"
+#include "PDOGS.hpp"
+#include "ReplayFile.hpp"
+
+namespace Feis {
+    // Re-executes a replay headlessly and keeps a checkpoint every checkpointInterval ticks, so any tick is reached
+    // by restoring the checkpoint at or before it and simulating fewer than checkpointInterval ticks. Restoring
+    // only rebuilds the cells that differ from the board as it stands, which is most of the cost of a seek.
+    //
+    // Checkpoint: varint elapsed time, board tick, last board change time, scores, delivered and scored product
+    // counts, then a varint count of non-empty cells and per cell a varint gap from the previous cell index and the
+    // cell as Dataset::PutCell writes it. A busy board takes about 15 KB.
+    class ReplayEngine {
+    public:
+        explicit ReplayEngine(const int checkpointInterval = 100) :
+            checkpointInterval_(checkpointInterval), player_(&actions_), targets_(Dataset::kCellCount) {}
+
+        // Plays the replay from its seed to its last tick, taking checkpoints on the way, and returns whether it
+        // ended exactly as recorded. The game is left at the last tick either way, except that a damaged header is
+        // rejected before anything runs and leaves the engine as it was.
+        bool Load(const ReplayView &replay) {
+            const ReplayHeader &header = replay.GetHeader();
+            if (!Replay::IsPlayable(header))
+                return false;
+
+            actions_.clear();
+            ReplayView::Cursor cursor = replay.GetCursor();
+            ReplayAction action{};
+            while (cursor.Next(action)) {
+                actions_.push_back(action);
+            }
+            endTime_ = header.elapsedTime;
+
+            gameManager_ = std::make_unique<GameManager>(&player_, header.commonDivisor, header.seed);
+            player_.Seek(0);
+            player_.StartChecksum();
+            checkpointData_.clear();
+            checkpointOffsets_.clear();
+            TakeCheckpoint();
+            while (gameManager_->GetElapsedTime() < endTime_ && !gameManager_->IsGameOver()) {
+                gameManager_->Update();
+                if (gameManager_->GetElapsedTime() % checkpointInterval_ == 0) {
+                    TakeCheckpoint();
+                }
+            }
+            const std::uint64_t checksum = player_.StopChecksum();
+
+            return header.engineVersion == GameManagerConfig::kEngineVersion && cursor.IsAtEnd() &&
+                   gameManager_->GetElapsedTime() == endTime_ && gameManager_->GetScores() == header.scores &&
+                   checksum == header.scoreChecksum;
+        }
+
+        // After Load: brings the game to elapsedTime, clamped to the replay. Moving forward by less than a checkpoint
+        // interval just simulates on. Returns false if the checkpoint could not be applied to the board, which leaves
+        // the game half restored; only Load brings it back.
+        bool Seek(int elapsedTime) {
+            elapsedTime = std::clamp(elapsedTime, 0, endTime_);
+            const int checkpoint = std::min(elapsedTime / checkpointInterval_,
+                                            static_cast<int>(checkpointOffsets_.size()) - 1);
+            const int current = gameManager_->GetElapsedTime();
+            if ((elapsedTime < current || current < checkpoint * checkpointInterval_) &&
+                !RestoreCheckpoint(checkpoint)) {
+                return false;
+            }
+            while (gameManager_->GetElapsedTime() < elapsedTime) {
+                gameManager_->Update();
+            }
+            return true;
+        }
+
+        [[nodiscard]] const GameManager &GetGameManager() const { return *gameManager_; }
+
+        [[nodiscard]] int GetEndTime() const { return endTime_; }
+
+        [[nodiscard]] std::size_t GetCheckpointCount() const { return checkpointOffsets_.size(); }
+
+        [[nodiscard]] std::size_t GetCheckpointBytes() const { return checkpointData_.size(); }
+
+    private:
+        // Plays the actions back and, while a replay is first run, computes its score checksum again.
+        class Player final : public IGamePlayer {
+        public:
+            explicit Player(const std::vector<ReplayAction> *actions) : scripted_(actions) {}
+
+            PlayerAction GetNextAction(const IGameInfo &info) override {
+                if (checksumming_) {
+                    checksum_.Add(Replay::GetChecksumValue(info));
+                }
+                return scripted_.GetNextAction(info);
+            }
+
+            void Seek(const int elapsedTime) { scripted_.Seek(elapsedTime); }
+
+            void StartChecksum() {
+                checksum_ = StateHasher();
+                checksumming_ = true;
+            }
+
+            std::uint64_t StopChecksum() {
+                checksumming_ = false;
+                return checksum_.GetHash();
+            }
+
+        private:
+            ScriptedGamePlayer scripted_;
+            StateHasher checksum_;
+            bool checksumming_ = false;
+        };
+
+        void TakeCheckpoint() {
+            const GameManager &gameManager = *gameManager_;
+            checkpointOffsets_.push_back(checkpointData_.size());
+            Dataset::PutVarint(checkpointData_, static_cast<std::uint32_t>(gameManager.GetElapsedTime()));
+            Dataset::PutVarint(checkpointData_, static_cast<std::uint64_t>(gameManager.GetBoard().GetTick()));
+            Dataset::PutVarint(checkpointData_, static_cast<std::uint32_t>(gameManager.GetLastBoardChangeTime()));
+            Dataset::PutVarint(checkpointData_, static_cast<std::uint32_t>(gameManager.GetScores()));
+            Dataset::PutVarint(checkpointData_, static_cast<std::uint64_t>(gameManager.GetDeliveredProductCount()));
+            Dataset::PutVarint(checkpointData_, static_cast<std::uint64_t>(gameManager.GetScoredProductCount()));
+
+            cells_.clear();
+            for (int index = 0; index < Dataset::kCellCount; ++index) {
+                const CellState state = CaptureCellState(gameManager, {index / GameManagerConfig::kBoardWidth,
+                                                                       index % GameManagerConfig::kBoardWidth});
+                if (state.kind != CellKind::kEmpty) {
+                    cells_.emplace_back(index, state);
+                }
+            }
+            Dataset::PutVarint(checkpointData_, cells_.size());
+            int previous = -1;
+            for (const auto &[index, state]: cells_) {
+                Dataset::PutVarint(checkpointData_, static_cast<std::uint64_t>(index - previous - 1));
+                Dataset::PutCell(checkpointData_, index, state);
+                previous = index;
+            }
+        }
+
+        bool RestoreCheckpoint(const int checkpoint) {
+            const std::uint8_t *in = checkpointData_.data() + checkpointOffsets_[checkpoint];
+            const auto elapsedTime = static_cast<int>(Dataset::GetVarint(in));
+            const auto tick = static_cast<long long>(Dataset::GetVarint(in));
+            const auto lastBoardChangeTime = static_cast<int>(Dataset::GetVarint(in));
+            const auto scores = static_cast<int>(Dataset::GetVarint(in));
+            const auto deliveredProducts = static_cast<long long>(Dataset::GetVarint(in));
+            const auto scoredProducts = static_cast<long long>(Dataset::GetVarint(in));
+
+            for (int index = 0; index < Dataset::kCellCount; ++index) {
+                targets_[index] = {CellKind::kEmpty, Direction::kTop,
+                                   {index / GameManagerConfig::kBoardWidth, index % GameManagerConfig::kBoardWidth},
+                                   {}};
+            }
+            const auto count = Dataset::GetVarint(in);
+            for (std::uint64_t k = 0, index = ~std::uint64_t{0}; k < count; ++k) {
+                index += Dataset::GetVarint(in) + 1;
+                targets_[index] = Dataset::GetCell(in, static_cast<int>(index));
+            }
+
+            cells_.clear();
+            for (int index = 0; index < Dataset::kCellCount; ++index) {
+                const CellPosition position{index / GameManagerConfig::kBoardWidth,
+                                            index % GameManagerConfig::kBoardWidth};
+                if (CaptureCellState(*gameManager_, position) != targets_[index]) {
+                    cells_.emplace_back(index, targets_[index]);
+                }
+            }
+            // The tick goes back first, so any idle mining machine ApplyCellStates rebuilds is idle from then.
+            GameBoard &board = gameManager_->GetBoard();
+            board.SetTick(tick);
+            if (!ApplyCellStates(board, gameManager_.get(), cells_))
+                return false;
+
+            gameManager_->SetProgress(elapsedTime, lastBoardChangeTime, scores, deliveredProducts, scoredProducts);
+            player_.Seek(elapsedTime);
+            return true;
+        }
+
+        int checkpointInterval_;
+        std::vector<ReplayAction> actions_;
+        Player player_;
+        std::unique_ptr<GameManager> gameManager_;
+        int endTime_ = 0;
+        std::vector<std::uint8_t> checkpointData_;
+        std::vector<std::size_t> checkpointOffsets_;
+        std::vector<CellState> targets_;
+        std::vector<CellStateRecord> cells_;
+    };
+} // namespace Feis
+#endif
@@ -0,0 +1,399 @@
+#ifndef REPLAY_FILE_HPP
+#define REPLAY_FILE_HPP
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "CellState.hpp"
+#include "DatasetRecorder.hpp"
+#include "PDOGS.hpp"
+
+namespace Feis {
+    // On-disk layout, all integers in host byte order like DatasetRecorder:
+    //
+    // A replay is a ReplayHeader followed by actionBytes bytes of actions, zero-padded to a multiple of
+    // Replay::kAlignment. Replays may be concatenated into one archive file; each one starts aligned, so a mapped
+    // archive is read in place by stepping from header to header with ReplayView::GetSize.
+    // Action: varint ticks since the previous action (since tick 0 for the first), type byte, zigzag varint row and
+    // col. Decisions of PlayerActionType::None are not stored, so a typical action takes 4 bytes.
+    // scoreChecksum is a StateHasher over elapsedTime << 32 | scores at every decision up to elapsedTime, which
+    // pins down when each point was scored and not just the total.
+    struct ReplayHeader {
+        static constexpr std::uint32_t kMagic = 0x50524450; // "PDRP"
+        static constexpr std::uint32_t kVersion = 1;
+
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t engineVersion;
+        std::uint32_t seed;
+        std::int32_t commonDivisor;
+        std::int32_t elapsedTime;
+        std::int32_t scores;
+        std::uint32_t actionCount;
+        std::uint32_t actionBytes;
+        std::uint32_t reserved;
+        std::uint64_t scoreChecksum;
+    };
+
+    static_assert(sizeof(ReplayHeader) == 48, "ReplayHeader is read in place and must not change size");
+
+    struct ReplayAction {
+        int elapsedTime;
+        PlayerAction action;
+    };
+
+    namespace Replay {
+        constexpr std::size_t kAlignment = 8;
+
+        inline std::size_t GetPaddedSize(const std::size_t size) {
+            return (size + kAlignment - 1) / kAlignment * kAlignment;
+        }
+
+        // The header is not covered by any checksum, so a damaged one is checked for a level a GameManager can
+        // actually play before any game is started from it.
+        inline bool IsPlayable(const ReplayHeader &header) {
+            return header.commonDivisor > 0 && header.elapsedTime >= 0 &&
+                   header.elapsedTime <= static_cast<int>(GameManagerConfig::kEndTime);
+        }
+
+        inline std::uint64_t GetChecksumValue(const IGameInfo &info) {
+            return static_cast<std::uint64_t>(info.GetElapsedTime()) << 32 |
+                   static_cast<std::uint32_t>(info.GetScores());
+        }
+
+        inline bool WriteFile(const std::string &filename, const std::vector<std::uint8_t> &replay) {
+            std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char *>(replay.data()), static_cast<std::streamsize>(replay.size()));
+            return static_cast<bool>(out);
+        }
+
+        // Read-only view of a whole file, mapped rather than read so that an archive is only paged in where it
+        // is actually looked at.
+        class MappedFile {
+        public:
+            MappedFile() = default;
+
+            MappedFile(const MappedFile &) = delete;
+
+            MappedFile &operator=(const MappedFile &) = delete;
+
+            ~MappedFile() { Close(); }
+
+            bool Open(const std::string &filename) {
+                Close();
+#if defined(_WIN32)
+                file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+                LARGE_INTEGER size{};
+                if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+                    Close();
+                    return false;
+                }
+                mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping_ != nullptr) {
+                    data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+                }
+                size_ = static_cast<std::size_t>(size.QuadPart);
+#else
+                const int fd = open(filename.c_str(), O_RDONLY);
+                if (fd < 0)
+                    return false;
+                struct stat status{};
+                if (fstat(fd, &status) == 0 && status.st_size > 0) {
+                    size_ = static_cast<std::size_t>(status.st_size);
+                    void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                    data_ = data == MAP_FAILED ? nullptr : data;
+                }
+                close(fd);
+#endif
+                if (data_ == nullptr) {
+                    Close();
+                    return false;
+                }
+                return true;
+            }
+
+            void Close() {
+#if defined(_WIN32)
+                if (data_ != nullptr) {
+                    UnmapViewOfFile(data_);
+                }
+                if (mapping_ != nullptr) {
+                    CloseHandle(mapping_);
+                    mapping_ = nullptr;
+                }
+                if (file_ != INVALID_HANDLE_VALUE) {
+                    CloseHandle(file_);
+                    file_ = INVALID_HANDLE_VALUE;
+                }
+#else
+                if (data_ != nullptr) {
+                    munmap(data_, size_);
+                }
+#endif
+                data_ = nullptr;
+                size_ = 0;
+            }
+
+            [[nodiscard]] const std::uint8_t *GetData() const { return static_cast<const std::uint8_t *>(data_); }
+
+            [[nodiscard]] std::size_t GetSize() const { return size_; }
+
+        private:
+            void *data_ = nullptr;
+            std::size_t size_ = 0;
+#if defined(_WIN32)
+            HANDLE file_ = INVALID_HANDLE_VALUE;
+            HANDLE mapping_ = nullptr;
+#endif
+        };
+    } // namespace Replay
+
+    // Wraps a player and records every action it takes, with the tick it was taken at. Save may be called between
+    // any two updates; the replay then ends at that tick.
+    class ReplayRecorder final : public IGamePlayer {
+    public:
+        ReplayRecorder(IGamePlayer *player, const int commonDivisor, const std::uint32_t seed) :
+            player_(player), commonDivisor_(commonDivisor), seed_(seed) {}
+
+        PlayerAction GetNextAction(const IGameInfo &info) override {
+            const PlayerAction action = player_->GetNextAction(info);
+            checksum_.Add(Replay::GetChecksumValue(info));
+            if (action.type != PlayerActionType::None) {
+                Dataset::PutVarint(body_, static_cast<std::uint32_t>(info.GetElapsedTime() - lastActionTime_));
+                body_.push_back(static_cast<std::uint8_t>(action.type));
+                Dataset::PutSigned(body_, action.cellPosition.row);
+                Dataset::PutSigned(body_, action.cellPosition.col);
+                lastActionTime_ = info.GetElapsedTime();
+                actionCount_ += 1;
+            }
+            return action;
+        }
+
+        // The replay of the game so far, header and padding included; info is the game being recorded.
+        [[nodiscard]] std::vector<std::uint8_t> Finish(const IGameInfo &info) const {
+            const ReplayHeader header{ReplayHeader::kMagic,
+                                      ReplayHeader::kVersion,
+                                      GameManagerConfig::kEngineVersion,
+                                      seed_,
+                                      commonDivisor_,
+                                      info.GetElapsedTime(),
+                                      info.GetScores(),
+                                      actionCount_,
+                                      static_cast<std::uint32_t>(body_.size()),
+                                      0,
+                                      checksum_.GetHash()};
+
+            std::vector<std::uint8_t> replay(Replay::GetPaddedSize(sizeof(header) + body_.size()));
+            std::memcpy(replay.data(), &header, sizeof(header));
+            std::copy(body_.begin(), body_.end(), replay.begin() + sizeof(header));
+            return replay;
+        }
+
+        bool Save(const std::string &filename, const IGameInfo &info) const {
+            return Replay::WriteFile(filename, Finish(info));
+        }
+
+    private:
+        IGamePlayer *player_;
+        int commonDivisor_;
+        std::uint32_t seed_;
+        int lastActionTime_ = 0;
+        std::uint32_t actionCount_ = 0;
+        StateHasher checksum_;
+        std::vector<std::uint8_t> body_;
+    };
+
+    // A replay read in place from memory it does not own, typically a Replay::MappedFile. The memory must be
+    // aligned to Replay::kAlignment and outlive the view.
+    class ReplayView {
+    public:
+        // Walks the actions in order. Decoding checks every read against the end of the replay, so a damaged file
+        // ends the walk early instead of reading past it.
+        class Cursor {
+        public:
+            // elapsedTime is the tick the first action's gap counts from.
+            Cursor(const std::uint8_t *begin, const std::uint8_t *end, const int elapsedTime = 0) :
+                in_(begin), end_(end), elapsedTime_(elapsedTime) {}
+
+            [[nodiscard]] int GetElapsedTime() const { return elapsedTime_; }
+
+            bool Next(ReplayAction &out) {
+                std::uint64_t gap = 0;
+                std::int64_t row = 0;
+                std::int64_t col = 0;
+                if (!GetVarint(gap) || in_ == end_) {
+                    return false;
+                }
+                const std::uint8_t type = *in_++;
+                if (!GetSigned(row) || !GetSigned(col)) {
+                    return false;
+                }
+                elapsedTime_ += static_cast<int>(gap);
+                out = {elapsedTime_,
+                       {static_cast<PlayerActionType>(type), {static_cast<int>(row), static_cast<int>(col)}}};
+                return true;
+            }
+
+            [[nodiscard]] bool IsAtEnd() const { return in_ == end_; }
+
+        private:
+            bool GetVarint(std::uint64_t &value) {
+                value = 0;
+                for (int shift = 0; shift < 35 && in_ != end_; shift += 7) {
+                    const std::uint8_t byte = *in_++;
+                    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                    if ((byte & 0x80) == 0)
+                        return true;
+                }
+                in_ = end_;
+                return false;
+            }
+
+            bool GetSigned(std::int64_t &value) {
+                std::uint64_t zigzag = 0;
+                if (!GetVarint(zigzag))
+                    return false;
+                value = static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+                return true;
+            }
+
+            const std::uint8_t *in_;
+            const std::uint8_t *end_;
+            int elapsedTime_;
+        };
+
+        // Checks the header against the size available; nothing else is decoded until a cursor walks the actions.
+        bool Open(const std::uint8_t *data, const std::size_t size) {
+            header_ = nullptr;
+            if (size < sizeof(ReplayHeader) || reinterpret_cast<std::uintptr_t>(data) % Replay::kAlignment != 0) {
+                return false;
+            }
+            const auto *header = reinterpret_cast<const ReplayHeader *>(data);
+            if (header->magic != ReplayHeader::kMagic || header->version != ReplayHeader::kVersion ||
+                header->actionBytes > size - sizeof(ReplayHeader)) {
+                return false;
+            }
+            header_ = header;
+            return true;
+        }
+
+        [[nodiscard]] bool IsOpen() const { return header_ != nullptr; }
+
+        [[nodiscard]] const ReplayHeader &GetHeader() const { return *header_; }
+
+        // Bytes taken in the file, padding included; the next replay of an archive starts this far on.
+        [[nodiscard]] std::size_t GetSize() const {
+            return Replay::GetPaddedSize(sizeof(ReplayHeader) + header_->actionBytes);
+        }
+
+        [[nodiscard]] Cursor GetCursor() const {
+            const auto *begin = reinterpret_cast<const std::uint8_t *>(header_ + 1);
+            return {begin, begin + header_->actionBytes};
+        }
+
+    private:
+        const ReplayHeader *header_ = nullptr;
+    };
+
+    // Plays a replay back: each action is returned at the tick it was recorded at and None otherwise, while the
+    // score checksum is computed again for Matches to compare.
+    class ReplayGamePlayer final : public IGamePlayer {
+    public:
+        explicit ReplayGamePlayer(const ReplayView &replay) : replay_(replay), cursor_(replay.GetCursor()) {
+            hasNext_ = cursor_.Next(next_);
+        }
+
+        PlayerAction GetNextAction(const IGameInfo &info) override {
+            checksum_.Add(Replay::GetChecksumValue(info));
+            if (!hasNext_ || next_.elapsedTime != info.GetElapsedTime()) {
+                return {PlayerActionType::None, {0, 0}};
+            }
+            const PlayerAction action = next_.action;
+            actionCount_ += 1;
+            hasNext_ = cursor_.Next(next_);
+            return action;
+        }
+
+        // Whether info, the game this player drove up to the replay's last tick, ended exactly as recorded.
+        [[nodiscard]] bool Matches(const IGameInfo &info) const {
+            const ReplayHeader &header = replay_.GetHeader();
+            return !hasNext_ && cursor_.IsAtEnd() && actionCount_ == header.actionCount &&
+                   info.GetElapsedTime() == header.elapsedTime && info.GetScores() == header.scores &&
+                   checksum_.GetHash() == header.scoreChecksum;
+        }
+
+    private:
+        const ReplayView &replay_;
+        ReplayView::Cursor cursor_;
+        ReplayAction next_{};
+        bool hasNext_ = false;
+        std::uint32_t actionCount_ = 0;
+        StateHasher checksum_;
+    };
+
+    // Returns a decoded list of actions, each at the tick it is stamped with. Seek repositions it for a game that
+    // was moved to another tick, as when restoring a checkpoint.
+    class ScriptedGamePlayer final : public IGamePlayer {
+    public:
+        explicit ScriptedGamePlayer(const std::vector<ReplayAction> *actions) : actions_(actions) {}
+
+        PlayerAction GetNextAction(const IGameInfo &info) override {
+            while (next_ < actions_->size() && (*actions_)[next_].elapsedTime < info.GetElapsedTime()) {
+                next_ += 1;
+            }
+            if (next_ == actions_->size() || (*actions_)[next_].elapsedTime != info.GetElapsedTime()) {
+                return {PlayerActionType::None, {0, 0}};
+            }
+            return (*actions_)[next_++].action;
+        }
+
+        // The next action returned is the first one stamped after elapsedTime.
+        void Seek(const int elapsedTime) {
+            next_ = static_cast<std::size_t>(
+                    std::upper_bound(actions_->begin(), actions_->end(), elapsedTime,
+                                     [](const int time, const ReplayAction &action) {
+                                         return time < action.elapsedTime;
+                                     }) -
+                    actions_->begin());
+        }
+
+    private:
+        const std::vector<ReplayAction> *actions_;
+        std::size_t next_ = 0;
+    };
+
+    // Re-runs a replay from its seed and reports whether it reproduces the recorded scores. Replays recorded by
+    // another engine version, or whose header is damaged, are rejected rather than re-run.
+    inline bool VerifyReplay(const ReplayView &replay) {
+        const ReplayHeader &header = replay.GetHeader();
+        if (header.engineVersion != GameManagerConfig::kEngineVersion || !Replay::IsPlayable(header)) {
+            return false;
+        }
+        ReplayGamePlayer player(replay);
+        GameManager gameManager(&player, header.commonDivisor, header.seed);
+        while (gameManager.GetElapsedTime() < header.elapsedTime && !gameManager.IsGameOver()) {
+            gameManager.Update();
+        }
+        return player.Matches(gameManager);
+    }
+} // namespace Feis
+#endif
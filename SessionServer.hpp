@@ -0,0 +1,653 @@
+#ifndef SESSION_SERVER_HPP
+#define SESSION_SERVER_HPP
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <SFML/Network.hpp>
+#include "CellState.hpp"
+#include "DatasetRecorder.hpp"
+#include "PDOGS.hpp"
+
+// Link with sfml-network (and sfml-system) when including this header.
+
+namespace Feis {
+    // Wire protocol of SessionServer. Every message is a uint32 byte count followed by that many bytes, all in host
+    // byte order; the first byte is the message type. A client may open any number of sessions on one connection
+    // and have steps of many sessions in flight at once; replies to different sessions may arrive in any order.
+    namespace SessionProtocol {
+        enum class MessageType : std::uint8_t {
+            // Client to server.
+            kOpen = 1,  // uint8 wantsDeltas, uint32 tag, uint32 seed, int32 commonDivisor
+            kStep = 2,  // uint8 actionType, uint32 session, int32 row, int32 col
+            kClose = 3, // uint32 session
+            // Server to client.
+            kOpened = 4, // uint32 tag, uint32 session (0 when the request was invalid)
+            kState = 5,  // uint8 gameOver, uint32 session, int32 elapsedTime, int32 scores, then for sessions
+                         // opened with wantsDeltas the cells that changed, encoded as in DatasetRecorder.hpp
+        };
+
+        constexpr std::uint32_t kMaxClientMessageSize = 64;
+
+        template<typename T>
+        void Put(std::vector<std::uint8_t> &out, const T value) {
+            const std::size_t size = out.size();
+            out.resize(size + sizeof(T));
+            std::memcpy(out.data() + size, &value, sizeof(T));
+        }
+
+        template<typename T>
+        T Get(const std::uint8_t *&in) {
+            T value;
+            std::memcpy(&value, in, sizeof(T));
+            in += sizeof(T);
+            return value;
+        }
+
+        // Starts a message in out; FinishMessage fills in its size once the body is written.
+        inline std::size_t BeginMessage(std::vector<std::uint8_t> &out, const MessageType type) {
+            const std::size_t begin = out.size();
+            Put<std::uint32_t>(out, 0);
+            Put(out, type);
+            return begin;
+        }
+
+        inline void FinishMessage(std::vector<std::uint8_t> &out, const std::size_t begin) {
+            const auto size = static_cast<std::uint32_t>(out.size() - begin - sizeof(std::uint32_t));
+            std::memcpy(out.data() + begin, &size, sizeof(size));
+        }
+
+        // Splits complete messages off the front of buffer; returns false when one is larger than maxSize.
+        template<typename TFunction>
+        bool ForEachMessage(std::vector<std::uint8_t> &buffer, const std::uint32_t maxSize, TFunction function) {
+            std::size_t offset = 0;
+            while (buffer.size() - offset >= sizeof(std::uint32_t)) {
+                std::uint32_t size;
+                std::memcpy(&size, buffer.data() + offset, sizeof(size));
+                if (size == 0 || size > maxSize)
+                    return false;
+                if (buffer.size() - offset - sizeof(size) < size)
+                    break;
+                function(buffer.data() + offset + sizeof(size), size);
+                offset += sizeof(size) + size;
+            }
+            buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(offset));
+            return true;
+        }
+    } // namespace SessionProtocol
+
+    // Hosts many GameManager sessions in one process for remote clients on local TCP. One network thread owns
+    // the listener and every connection; a pool of workers advances sessions. A session only runs when a step
+    // for it arrives, and then only from one decision to the next, so an idle session costs its memory and
+    // nothing else. Step replies are sent straight from the worker; whatever a full socket buffer refuses is
+    // sent later by the network thread.
+    class SessionServer {
+    public:
+        explicit SessionServer(const int workerCount = static_cast<int>(std::thread::hardware_concurrency())) :
+            workerCount_(workerCount > 0 ? workerCount : 1) {}
+
+        SessionServer(const SessionServer &) = delete;
+
+        SessionServer &operator=(const SessionServer &) = delete;
+
+        ~SessionServer() { Stop(); }
+
+        bool Start(const unsigned short port) {
+            if (networkThread_.joinable() ||
+                listener_.listen(port, sf::IpAddress::LocalHost) != sf::Socket::Status::Done)
+                return false;
+
+            listener_.setBlocking(false);
+            running_.store(true);
+            networkThread_ = std::thread([this] { RunNetwork(); });
+            for (int k = 0; k < workerCount_; ++k) {
+                workers_.emplace_back([this] { RunWorker(); });
+            }
+            return true;
+        }
+
+        void Stop() {
+            if (!networkThread_.joinable())
+                return;
+
+            // Stored under the lock so that no worker can check running_ and then miss the wakeup below.
+            {
+                std::lock_guard lock(mutex_);
+                running_.store(false);
+            }
+            wakeWorkers_.notify_all();
+            networkThread_.join();
+            for (auto &worker: workers_) {
+                worker.join();
+            }
+            workers_.clear();
+            listener_.close();
+
+            std::lock_guard lock(mutex_);
+            sessions_.clear();
+            runQueue_.clear();
+            openQueue_.clear();
+            connections_.clear();
+        }
+
+        [[nodiscard]] unsigned short GetPort() const { return listener_.getLocalPort(); }
+
+        [[nodiscard]] std::size_t GetSessionCount() {
+            std::lock_guard lock(mutex_);
+            return sessions_.size();
+        }
+
+    private:
+        struct Connection {
+            sf::TcpSocket socket;
+            std::vector<std::uint8_t> received;
+            std::mutex sendMutex;
+            std::vector<std::uint8_t> unsent;
+            bool closed = false;
+        };
+
+        // Answers each decision with the action of the step being run.
+        class StepPlayer final : public IGamePlayer {
+        public:
+            PlayerAction GetNextAction(const IGameInfo &info) override {
+                asked = true;
+                return action;
+            }
+
+            PlayerAction action{};
+            bool asked = false;
+        };
+
+        struct OpenRequest {
+            std::shared_ptr<Connection> connection;
+            std::uint32_t tag;
+            std::uint32_t seed;
+            int commonDivisor;
+            bool wantsDeltas;
+        };
+
+        struct Session {
+            Session(const std::uint32_t id, const std::shared_ptr<Connection> &connection, const unsigned int seed,
+                    const int commonDivisor, const bool wantsDeltas) :
+                id(id), connection(connection), gameManager(&player, commonDivisor, seed) {
+                if (wantsDeltas) {
+                    cellHashes.resize(GameManagerConfig::kBoardWidth * GameManagerConfig::kBoardHeight);
+                }
+            }
+
+            std::uint32_t id;
+            std::shared_ptr<Connection> connection;
+            StepPlayer player;
+            GameManager gameManager;
+            std::vector<std::uint64_t> cellHashes;
+
+            // Guarded by SessionServer::mutex_.
+            std::deque<PlayerAction> pendingActions;
+            bool queued = false;
+            bool running = false;
+            bool closed = false;
+        };
+
+        static std::uint64_t HashCell(const CellState &state) {
+            std::uint64_t hash = static_cast<std::uint64_t>(state.kind) |
+                                 static_cast<std::uint64_t>(state.direction) << 8 |
+                                 static_cast<std::uint64_t>(state.topLeft.row) << 16 |
+                                 static_cast<std::uint64_t>(state.topLeft.col) << 32;
+            for (const int product: state.products) {
+                hash = (hash ^ static_cast<std::uint32_t>(product)) * 0x9e3779b97f4a7c15ull;
+                hash ^= hash >> 29;
+            }
+            return hash;
+        }
+
+        // Plays the action at the next decision and stops right before the one after it, or at the end.
+        static void Step(Session &session, const PlayerAction &action) {
+            GameManager &gameManager = session.gameManager;
+            session.player.action = action;
+            session.player.asked = false;
+            while (!gameManager.IsGameOver() &&
+                   !(session.player.asked && (gameManager.GetElapsedTime() + 1) % 3 == 0)) {
+                gameManager.Update();
+            }
+            session.player.action = {};
+        }
+
+        static void WriteState(Session &session, std::vector<std::uint8_t> &out) {
+            using namespace SessionProtocol;
+            const GameManager &gameManager = session.gameManager;
+            const std::size_t begin = BeginMessage(out, MessageType::kState);
+            Put<std::uint8_t>(out, gameManager.IsGameOver() ? 1 : 0);
+            Put<std::uint32_t>(out, session.id);
+            Put<std::int32_t>(out, gameManager.GetElapsedTime());
+            Put<std::int32_t>(out, gameManager.GetScores());
+
+            if (!session.cellHashes.empty()) {
+                thread_local std::vector<std::uint8_t> cells;
+                cells.clear();
+                std::uint64_t changedCount = 0;
+                int previous = -1;
+                for (int index = 0; index < static_cast<int>(session.cellHashes.size()); ++index) {
+                    const CellState state = CaptureCellState(gameManager, {index / GameManagerConfig::kBoardWidth,
+                                                                           index % GameManagerConfig::kBoardWidth});
+                    if (const std::uint64_t hash = HashCell(state); hash != session.cellHashes[index]) {
+                        session.cellHashes[index] = hash;
+                        Dataset::PutVarint(cells, static_cast<std::uint64_t>(index - previous - 1));
+                        Dataset::PutCell(cells, index, state);
+                        previous = index;
+                        changedCount += 1;
+                    }
+                }
+                Dataset::PutVarint(out, changedCount);
+                out.insert(out.end(), cells.begin(), cells.end());
+            }
+            FinishMessage(out, begin);
+        }
+
+        static void Send(Connection &connection, const std::vector<std::uint8_t> &bytes) {
+            std::lock_guard lock(connection.sendMutex);
+            if (connection.closed)
+                return;
+
+            std::size_t sent = 0;
+            if (connection.unsent.empty()) {
+                const auto status = connection.socket.send(bytes.data(), bytes.size(), sent);
+                if (status != sf::Socket::Status::Done && status != sf::Socket::Status::Partial &&
+                    status != sf::Socket::Status::NotReady) {
+                    connection.closed = true;
+                    return;
+                }
+            }
+            connection.unsent.insert(connection.unsent.end(), bytes.begin() + static_cast<std::ptrdiff_t>(sent),
+                                     bytes.end());
+        }
+
+        static void WriteOpened(std::uint32_t tag, std::uint32_t id, std::vector<std::uint8_t> &out) {
+            using namespace SessionProtocol;
+            const std::size_t begin = BeginMessage(out, MessageType::kOpened);
+            Put(out, tag);
+            Put(out, id);
+            FinishMessage(out, begin);
+        }
+
+        static bool IsClosed(Connection &connection) {
+            std::lock_guard lock(connection.sendMutex);
+            return connection.closed;
+        }
+
+        static void FlushUnsent(Connection &connection) {
+            std::lock_guard lock(connection.sendMutex);
+            if (connection.closed || connection.unsent.empty())
+                return;
+
+            std::size_t sent = 0;
+            const auto status = connection.socket.send(connection.unsent.data(), connection.unsent.size(), sent);
+            if (status != sf::Socket::Status::Done && status != sf::Socket::Status::Partial &&
+                status != sf::Socket::Status::NotReady) {
+                connection.closed = true;
+                return;
+            }
+            connection.unsent.erase(connection.unsent.begin(),
+                                    connection.unsent.begin() + static_cast<std::ptrdiff_t>(sent));
+        }
+
+        void RunNetwork() {
+            sf::SocketSelector selector;
+            selector.add(listener_);
+            std::vector<std::uint8_t> replies;
+
+            while (running_.load()) {
+                bool hasUnsent = false;
+                for (const auto &connection: connections_) {
+                    FlushUnsent(*connection);
+                    std::lock_guard lock(connection->sendMutex);
+                    hasUnsent = hasUnsent || !connection->unsent.empty();
+                }
+
+                // SFML can only wait for sockets to become readable, so pending output is retried on a short
+                // timeout instead.
+                if (!selector.wait(hasUnsent ? sf::milliseconds(1) : sf::milliseconds(100)))
+                    continue;
+
+                if (selector.isReady(listener_)) {
+                    auto connection = std::make_shared<Connection>();
+                    while (listener_.accept(connection->socket) == sf::Socket::Status::Done) {
+                        connection->socket.setBlocking(false);
+                        selector.add(connection->socket);
+                        connections_.push_back(connection);
+                        connection = std::make_shared<Connection>();
+                    }
+                }
+
+                for (std::size_t k = 0; k < connections_.size();) {
+                    Connection &connection = *connections_[k];
+                    bool alive = true;
+                    if (selector.isReady(connection.socket)) {
+                        alive = Receive(connection, replies);
+                        if (!replies.empty()) {
+                            Send(connection, replies);
+                            replies.clear();
+                        }
+                    }
+                    {
+                        std::lock_guard lock(connection.sendMutex);
+                        alive = alive && !connection.closed;
+                        connection.closed = !alive;
+                    }
+                    if (alive) {
+                        k += 1;
+                        continue;
+                    }
+                    selector.remove(connection.socket);
+                    CloseSessions(connections_[k].get());
+                    connection.socket.disconnect();
+                    connections_[k] = connections_.back();
+                    connections_.pop_back();
+                }
+            }
+        }
+
+        // Reads what arrived and handles every complete message; false when the connection is gone or broken.
+        bool Receive(Connection &connection, std::vector<std::uint8_t> &replies) {
+            std::uint8_t buffer[4096];
+            std::size_t received = 0;
+            const auto status = connection.socket.receive(buffer, sizeof(buffer), received);
+            if (status == sf::Socket::Status::NotReady)
+                return true;
+            if (status != sf::Socket::Status::Done)
+                return false;
+
+            connection.received.insert(connection.received.end(), buffer, buffer + received);
+            bool valid = true;
+            const bool framed = SessionProtocol::ForEachMessage(
+                    connection.received, SessionProtocol::kMaxClientMessageSize,
+                    [&](const std::uint8_t *message, const std::uint32_t size) {
+                        valid = valid && Handle(connection, message, size, replies);
+                    });
+            return framed && valid;
+        }
+
+        bool Handle(Connection &connection, const std::uint8_t *message, const std::uint32_t size,
+                    std::vector<std::uint8_t> &replies) {
+            using namespace SessionProtocol;
+            const std::uint8_t *in = message;
+            switch (Get<MessageType>(in)) {
+                case MessageType::kOpen: {
+                    if (size < 14)
+                        return false;
+                    const bool wantsDeltas = Get<std::uint8_t>(in) != 0;
+                    const auto tag = Get<std::uint32_t>(in);
+                    const auto seed = Get<std::uint32_t>(in);
+                    const auto commonDivisor = Get<std::int32_t>(in);
+
+                    if (commonDivisor <= 0) {
+                        WriteOpened(tag, 0, replies);
+                        return true;
+                    }
+
+                    // Setting up a board takes long enough to keep it off the network thread.
+                    std::lock_guard lock(mutex_);
+                    openQueue_.push_back({FindConnection(&connection), tag, seed, commonDivisor, wantsDeltas});
+                    wakeWorkers_.notify_one();
+                    return true;
+                }
+                case MessageType::kStep: {
+                    if (size < 14)
+                        return false;
+                    const auto type = Get<std::uint8_t>(in);
+                    const auto id = Get<std::uint32_t>(in);
+                    const auto row = Get<std::int32_t>(in);
+                    const auto col = Get<std::int32_t>(in);
+
+                    std::lock_guard lock(mutex_);
+                    const auto it = sessions_.find(id);
+                    if (it == sessions_.end() || it->second->connection.get() != &connection)
+                        return true;
+                    Session &session = *it->second;
+                    session.pendingActions.push_back({static_cast<PlayerActionType>(type), {row, col}});
+                    Schedule(session);
+                    return true;
+                }
+                case MessageType::kClose: {
+                    if (size < 5)
+                        return false;
+                    const auto id = Get<std::uint32_t>(in);
+                    std::lock_guard lock(mutex_);
+                    const auto it = sessions_.find(id);
+                    if (it != sessions_.end() && it->second->connection.get() == &connection) {
+                        CloseSession(it);
+                    }
+                    return true;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        std::shared_ptr<Connection> FindConnection(const Connection *connection) const {
+            for (const auto &candidate: connections_) {
+                if (candidate.get() == connection)
+                    return candidate;
+            }
+            return nullptr;
+        }
+
+        // Called with mutex_ held.
+        void Schedule(Session &session) {
+            if (session.queued || session.running || session.pendingActions.empty())
+                return;
+            session.queued = true;
+            runQueue_.push_back(&session);
+            wakeWorkers_.notify_one();
+        }
+
+        // Called with mutex_ held. A running session is left for its worker to remove.
+        void CloseSession(const std::unordered_map<std::uint32_t, std::unique_ptr<Session>>::iterator it) {
+            Session &session = *it->second;
+            session.closed = true;
+            if (session.running)
+                return;
+            if (session.queued) {
+                runQueue_.erase(std::find(runQueue_.begin(), runQueue_.end(), &session));
+            }
+            sessions_.erase(it);
+        }
+
+        void CloseSessions(const Connection *connection) {
+            std::lock_guard lock(mutex_);
+            for (auto it = sessions_.begin(); it != sessions_.end();) {
+                const auto next = std::next(it);
+                if (it->second->connection.get() == connection) {
+                    CloseSession(it);
+                }
+                it = next;
+            }
+        }
+
+        void RunWorker() {
+            std::vector<std::uint8_t> reply;
+            std::unique_lock lock(mutex_);
+            while (true) {
+                wakeWorkers_.wait(lock, [this] {
+                    return !runQueue_.empty() || !openQueue_.empty() || !running_.load();
+                });
+                if (!running_.load())
+                    return;
+
+                if (!openQueue_.empty()) {
+                    const OpenRequest request = std::move(openQueue_.front());
+                    openQueue_.pop_front();
+                    const std::uint32_t id = nextSessionId_++;
+                    lock.unlock();
+
+                    auto session = std::make_unique<Session>(id, request.connection, request.seed,
+                                                             request.commonDivisor, request.wantsDeltas);
+                    reply.clear();
+                    WriteOpened(request.tag, id, reply);
+
+                    lock.lock();
+                    // The connection may have gone away meanwhile; then nobody can ever refer to the session.
+                    if (!IsClosed(*request.connection)) {
+                        sessions_[id] = std::move(session);
+                        lock.unlock();
+                        Send(*request.connection, reply);
+                        lock.lock();
+                    }
+                    continue;
+                }
+
+                Session &session = *runQueue_.front();
+                runQueue_.pop_front();
+                session.queued = false;
+                session.running = true;
+                const PlayerAction action = session.pendingActions.front();
+                session.pendingActions.pop_front();
+                lock.unlock();
+
+                Step(session, action);
+                reply.clear();
+                WriteState(session, reply);
+                Send(*session.connection, reply);
+
+                lock.lock();
+                session.running = false;
+                if (session.closed) {
+                    sessions_.erase(session.id);
+                } else {
+                    Schedule(session);
+                }
+            }
+        }
+
+        int workerCount_;
+        sf::TcpListener listener_;
+        std::atomic<bool> running_{false};
+        std::thread networkThread_;
+        std::vector<std::thread> workers_;
+
+        // Only touched by the network thread while it runs.
+        std::vector<std::shared_ptr<Connection>> connections_;
+
+        std::mutex mutex_;
+        std::condition_variable wakeWorkers_;
+        std::unordered_map<std::uint32_t, std::unique_ptr<Session>> sessions_;
+        std::deque<Session *> runQueue_;
+        std::deque<OpenRequest> openQueue_;
+        std::uint32_t nextSessionId_ = 1;
+    };
+    // One message from SessionServer; cells holds the changed cells of a kState for sessions that want deltas.
+    struct SessionReply {
+        SessionProtocol::MessageType type;
+        std::uint32_t tag;
+        std::uint32_t session;
+        bool gameOver;
+        int elapsedTime;
+        int scores;
+        std::vector<std::pair<int, CellState>> cells;
+    };
+
+    // Blocking client for SessionServer. Sends never wait for replies, so a client can keep steps of many
+    // sessions in flight and collect the replies with Receive as they come.
+    class SessionClient {
+    public:
+        bool Connect(const unsigned short port) {
+            return socket_.connect(sf::IpAddress::LocalHost, port) == sf::Socket::Status::Done;
+        }
+
+        bool Open(const std::uint32_t tag, const std::uint32_t seed, const std::int32_t commonDivisor,
+                  const bool wantsDeltas) {
+            using namespace SessionProtocol;
+            std::vector<std::uint8_t> out;
+            const std::size_t begin = BeginMessage(out, MessageType::kOpen);
+            Put<std::uint8_t>(out, wantsDeltas ? 1 : 0);
+            Put(out, tag);
+            Put(out, seed);
+            Put(out, commonDivisor);
+            FinishMessage(out, begin);
+            return Send(out);
+        }
+
+        bool Step(const std::uint32_t session, const PlayerAction &action) {
+            using namespace SessionProtocol;
+            std::vector<std::uint8_t> out;
+            const std::size_t begin = BeginMessage(out, MessageType::kStep);
+            Put(out, static_cast<std::uint8_t>(action.type));
+            Put(out, session);
+            Put<std::int32_t>(out, action.cellPosition.row);
+            Put<std::int32_t>(out, action.cellPosition.col);
+            FinishMessage(out, begin);
+            return Send(out);
+        }
+
+        bool Close(const std::uint32_t session) {
+            using namespace SessionProtocol;
+            std::vector<std::uint8_t> out;
+            const std::size_t begin = BeginMessage(out, MessageType::kClose);
+            Put(out, session);
+            FinishMessage(out, begin);
+            return Send(out);
+        }
+
+        // Waits for the next message; false when the connection is gone.
+        bool Receive(SessionReply &reply) {
+            using namespace SessionProtocol;
+            std::uint32_t size = 0;
+            if (!ReceiveExactly(&size, sizeof(size)))
+                return false;
+            message_.resize(size);
+            if (size == 0 || !ReceiveExactly(message_.data(), size))
+                return false;
+
+            const std::uint8_t *in = message_.data();
+            reply.type = Get<MessageType>(in);
+            reply.cells.clear();
+            if (reply.type == MessageType::kOpened) {
+                reply.tag = Get<std::uint32_t>(in);
+                reply.session = Get<std::uint32_t>(in);
+                return true;
+            }
+            reply.gameOver = Get<std::uint8_t>(in) != 0;
+            reply.session = Get<std::uint32_t>(in);
+            reply.elapsedTime = Get<std::int32_t>(in);
+            reply.scores = Get<std::int32_t>(in);
+            if (in != message_.data() + size) {
+                const std::uint64_t changedCount = Dataset::GetVarint(in);
+                int index = -1;
+                for (std::uint64_t k = 0; k < changedCount; ++k) {
+                    index += static_cast<int>(Dataset::GetVarint(in)) + 1;
+                    reply.cells.emplace_back(index, Dataset::GetCell(in, index));
+                }
+            }
+            return true;
+        }
+
+    private:
+        bool Send(const std::vector<std::uint8_t> &out) {
+            return socket_.send(out.data(), out.size()) == sf::Socket::Status::Done;
+        }
+
+        bool ReceiveExactly(void *data, const std::size_t size) {
+            std::size_t total = 0;
+            while (total < size) {
+                std::size_t received = 0;
+                if (socket_.receive(static_cast<std::uint8_t *>(data) + total, size - total, received) !=
+                    sf::Socket::Status::Done)
+                    return false;
+                total += received;
+            }
+            return true;
+        }
+
+        sf::TcpSocket socket_;
+        std::vector<std::uint8_t> message_;
+    };
+} // namespace Feis
+#endif
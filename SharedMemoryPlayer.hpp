@@ -0,0 +1,334 @@
+#ifndef SHARED_MEMORY_PLAYER_HPP
+#define SHARED_MEMORY_PLAYER_HPP
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include "PDOGS.hpp"
+
+namespace Feis {
+    // Layout of the shared region: this header, then ObservationPlanes::kSize floats of observation planes at
+    // kPlanesOffset. The engine owns the request side and the player the response side; each decision is one
+    // request sequence number answered by the same number on the response side, so a late answer to a request
+    // that already timed out is simply ignored. Plain data only, so the player may be built with any toolchain.
+    struct SharedPlayerChannel {
+        static constexpr std::uint32_t kMagic = 0x50594c50; // "PLYP"
+        static constexpr std::uint32_t kVersion = 1;
+        static constexpr std::size_t kPlanesOffset = 256;
+        static constexpr std::size_t kSize = kPlanesOffset + ObservationPlanes::kSize * sizeof(float);
+
+        std::atomic<std::uint32_t> magic;
+        std::uint32_t version;
+        std::atomic<std::uint32_t> closed;
+
+        alignas(64) std::atomic<std::uint32_t> request;
+        std::atomic<std::uint32_t> requestWaiters;
+        std::int32_t elapsedTime;
+        std::int32_t endTime;
+        std::int32_t scores;
+        std::int32_t commonDivisor;
+
+        alignas(64) std::atomic<std::uint32_t> response;
+        std::atomic<std::uint32_t> responseWaiters;
+        std::int32_t actionType;
+        std::int32_t actionRow;
+        std::int32_t actionCol;
+    };
+
+    static_assert(sizeof(SharedPlayerChannel) <= SharedPlayerChannel::kPlanesOffset);
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free &&
+                  sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+
+    namespace SharedMemory {
+        // Spinning covers the common case of an answer within a few microseconds; only a slower peer costs a
+        // sleep and a wake-up system call. On a single core spinning only delays the peer, so it is skipped.
+        constexpr int kSpinCount = 4000;
+
+        inline int GetSpinCount() {
+            static const int spinCount = std::thread::hardware_concurrency() > 1 ? kSpinCount : 0;
+            return spinCount;
+        }
+
+        inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+            __builtin_ia32_pause();
+#endif
+        }
+
+        // Waits until value no longer holds expected or the deadline passes; returns whether it changed. On Linux
+        // this sleeps on a process-shared futex. Elsewhere there is no cross-process equivalent, so it yields.
+        inline bool WaitForChange(std::atomic<std::uint32_t> &value, std::atomic<std::uint32_t> &waiters,
+                                  const std::uint32_t expected, const std::chrono::steady_clock::time_point deadline) {
+            for (int k = 0; k < GetSpinCount(); ++k) {
+                if (value.load(std::memory_order_acquire) != expected)
+                    return true;
+                CpuRelax();
+            }
+
+            waiters.fetch_add(1, std::memory_order_seq_cst);
+            bool changed = false;
+            while (!(changed = value.load(std::memory_order_seq_cst) != expected)) {
+                const auto remaining = deadline - std::chrono::steady_clock::now();
+                if (remaining <= std::chrono::steady_clock::duration::zero())
+                    break;
+#if defined(__linux__)
+                const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+                timespec timeout{static_cast<std::time_t>(nanoseconds / 1000000000),
+                                 static_cast<long>(nanoseconds % 1000000000)};
+                syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&value), FUTEX_WAIT, expected, &timeout,
+                        nullptr, 0);
+#else
+                std::this_thread::yield();
+#endif
+            }
+            waiters.fetch_sub(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return changed;
+        }
+
+        inline void Publish(std::atomic<std::uint32_t> &value, const std::atomic<std::uint32_t> &waiters,
+                            const std::uint32_t newValue) {
+            value.store(newValue, std::memory_order_seq_cst);
+#if defined(__linux__)
+            if (waiters.load(std::memory_order_seq_cst) != 0) {
+                syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&value), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+            }
+#endif
+        }
+
+        // A named, process-shared mapping of SharedPlayerChannel::kSize bytes. The creator removes the name again
+        // when it is done; on Windows the mapping lives as long as any process has it open.
+        class Mapping {
+        public:
+            Mapping() = default;
+
+            Mapping(const Mapping &) = delete;
+
+            Mapping &operator=(const Mapping &) = delete;
+
+            ~Mapping() { Close(); }
+
+            bool Open(const std::string &name, const bool create) {
+                Close();
+#if defined(_WIN32)
+                handle_ = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+                                                      static_cast<DWORD>(SharedPlayerChannel::kSize), name.c_str())
+                                 : OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+                if (handle_ == nullptr)
+                    return false;
+                data_ = MapViewOfFile(handle_, FILE_MAP_ALL_ACCESS, 0, 0, SharedPlayerChannel::kSize);
+#else
+                const std::string path = "/" + name;
+                if (create) {
+                    shm_unlink(path.c_str());
+                }
+                const int fd = shm_open(path.c_str(), create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+                if (fd < 0)
+                    return false;
+                if (create && ftruncate(fd, static_cast<off_t>(SharedPlayerChannel::kSize)) != 0) {
+                    close(fd);
+                    shm_unlink(path.c_str());
+                    return false;
+                }
+                void *data = mmap(nullptr, SharedPlayerChannel::kSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                close(fd);
+                data_ = data == MAP_FAILED ? nullptr : data;
+                if (create) {
+                    path_ = path;
+                }
+#endif
+                if (data_ == nullptr) {
+                    Close();
+                    return false;
+                }
+                return true;
+            }
+
+            void Close() {
+#if defined(_WIN32)
+                if (data_ != nullptr) {
+                    UnmapViewOfFile(data_);
+                }
+                if (handle_ != nullptr) {
+                    CloseHandle(handle_);
+                    handle_ = nullptr;
+                }
+#else
+                if (data_ != nullptr) {
+                    munmap(data_, SharedPlayerChannel::kSize);
+                }
+                if (!path_.empty()) {
+                    shm_unlink(path_.c_str());
+                    path_.clear();
+                }
+#endif
+                data_ = nullptr;
+            }
+
+            [[nodiscard]] void *GetData() const { return data_; }
+
+        private:
+            void *data_ = nullptr;
+#if defined(_WIN32)
+            HANDLE handle_ = nullptr;
+#else
+            std::string path_;
+#endif
+        };
+    } // namespace SharedMemory
+
+    // Engine side: an IGamePlayer whose decisions are made by another process attached to the same named mapping
+    // through SharedMemoryPlayerClient. The board view is the game's ObservationPlanes, kept up to date by the
+    // engine directly inside the mapping, so a decision copies nothing but a few header values. Attach it with
+    // gameManager.SetObservationPlanes(&player.GetObservationPlanes()). A player that does not answer within the
+    // timeout (or has crashed) makes the game go on with PlayerActionType::None.
+    class SharedMemoryPlayer final : public IGamePlayer {
+    public:
+        explicit SharedMemoryPlayer(const int commonDivisor,
+                                    const std::chrono::microseconds timeout = std::chrono::milliseconds(100)) :
+            commonDivisor_(commonDivisor), timeout_(timeout) {}
+
+        ~SharedMemoryPlayer() override { Close(); }
+
+        bool Open(const std::string &name) {
+            if (!mapping_.Open(name, true))
+                return false;
+
+            auto *data = static_cast<unsigned char *>(mapping_.GetData());
+            std::memset(data, 0, SharedPlayerChannel::kPlanesOffset);
+            channel_ = new (data) SharedPlayerChannel{};
+            channel_->version = SharedPlayerChannel::kVersion;
+            channel_->commonDivisor = commonDivisor_;
+            planes_.emplace(reinterpret_cast<float *>(data + SharedPlayerChannel::kPlanesOffset));
+            channel_->magic.store(SharedPlayerChannel::kMagic, std::memory_order_release);
+            return true;
+        }
+
+        // Tells the player process the game is over and removes the mapping's name.
+        void Close() {
+            if (channel_ == nullptr)
+                return;
+            channel_->closed.store(1, std::memory_order_seq_cst);
+            SharedMemory::Publish(channel_->request, channel_->requestWaiters, sequence_ + 1);
+            channel_ = nullptr;
+            planes_.reset();
+            mapping_.Close();
+        }
+
+        [[nodiscard]] ObservationPlanes &GetObservationPlanes() { return *planes_; }
+
+        [[nodiscard]] int GetTimeoutCount() const { return timeoutCount_; }
+
+        PlayerAction GetNextAction(const IGameInfo &info) override {
+            if (channel_ == nullptr)
+                return {};
+
+            channel_->elapsedTime = info.GetElapsedTime();
+            channel_->endTime = info.GetEndTime();
+            channel_->scores = info.GetScores();
+            sequence_ += 1;
+            SharedMemory::Publish(channel_->request, channel_->requestWaiters, sequence_);
+
+            // Anything but this sequence number on the response side is a late answer to an earlier request.
+            const auto deadline = std::chrono::steady_clock::now() + timeout_;
+            for (std::uint32_t seen; (seen = channel_->response.load(std::memory_order_acquire)) != sequence_;) {
+                if (!SharedMemory::WaitForChange(channel_->response, channel_->responseWaiters, seen, deadline)) {
+                    timeoutCount_ += 1;
+                    return {};
+                }
+            }
+            return {static_cast<PlayerActionType>(channel_->actionType), {channel_->actionRow, channel_->actionCol}};
+        }
+
+    private:
+        int commonDivisor_;
+        std::chrono::microseconds timeout_;
+        SharedMemory::Mapping mapping_;
+        SharedPlayerChannel *channel_ = nullptr;
+        std::optional<ObservationPlanes> planes_;
+        std::uint32_t sequence_ = 0;
+        int timeoutCount_ = 0;
+    };
+
+    // Player side of SharedMemoryPlayer, for the process that makes the decisions:
+    //     while (client.WaitForRequest()) { ...read client.GetPlanes()...; client.Respond(action); }
+    class SharedMemoryPlayerClient {
+    public:
+        // Fails until the engine has created the mapping, so callers may simply retry.
+        bool Open(const std::string &name) {
+            if (!mapping_.Open(name, false))
+                return false;
+            channel_ = static_cast<SharedPlayerChannel *>(mapping_.GetData());
+            if (channel_->magic.load(std::memory_order_acquire) != SharedPlayerChannel::kMagic ||
+                channel_->version != SharedPlayerChannel::kVersion) {
+                channel_ = nullptr;
+                mapping_.Close();
+                return false;
+            }
+            answered_ = channel_->response.load(std::memory_order_acquire);
+            current_ = answered_;
+            return true;
+        }
+
+        // Waits for the next decision; false once the engine has closed the game or the wait times out.
+        bool WaitForRequest(const std::chrono::microseconds timeout = std::chrono::seconds(10)) {
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            while ((current_ = channel_->request.load(std::memory_order_acquire)) == answered_) {
+                if (!SharedMemory::WaitForChange(channel_->request, channel_->requestWaiters, answered_, deadline))
+                    return false;
+            }
+            return channel_->closed.load(std::memory_order_acquire) == 0;
+        }
+
+        [[nodiscard]] const SharedPlayerChannel &GetChannel() const { return *channel_; }
+
+        [[nodiscard]] const float *GetPlanes() const {
+            return reinterpret_cast<const float *>(reinterpret_cast<const unsigned char *>(channel_) +
+                                                   SharedPlayerChannel::kPlanesOffset);
+        }
+
+        [[nodiscard]] float Get(const ObservationChannel channel, const CellPosition cellPosition) const {
+            return GetPlanes()[static_cast<std::size_t>(channel) * ObservationPlanes::kPlaneSize +
+                               cellPosition.row * GameManagerConfig::kBoardWidth + cellPosition.col];
+        }
+
+        void Respond(const PlayerAction &action) {
+            channel_->actionType = static_cast<std::int32_t>(action.type);
+            channel_->actionRow = action.cellPosition.row;
+            channel_->actionCol = action.cellPosition.col;
+            answered_ = current_;
+            SharedMemory::Publish(channel_->response, channel_->responseWaiters, answered_);
+        }
+
+    private:
+        SharedMemory::Mapping mapping_;
+        SharedPlayerChannel *channel_ = nullptr;
+        std::uint32_t answered_ = 0;
+        std::uint32_t current_ = 0;
+    };
+} // namespace Feis
+#endif
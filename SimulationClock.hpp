@@ -0,0 +1,115 @@
+#ifndef SIMULATION_CLOCK_HPP
+#define SIMULATION_CLOCK_HPP
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+
+namespace Feis {
+    // Decides when the simulation thread runs its next ticks, independent of how often the window draws. The UI
+    // thread changes pause and speed through atomics; only the simulation thread calls TakeDueTicks.
+    class SimulationClock {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // 0 stands for "as fast as possible".
+        static constexpr std::array<double, 9> kSpeeds = {0.25, 0.5, 1, 2, 4, 8, 16, 32, 0};
+        static constexpr int kNormalSpeedIndex = 2;
+        // Upper bound on ticks run back to back before a snapshot is published again.
+        static constexpr int kMaxTicksPerBatch = 64;
+
+        explicit SimulationClock(const Clock::duration tickPeriod) : tickPeriod_(tickPeriod) {}
+
+        void TogglePause() { paused_.store(!paused_.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+
+        [[nodiscard]] bool IsPaused() const { return paused_.load(std::memory_order_relaxed); }
+
+        // Runs exactly one tick the next time the simulation thread looks, and leaves the game paused.
+        void Step() {
+            paused_.store(true, std::memory_order_relaxed);
+            pendingSteps_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void Faster() { SetSpeedIndex(speedIndex_.load(std::memory_order_relaxed) + 1); }
+
+        void Slower() { SetSpeedIndex(speedIndex_.load(std::memory_order_relaxed) - 1); }
+
+        [[nodiscard]] double GetSpeed() const { return kSpeeds[speedIndex_.load(std::memory_order_relaxed)]; }
+
+        // Product motion is only worth interpolating when ticks are slower than frames.
+        [[nodiscard]] bool IsSlowed() const { return IsSlowed(GetSpeed()); }
+
+        // How far the next tick is from the last one, in [0, 1]; the renderer blends product positions with it.
+        [[nodiscard]] float GetInterpolation(const Clock::time_point now) const {
+            // The UI thread may change the speed at any time, so it is read once and everything follows from it.
+            const double speed = GetSpeed();
+            if (!IsSlowed(speed) || IsPaused()) {
+                return 1.0f;
+            }
+            const auto lastTick = Clock::time_point(Clock::duration(lastTick_.load(std::memory_order_relaxed)));
+            const double fraction = std::chrono::duration<double>(now - lastTick).count() /
+                                    std::chrono::duration<double>(GetPeriod(speed)).count();
+            return static_cast<float>(std::clamp(fraction, 0.0, 1.0));
+        }
+
+        // Simulation thread: how many ticks to run right now. When it returns 0, sleep until GetNextTickTime().
+        int TakeDueTicks(const Clock::time_point now) {
+            if (paused_.load(std::memory_order_relaxed)) {
+                nextTick_ = now;
+                if (pendingSteps_.load(std::memory_order_relaxed) == 0) {
+                    return 0;
+                }
+                pendingSteps_.fetch_sub(1, std::memory_order_relaxed);
+                MarkTick(now);
+                return 1;
+            }
+
+            const double speed = GetSpeed();
+            if (speed == 0) {
+                nextTick_ = now;
+                MarkTick(now);
+                return kMaxTicksPerBatch;
+            }
+
+            if (now < nextTick_) {
+                return 0;
+            }
+            const Clock::duration period = GetPeriod(speed);
+            const auto due = static_cast<int>((now - nextTick_) / period) + 1;
+            const int ticks = std::min(due, kMaxTicksPerBatch);
+            // Falling too far behind drops the backlog instead of catching up in a burst.
+            nextTick_ = due > kMaxTicksPerBatch ? now + period : nextTick_ + ticks * period;
+            MarkTick(now);
+            return ticks;
+        }
+
+        [[nodiscard]] Clock::time_point GetNextTickTime() const {
+            // While paused, poll often enough that a step or unpause feels immediate.
+            return IsPaused() ? Clock::now() + std::chrono::milliseconds(5) : nextTick_;
+        }
+
+    private:
+        void SetSpeedIndex(const int index) {
+            speedIndex_.store(std::clamp(index, 0, static_cast<int>(kSpeeds.size()) - 1), std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] static bool IsSlowed(const double speed) { return speed != 0 && speed < 1; }
+
+        // speed must not be 0.
+        [[nodiscard]] Clock::duration GetPeriod(const double speed) const {
+            return std::chrono::duration_cast<Clock::duration>(tickPeriod_ / speed);
+        }
+
+        void MarkTick(const Clock::time_point now) {
+            lastTick_.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+        }
+
+        Clock::duration tickPeriod_;
+        std::atomic<bool> paused_{false};
+        std::atomic<int> pendingSteps_{0};
+        std::atomic<int> speedIndex_{kNormalSpeedIndex};
+        std::atomic<Clock::rep> lastTick_{0};
+        Clock::time_point nextTick_ = Clock::now();
+    };
+} // namespace Feis
+#endif
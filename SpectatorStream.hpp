@@ -0,0 +1,396 @@
+#ifndef SPECTATOR_STREAM_HPP
+#define SPECTATOR_STREAM_HPP
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "CellState.hpp"
+#include "DatasetRecorder.hpp"
+#include "PDOGS.hpp"
+
+namespace Feis {
+    // Frames of a spectator stream. Both ends keep a model of the game and step it with the engine's own
+    // GameBoard::Update, so products moving along conveyors, mining cycles and deliveries cost nothing; a frame
+    // only carries what that prediction got wrong, which is mostly what the player built or cleared.
+    //
+    // All integers are varints. Cells are written by Dataset::PutCell, each after the gap from the previous cell's
+    // index (from -1).
+    // Keyframe: type, elapsed time, end time, common divisor, scores, 1 if the game skips dead entities else 0, count
+    // of cells with a number under them and per cell its gap and number byte, count of non-empty cells and per cell
+    // its gap and the cell.
+    // Delta: type, ticks since the previous frame, zigzag score correction, count of cells built over or cleared
+    // since the previous frame and per cell its gap and just the tag byte of its cell, then count of corrected cells
+    // and per cell its gap and the cell. Views apply the first list before they predict, so whatever the player built
+    // takes part in the tick it was built in, and the second list after.
+    // Tick: the type byte alone, for one tick the prediction got entirely right.
+    namespace Spectator {
+        enum class FrameType : std::uint8_t { kKeyframe = 1, kDelta = 2, kTick = 3 };
+
+        // Bounds-checked reading of a frame, which may have come over the network.
+        class Reader {
+        public:
+            Reader(const std::uint8_t *data, const std::size_t size) : in_(data), end_(data + size) {}
+
+            [[nodiscard]] bool AtEnd() const { return in_ == end_; }
+
+            bool GetByte(std::uint8_t &value) {
+                if (in_ == end_)
+                    return false;
+                value = *in_++;
+                return true;
+            }
+
+            bool GetVarint(std::uint64_t &value) {
+                value = 0;
+                for (int shift = 0; shift < 64; shift += 7) {
+                    std::uint8_t byte;
+                    if (!GetByte(byte))
+                        return false;
+                    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                    if (!(byte & 0x80))
+                        return true;
+                }
+                return false;
+            }
+
+            bool GetInt(int &value, const int limit) {
+                std::uint64_t raw;
+                if (!GetVarint(raw) || raw > static_cast<std::uint64_t>(limit))
+                    return false;
+                value = static_cast<int>(raw);
+                return true;
+            }
+
+            bool GetSigned(int &value) {
+                std::uint64_t raw;
+                if (!GetVarint(raw) || raw > 0xffffffffu)
+                    return false;
+                value = static_cast<int>(static_cast<std::int64_t>(raw >> 1) ^ -static_cast<std::int64_t>(raw & 1));
+                return true;
+            }
+
+            // Reads the next cell's gap and the cell, as Dataset::GetCell would, into index and state; without
+            // products only the tag byte.
+            bool GetCell(int &index, CellState &state, const bool withProducts) {
+                int gap;
+                std::uint8_t tag;
+                if (!GetInt(gap, Dataset::kCellCount) || (index += gap + 1) >= Dataset::kCellCount ||
+                    !GetByte(tag) || (tag & 7) > static_cast<int>(CellKind::kWall) || tag >= 64)
+                    return false;
+
+                const CellPosition position{index / GameManagerConfig::kBoardWidth,
+                                            index % GameManagerConfig::kBoardWidth};
+                state = {static_cast<CellKind>(tag & 7), static_cast<Direction>(tag >> 3 & 3), position, {}};
+                if ((tag & 32) == 0) {
+                    if (state.kind == CellKind::kCollectionCenter) {
+                        state.topLeft = {GameManager::CollectionCenterConfig::kTop,
+                                         GameManager::CollectionCenterConfig::kLeft};
+                    } else if (state.kind != CellKind::kCombiner) {
+                        return false;
+                    } else if (state.direction == Direction::kTop || state.direction == Direction::kBottom) {
+                        state.topLeft = position + CellPosition{0, -1};
+                    } else {
+                        state.topLeft = position + CellPosition{-1, 0};
+                    }
+                }
+                for (std::size_t i = 0; withProducts && i < Dataset::GetStoredProductCount(state.kind); ++i) {
+                    if (!GetInt(state.products[i], 0x7fffffff))
+                        return false;
+                }
+                return true;
+            }
+
+        private:
+            const std::uint8_t *in_;
+            const std::uint8_t *end_;
+        };
+    } // namespace Spectator
+
+    // The receiving end of a spectator stream: a game rebuilt from frames, which GameRenderer draws like any other.
+    // Until its first keyframe the board is empty. Product tags are not carried, so lineage tracing stays with the
+    // game itself.
+    class SpectatorView final : public IGameManager {
+    public:
+        SpectatorView() : board_(std::make_unique<GameBoard>()) {}
+
+        SpectatorView(const SpectatorView &) = delete;
+
+        SpectatorView &operator=(const SpectatorView &) = delete;
+
+        ~SpectatorView() override = default;
+
+        // Applies one frame from SpectatorEncoder. Returns false for a frame that does not decode or does not fit
+        // the board, and for every delta until the next keyframe after that or before the first one.
+        bool Apply(const std::uint8_t *frame, const std::size_t size) {
+            Spectator::Reader in(frame, size);
+            std::uint8_t type;
+            if (!in.GetByte(type))
+                return synchronized_ = false;
+
+            switch (static_cast<Spectator::FrameType>(type)) {
+                case Spectator::FrameType::kKeyframe:
+                    synchronized_ = ApplyKeyframe(in) && in.AtEnd();
+                    return synchronized_;
+                case Spectator::FrameType::kDelta:
+                    synchronized_ = synchronized_ && ApplyDelta(in) && in.AtEnd();
+                    return synchronized_;
+                case Spectator::FrameType::kTick:
+                    if (synchronized_ && in.AtEnd()) {
+                        Predict(1);
+                        return true;
+                    }
+                    return synchronized_ = false;
+            }
+            return synchronized_ = false;
+        }
+
+        [[nodiscard]] bool IsSynchronized() const { return synchronized_; }
+
+        [[nodiscard]] const GameBoard &GetBoard() const { return *board_; }
+
+        [[nodiscard]] std::string GetLevelInfo() const override { return "(" + std::to_string(commonDivisor_) + ")"; }
+
+        [[nodiscard]] const LayeredCell &GetLayeredCell(const CellPosition cellPosition) const override {
+            return board_->GetLayeredCell(cellPosition);
+        }
+
+        [[nodiscard]] bool IsScoredProduct(const int number) const override { return number % commonDivisor_ == 0; }
+
+        [[nodiscard]] int GetScores() const override { return scores_; }
+
+        [[nodiscard]] int GetEndTime() const override { return endTime_; }
+
+        [[nodiscard]] int GetElapsedTime() const override { return elapsedTime_; }
+
+        [[nodiscard]] bool IsGameOver() const override { return elapsedTime_ >= endTime_; }
+
+        [[nodiscard]] int GetDistanceToCollectionCenter(const CellPosition cellPosition) const override {
+            return board_->GetDistanceToCollectionCenter(cellPosition);
+        }
+
+        [[nodiscard]] FlowStatus GetFlowStatus(const CellPosition cellPosition) const override {
+            return board_->GetFlowStatus(cellPosition);
+        }
+
+        // Deliveries during a predicted tick.
+        void OnProductReceived(const int number, ProductTag tag) override {
+            if (number % commonDivisor_ == 0) {
+                scores_ += 1;
+            }
+        }
+
+    private:
+        friend class SpectatorEncoder;
+
+        using Record = CellStateRecord;
+
+        void Predict(const int ticks) {
+            for (int k = 0; k < ticks; ++k) {
+                board_->Update();
+            }
+            elapsedTime_ += ticks;
+        }
+
+        bool ApplyKeyframe(Spectator::Reader &in) {
+            int skipDeadEntities, numberCount;
+            if (!in.GetInt(elapsedTime_, GameManagerConfig::kEndTime) ||
+                !in.GetInt(endTime_, GameManagerConfig::kEndTime) || !in.GetInt(commonDivisor_, 0x7fffffff) ||
+                commonDivisor_ == 0 || !in.GetInt(scores_, 0x7fffffff) || !in.GetInt(skipDeadEntities, 1) ||
+                !in.GetInt(numberCount, Dataset::kCellCount))
+                return false;
+
+            // The model skips dead entities exactly when the game does, so predicting costs the views no more
+            // than it costs the game.
+            board_ = std::make_unique<GameBoard>();
+            board_->SetSkipDeadEntities(skipDeadEntities != 0);
+            for (int k = 0, index = -1; k < numberCount; ++k) {
+                int gap;
+                std::uint8_t number;
+                if (!in.GetInt(gap, Dataset::kCellCount) || (index += gap + 1) >= Dataset::kCellCount ||
+                    !in.GetByte(number) || number == 0)
+                    return false;
+                board_->SetBackground({index / GameManagerConfig::kBoardWidth, index % GameManagerConfig::kBoardWidth},
+                                      std::make_shared<NumberCell>(number));
+            }
+            return ReadRecords(in, true) && ApplyRecords(records_);
+        }
+
+        bool ApplyDelta(Spectator::Reader &in) {
+            int ticks, scoreCorrection;
+            if (!in.GetInt(ticks, GameManagerConfig::kEndTime) || !in.GetSigned(scoreCorrection) ||
+                !ReadRecords(in, false) || !ApplyRecords(records_))
+                return false;
+
+            Predict(ticks);
+            scores_ += scoreCorrection;
+            return ReadRecords(in, true) && ApplyRecords(records_);
+        }
+
+        bool ReadRecords(Spectator::Reader &in, const bool withProducts) {
+            int count;
+            if (!in.GetInt(count, Dataset::kCellCount))
+                return false;
+
+            records_.resize(count);
+            for (int k = 0, index = -1; k < count; ++k) {
+                if (!in.GetCell(index, records_[k].second, withProducts))
+                    return false;
+                records_[k].first = index;
+            }
+            return true;
+        }
+
+        bool ApplyRecords(const std::vector<Record> &records) {
+            return ApplyCellStates(*board_, this, records);
+        }
+
+        std::unique_ptr<GameBoard> board_;
+        std::vector<Record> records_;
+        int elapsedTime_ = 0;
+        int endTime_ = GameManagerConfig::kEndTime;
+        int scores_ = 0;
+        int commonDivisor_ = 1;
+        bool synchronized_ = false;
+    };
+
+    inline CellState CaptureCellState(const SpectatorView &view, const CellPosition cellPosition) {
+        return CaptureCellState(view.GetBoard(), cellPosition);
+    }
+
+    // The sending end: turns a running game into frames for SpectatorView. It steps a model of its own exactly as
+    // every view does and compares it with the game, so a frame lists only the cells the views would get wrong.
+    // That comparison reads the whole board, so encode from the simulation thread, not per rendered frame.
+    class SpectatorEncoder {
+    public:
+        explicit SpectatorEncoder(const int keyframeInterval = 900) : keyframeInterval_(keyframeInterval) {}
+
+        // Call after any tick that should be shown, typically every one; frame is replaced with its encoding.
+        void Encode(const GameManager &gameManager, std::vector<std::uint8_t> &frame) {
+            frame.clear();
+            const int ticks = gameManager.GetElapsedTime() - model_.elapsedTime_;
+            if (!model_.synchronized_ || keyframeRequested_ || ticks < 0 ||
+                gameManager.GetElapsedTime() - lastKeyframeTime_ >= keyframeInterval_) {
+                WriteKeyframe(gameManager, frame);
+                return;
+            }
+
+            // Only an action changes the shape of the board, and GameManager notes when one last did.
+            shapes_.clear();
+            if (gameManager.GetLastBoardChangeTime() > model_.elapsedTime_) {
+                CollectShapeChanges(gameManager);
+                model_.synchronized_ = model_.ApplyRecords(shapes_);
+            }
+
+            model_.Predict(ticks);
+            const int scoreCorrection = gameManager.GetScores() - model_.scores_;
+            model_.scores_ += scoreCorrection;
+            records_.clear();
+            CollectDifferences(gameManager);
+            if (ticks == 1 && shapes_.empty() && records_.empty() && scoreCorrection == 0) {
+                frame.push_back(static_cast<std::uint8_t>(Spectator::FrameType::kTick));
+                return;
+            }
+
+            // The shapes already match, so this only copies contents and cannot wake a skipped mining machine.
+            model_.synchronized_ = model_.synchronized_ && model_.ApplyRecords(records_);
+
+            frame.push_back(static_cast<std::uint8_t>(Spectator::FrameType::kDelta));
+            Dataset::PutVarint(frame, static_cast<std::uint64_t>(ticks));
+            Dataset::PutSigned(frame, scoreCorrection);
+            WriteRecords(frame, shapes_, false);
+            WriteRecords(frame, records_, true);
+        }
+
+        // The next frame will be a keyframe, e.g. for a spectator who just joined.
+        void RequestKeyframe() { keyframeRequested_ = true; }
+
+    private:
+        void WriteKeyframe(const GameManager &gameManager, std::vector<std::uint8_t> &frame) {
+            frame.push_back(static_cast<std::uint8_t>(Spectator::FrameType::kKeyframe));
+            Dataset::PutVarint(frame, static_cast<std::uint64_t>(gameManager.GetElapsedTime()));
+            Dataset::PutVarint(frame, static_cast<std::uint64_t>(gameManager.GetEndTime()));
+            Dataset::PutVarint(frame, static_cast<std::uint64_t>(gameManager.GetCommonDivisor()));
+            Dataset::PutVarint(frame, static_cast<std::uint64_t>(gameManager.GetScores()));
+            frame.push_back(gameManager.GetSkipDeadEntities() ? 1 : 0);
+
+            numbers_.clear();
+            records_.clear();
+            for (int index = 0; index < Dataset::kCellCount; ++index) {
+                const CellPosition position{index / GameManagerConfig::kBoardWidth,
+                                            index % GameManagerConfig::kBoardWidth};
+                const LayeredCell &layeredCell = gameManager.GetLayeredCell(position);
+                if (const auto *numberCell = dynamic_cast<const NumberCell *>(layeredCell.GetBackground().get())) {
+                    numbers_.emplace_back(index, numberCell->GetNumber());
+                }
+                if (layeredCell.GetForeground()) {
+                    records_.emplace_back(index, CaptureCellState(gameManager, position));
+                }
+            }
+
+            Dataset::PutVarint(frame, numbers_.size());
+            int previous = -1;
+            for (const auto &[index, number]: numbers_) {
+                Dataset::PutVarint(frame, static_cast<std::uint64_t>(index - previous - 1));
+                frame.push_back(static_cast<std::uint8_t>(number));
+                previous = index;
+            }
+            WriteRecords(frame, records_, true);
+
+            // Decoding our own keyframe is what builds the model, so it starts out exactly as every view does.
+            model_.Apply(frame.data(), frame.size());
+            lastKeyframeTime_ = gameManager.GetElapsedTime();
+            keyframeRequested_ = false;
+        }
+
+        void CollectDifferences(const GameManager &gameManager) {
+            for (int index = 0; index < Dataset::kCellCount; ++index) {
+                const CellPosition position{index / GameManagerConfig::kBoardWidth,
+                                            index % GameManagerConfig::kBoardWidth};
+                if (const CellState state = CaptureCellState(gameManager, position);
+                    state != CaptureCellState(model_, position)) {
+                    records_.emplace_back(index, state);
+                }
+            }
+        }
+
+        // New entities start out empty, so their shape is all a view needs to build them.
+        void CollectShapeChanges(const GameManager &gameManager) {
+            for (int index = 0; index < Dataset::kCellCount; ++index) {
+                const CellPosition position{index / GameManagerConfig::kBoardWidth,
+                                            index % GameManagerConfig::kBoardWidth};
+                const CellState state = CaptureCellState(gameManager, position);
+                const CellState modelState = CaptureCellState(model_, position);
+                if (state.kind != modelState.kind || state.direction != modelState.direction ||
+                    state.topLeft != modelState.topLeft) {
+                    shapes_.emplace_back(index, CellState{state.kind, state.direction, state.topLeft, {}});
+                }
+            }
+        }
+
+        static void WriteRecords(std::vector<std::uint8_t> &frame, const std::vector<SpectatorView::Record> &records,
+                                 const bool withProducts) {
+            Dataset::PutVarint(frame, records.size());
+            int previous = -1;
+            std::vector<std::uint8_t>::size_type size = 0;
+            for (const auto &[index, state]: records) {
+                Dataset::PutVarint(frame, static_cast<std::uint64_t>(index - previous - 1));
+                size = frame.size();
+                Dataset::PutCell(frame, index, state);
+                if (!withProducts) {
+                    frame.resize(size + 1);
+                }
+                previous = index;
+            }
+        }
+
+        int keyframeInterval_;
+        int lastKeyframeTime_ = 0;
+        bool keyframeRequested_ = false;
+        SpectatorView model_;
+        std::vector<SpectatorView::Record> shapes_;
+        std::vector<SpectatorView::Record> records_;
+        std::vector<std::pair<int, int>> numbers_;
+    };
+} // namespace Feis
+#endif
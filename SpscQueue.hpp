@@ -0,0 +1,45 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace Feis {
+    // Bounded lock-free queue for exactly one producer thread and one consumer thread. TryPush fails instead of
+    // waiting when the queue is full.
+    template<typename T, std::size_t kCapacity>
+    class SpscQueue {
+        static_assert((kCapacity & (kCapacity - 1)) == 0, "capacity must be a power of two");
+
+    public:
+        bool TryPush(const T &value) {
+            const std::size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) == kCapacity) {
+                return false;
+            }
+            items_[tail & (kCapacity - 1)] = value;
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool TryPop(T &value) {
+            const std::size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            value = items_[head & (kCapacity - 1)];
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        [[nodiscard]] bool IsEmpty() const {
+            return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::array<T, kCapacity> items_{};
+        alignas(64) std::atomic<std::size_t> head_{0};
+        alignas(64) std::atomic<std::size_t> tail_{0};
+    };
+} // namespace Feis
+#endif
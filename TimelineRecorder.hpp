@@ -0,0 +1,85 @@
+#ifndef TIMELINE_RECORDER_HPP
+#define TIMELINE_RECORDER_HPP
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "PDOGS.hpp"
+
+namespace Feis {
+    struct TimelineSample {
+        std::int32_t tick;
+        std::uint32_t deliveries;
+        std::uint32_t scoredDeliveries;
+        std::uint32_t productsInFlight;
+        std::uint32_t activeMachines;
+    };
+
+    // Keeps the last capacity ticks of deliveries, scored deliveries, products in flight and mining machines
+    // connected to the collection center. The ring is allocated once up front; Record only reads counters the
+    // engine already maintains, so calling it every tick costs a handful of loads and stores.
+    class TimelineRecorder {
+    public:
+        static constexpr std::uint32_t kBinaryMagic = 0x4c4d4954; // "TIML"
+
+        explicit TimelineRecorder(const std::size_t capacity = GameManagerConfig::kEndTime) : samples_(capacity) {}
+
+        // Call once after each GameManager::Update().
+        void Record(const GameManager &gameManager) {
+            const long long delivered = gameManager.GetDeliveredProductCount();
+            const long long scored = gameManager.GetScoredProductCount();
+
+            samples_[next_] = {gameManager.GetElapsedTime(), static_cast<std::uint32_t>(delivered - delivered_),
+                               static_cast<std::uint32_t>(scored - scored_),
+                               static_cast<std::uint32_t>(gameManager.GetProductsInFlight()),
+                               static_cast<std::uint32_t>(gameManager.GetConnectedMiningMachineCount())};
+            delivered_ = delivered;
+            scored_ = scored;
+
+            next_ = next_ + 1 == samples_.size() ? 0 : next_ + 1;
+            if (size_ < samples_.size()) {
+                size_ += 1;
+            }
+        }
+
+        [[nodiscard]] std::size_t GetSize() const { return size_; }
+
+        // Oldest first.
+        [[nodiscard]] const TimelineSample &GetSample(const std::size_t i) const {
+            const std::size_t start = size_ < samples_.size() ? 0 : next_;
+            const std::size_t index = start + i;
+            return samples_[index < samples_.size() ? index : index - samples_.size()];
+        }
+
+        void WriteCsv(std::ostream &out) const {
+            out << "tick,deliveries,scored_deliveries,products_in_flight,active_machines\n";
+            for (std::size_t i = 0; i < size_; ++i) {
+                const auto &sample = GetSample(i);
+                out << sample.tick << ',' << sample.deliveries << ',' << sample.scoredDeliveries << ','
+                    << sample.productsInFlight << ',' << sample.activeMachines << '\n';
+            }
+        }
+
+        // Magic, sample count, then the raw samples in host byte order, oldest first.
+        void WriteBinary(std::ostream &out) const {
+            const auto count = static_cast<std::uint32_t>(size_);
+            out.write(reinterpret_cast<const char *>(&kBinaryMagic), sizeof(kBinaryMagic));
+            out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+
+            const std::size_t start = size_ < samples_.size() ? 0 : next_;
+            const std::size_t firstRun = std::min(size_, samples_.size() - start);
+            out.write(reinterpret_cast<const char *>(&samples_[start]),
+                      static_cast<std::streamsize>(firstRun * sizeof(TimelineSample)));
+            out.write(reinterpret_cast<const char *>(samples_.data()),
+                      static_cast<std::streamsize>((size_ - firstRun) * sizeof(TimelineSample)));
+        }
+
+    private:
+        std::vector<TimelineSample> samples_;
+        std::size_t next_ = 0;
+        std::size_t size_ = 0;
+        long long delivered_ = 0;
+        long long scored_ = 0;
+    };
+} // namespace Feis
+#endif
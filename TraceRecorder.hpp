@@ -0,0 +1,176 @@
+#ifndef TRACE_RECORDER_HPP
+#define TRACE_RECORDER_HPP
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ProfilePhase.hpp"
+
+namespace Feis {
+    struct TraceEvent {
+        std::uint64_t begin;
+        std::uint64_t end;
+        ProfilePhase phase;
+    };
+
+    // Single producer (the thread that owns it), single consumer (the flusher). Full means the event is dropped
+    // and counted, never that the producer waits.
+    class TraceBuffer {
+    public:
+        static constexpr std::size_t kCapacity = 1 << 16;
+
+        explicit TraceBuffer(const int threadIndex) : events_(kCapacity), threadIndex_(threadIndex) {}
+
+        void Push(const TraceEvent &event) {
+            const std::size_t head = head_.load(std::memory_order_relaxed);
+            if (head - tail_.load(std::memory_order_acquire) == kCapacity) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            events_[head % kCapacity] = event;
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+        template<typename TFunction>
+        void Drain(TFunction function) {
+            const std::size_t head = head_.load(std::memory_order_acquire);
+            std::size_t tail = tail_.load(std::memory_order_relaxed);
+            for (; tail != head; ++tail) {
+                function(events_[tail % kCapacity]);
+            }
+            tail_.store(tail, std::memory_order_release);
+        }
+
+        [[nodiscard]] int GetThreadIndex() const { return threadIndex_; }
+
+        [[nodiscard]] std::size_t GetDroppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+    private:
+        std::vector<TraceEvent> events_;
+        int threadIndex_;
+        std::atomic<std::size_t> head_{0};
+        std::atomic<std::size_t> tail_{0};
+        std::atomic<std::size_t> dropped_{0};
+    };
+
+    // Collects profiled scopes as Chrome trace events ("X" complete events, microseconds) and streams them to a
+    // JSON file that chrome://tracing and Perfetto open directly. Recording threads only ever touch their own
+    // buffer; a background thread drains all buffers every flush interval and does all of the formatting and I/O.
+    class TraceRecorder {
+    public:
+        static TraceRecorder &Instance() {
+            static TraceRecorder recorder;
+            return recorder;
+        }
+
+        TraceRecorder(const TraceRecorder &) = delete;
+
+        TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+        ~TraceRecorder() { Stop(); }
+
+        bool Start(const std::string &filename,
+                   const std::chrono::milliseconds flushInterval = std::chrono::milliseconds(50)) {
+            if (flusher_.joinable()) {
+                return false;
+            }
+            out_.open(filename, std::ios::trunc);
+            if (!out_) {
+                return false;
+            }
+            out_ << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            firstEvent_ = true;
+            stopping_ = false;
+            flusher_ = std::thread([this, flushInterval] {
+                std::unique_lock lock(flushMutex_);
+                while (!stopping_) {
+                    wakeUp_.wait_for(lock, flushInterval, [this] { return stopping_; });
+                    Flush();
+                }
+            });
+            enabled_.store(true, std::memory_order_release);
+            return true;
+        }
+
+        // Writes whatever is still buffered and closes the file.
+        void Stop() {
+            if (!flusher_.joinable()) {
+                return;
+            }
+            enabled_.store(false, std::memory_order_release);
+            {
+                std::lock_guard lock(flushMutex_);
+                stopping_ = true;
+            }
+            wakeUp_.notify_one();
+            flusher_.join();
+
+            std::lock_guard lock(buffersMutex_);
+            for (const auto &buffer: buffers_) {
+                out_ << (firstEvent_ ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                     << buffer->GetThreadIndex() << ",\"args\":{\"name\":\"thread " << buffer->GetThreadIndex()
+                     << " (" << buffer->GetDroppedCount() << " dropped)\"}}";
+                firstEvent_ = false;
+            }
+            out_ << "\n]}\n";
+            out_.close();
+        }
+
+        [[nodiscard]] bool IsEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+        static std::uint64_t Now() {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                      std::chrono::steady_clock::now().time_since_epoch())
+                                                      .count());
+        }
+
+        void Record(const ProfilePhase phase, const std::uint64_t begin, const std::uint64_t end) {
+            thread_local TraceBuffer *buffer = nullptr;
+            if (buffer == nullptr) {
+                buffer = Register();
+            }
+            buffer->Push({begin, end, phase});
+        }
+
+    private:
+        TraceRecorder() = default;
+
+        TraceBuffer *Register() {
+            std::lock_guard lock(buffersMutex_);
+            buffers_.push_back(std::make_unique<TraceBuffer>(static_cast<int>(buffers_.size())));
+            return buffers_.back().get();
+        }
+
+        void Flush() {
+            std::lock_guard lock(buffersMutex_);
+            for (const auto &buffer: buffers_) {
+                buffer->Drain([this, &buffer](const TraceEvent &event) {
+                    out_ << (firstEvent_ ? "" : ",") << "\n{\"name\":\"" << GetProfilePhaseName(event.phase)
+                         << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->GetThreadIndex()
+                         << ",\"ts\":" << event.begin / 1000 << "." << event.begin % 1000 / 100
+                         << ",\"dur\":" << (event.end - event.begin) / 1000 << "."
+                         << (event.end - event.begin) % 1000 / 100 << "}";
+                    firstEvent_ = false;
+                });
+            }
+            out_.flush();
+        }
+
+        std::atomic<bool> enabled_{false};
+        std::mutex buffersMutex_;
+        std::vector<std::unique_ptr<TraceBuffer>> buffers_;
+        std::mutex flushMutex_;
+        std::condition_variable wakeUp_;
+        bool stopping_ = false;
+        std::thread flusher_;
+        std::ofstream out_;
+        bool firstEvent_ = true;
+    };
+} // namespace Feis
+#endif
@@ -0,0 +1,38 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+#include <array>
+#include <atomic>
+
+namespace Feis {
+    // Hands whole values from one writer thread to one reader thread without locks and without either side ever
+    // waiting: the writer fills its back buffer and swaps it into the middle, the reader swaps the middle out for
+    // its front buffer when something new is there. The reader may skip values, never sees a half-written one.
+    template<typename T>
+    class TripleBuffer {
+    public:
+        // Writer side.
+        T &GetBack() { return buffers_[back_]; }
+
+        void Publish() { back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndexMask; }
+
+        // Reader side. Returns the newest published value, or the one returned last time if nothing is new.
+        const T &AcquireFront() {
+            if (middle_.load(std::memory_order_relaxed) & kFresh) {
+                front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+            }
+            return buffers_[front_];
+        }
+
+        [[nodiscard]] bool HasFresh() const { return (middle_.load(std::memory_order_relaxed) & kFresh) != 0; }
+
+    private:
+        static constexpr int kFresh = 4;
+        static constexpr int kIndexMask = 3;
+
+        std::array<T, 3> buffers_{};
+        int back_ = 0;
+        std::atomic<int> middle_{1};
+        int front_ = 2;
+    };
+} // namespace Feis
+#endif
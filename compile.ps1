@@ -1,2 +1,6 @@
 g++ -IC:\SFML-3.0.0\include -c main.cpp -o main.o
-g++ -LC:\SFML-3.0.0\lib .\main.o -o game.exe -lmingw32 -lsfml-graphics -lsfml-window -lsfml-system -mwindows
\ No newline at end of file
+g++ -LC:\SFML-3.0.0\lib .\main.o -o game.exe -lmingw32 -lsfml-graphics -lsfml-window -lsfml-system -mwindows
+g++ -O3 -shared -o pdogs_env.dll PDOGSEnv.cpp
+g++ -O3 -o batch_check.exe BatchCheck.cpp
+g++ -O3 -o flow_check.exe FlowCheck.cpp
+g++ -O3 -o allocation_check.exe AllocationCheck.cpp
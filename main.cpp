@@ -1,10 +1,25 @@
-#include <fstream>
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <memory>
 #include <queue>
+#include <thread>
 
 #include <SFML/Graphics.hpp>
 #include <SFML/Window.hpp>
+#include "ActionJournal.hpp"
 #include "GameRenderer.hpp"
+#include "GameSnapshot.hpp"
+#include "ReplayFile.hpp"
+#include "SimulationClock.hpp"
+#include "SpscQueue.hpp"
+#include "TripleBuffer.hpp"
+#ifdef PDOGS_ENABLE_TRACING
+#include "TraceRecorder.hpp"
+#endif
+#ifdef PDOGS_ENABLE_PROFILING
+#include <fstream>
+#endif
 
 using namespace Feis;
 
@@ -232,16 +247,6 @@ private:
 
 // end
 
-void Save(std::queue<PlayerAction> playerActionHistory, const std::string &filename) {
-    std::ofstream outFile(filename);
-    while (!playerActionHistory.empty()) {
-        const auto &[type, cellPosition] = playerActionHistory.front();
-        outFile << cellPosition.row << " " << cellPosition.col << " "
-                << static_cast<int>(type) << std::endl;
-        playerActionHistory.pop();
-    }
-}
-
 int main(int, char **) {
     auto mode = sf::VideoMode(sf::Vector2u(1280, 1024));
 
@@ -251,7 +256,21 @@ int main(int, char **) {
 
     GamePlayer player;
 
-    GameManager gameManager(&player, 1, 20);
+    constexpr int kCommonDivisor = 1;
+    constexpr unsigned int kSeed = 20;
+    ReplayRecorder replayRecorder(&player, kCommonDivisor, kSeed);
+
+    // Every decision is journaled as it happens. The journal of the previous session is turned into a replay
+    // first, since starting this one truncates it; after a crash that replay holds all but the last second.
+    RecoveredJournal previousJournal{};
+    if (ReadJournal("gameplay.pdjn", previousJournal)) {
+        Replay::WriteFile("gameplay-recovered.pdrp", RecoverReplay(previousJournal));
+    }
+    const auto actionJournal = std::make_unique<ActionJournal>("gameplay.pdjn", kCommonDivisor, kSeed);
+    actionJournal->Start();
+    JournalingGamePlayer journalingPlayer(&replayRecorder, actionJournal.get());
+
+    GameManager gameManager(&journalingPlayer, kCommonDivisor, kSeed);
 
     const std::map<sf::Keyboard::Key, PlayerActionType> playerActionKeyboardMap = {
             {sf::Keyboard::Key::J, PlayerActionType::BuildLeftOutMiningMachine},
@@ -273,7 +292,61 @@ int main(int, char **) {
 
     GameRenderer<GameRendererConfig> gameRenderer(&window);
 
-    std::queue<PlayerAction> playerActionHistory;
+    // The game runs on its own thread, by default at kFPS ticks per second. Clicks reach the player through a
+    // lock-free queue and the window draws whichever snapshot was published last, so neither side ever waits for
+    // the other. Space pauses, Period steps one tick, Equal and Hyphen change the speed. F4 saves the replay so
+    // far; the simulation thread writes it, since only it may touch the recorder.
+    const auto snapshots = std::make_unique<TripleBuffer<GameSnapshot>>();
+    SpscQueue<PlayerAction, 256> pendingPlayerActions;
+    SimulationClock simulationClock(std::chrono::nanoseconds(1000000000 / GameRendererConfig::kFPS));
+    std::atomic<bool> running{true};
+    std::atomic<bool> saveRequested{false};
+
+    snapshots->GetBack().Capture(gameManager);
+    snapshots->Publish();
+
+#ifdef PDOGS_ENABLE_TRACING
+    // Every profiled scope of the session, for chrome://tracing or Perfetto.
+    TraceRecorder::Instance().Start("gameplay-trace.json");
+#endif
+
+    std::thread simulationThread([&] {
+        const auto productMotionTracker = std::make_unique<ProductMotionTracker>();
+
+        while (running.load(std::memory_order_relaxed)) {
+            if (saveRequested.exchange(false, std::memory_order_relaxed)) {
+                replayRecorder.Save("gameplay.pdrp", gameManager);
+            }
+
+            if (gameManager.IsGameOver()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                continue;
+            }
+
+            const int ticks = simulationClock.TakeDueTicks(std::chrono::steady_clock::now());
+            if (ticks == 0) {
+                std::this_thread::sleep_until(simulationClock.GetNextTickTime());
+                continue;
+            }
+
+            for (int k = 0; k < ticks && !gameManager.IsGameOver(); ++k) {
+                PlayerAction playerAction{};
+                while (pendingPlayerActions.TryPop(playerAction)) {
+                    player.EnqueueAction(playerAction);
+                }
+                gameManager.Update();
+            }
+
+            GameSnapshot &snapshot = snapshots->GetBack();
+            snapshot.Capture(gameManager);
+            if (simulationClock.IsSlowed() && ticks == 1) {
+                productMotionTracker->Update(gameManager, &snapshot.GetProductMotion());
+            } else {
+                snapshot.GetProductMotion().valid = false;
+            }
+            snapshots->Publish();
+        }
+    });
 
     while (window.isOpen()) {
         while (auto event = window.pollEvent()) {
@@ -281,9 +354,7 @@ int main(int, char **) {
                 if (const CellPosition mouseCellPosition = GetMouseCellPosition(window);
                     IsWithinBoard(mouseCellPosition)) {
                     if (mouseEvent->button == sf::Mouse::Button::Left) {
-                        auto playerAction = PlayerAction{playerActionType, mouseCellPosition};
-                        player.EnqueueAction(playerAction);
-                        playerActionHistory.push(playerAction);
+                        pendingPlayerActions.TryPush(PlayerAction{playerActionType, mouseCellPosition});
                     }
                 }
             }
@@ -292,7 +363,15 @@ int main(int, char **) {
                 if (playerActionKeyboardMap.count(keyboardEvent->code)) {
                     playerActionType = playerActionKeyboardMap.at(keyboardEvent->code);
                 } else if (keyboardEvent->code == sf::Keyboard::Key::F4) {
-                    Save(playerActionHistory, "gameplay.txt");
+                    saveRequested.store(true, std::memory_order_relaxed);
+                } else if (keyboardEvent->code == sf::Keyboard::Key::Space) {
+                    simulationClock.TogglePause();
+                } else if (keyboardEvent->code == sf::Keyboard::Key::Period) {
+                    simulationClock.Step();
+                } else if (keyboardEvent->code == sf::Keyboard::Key::Equal) {
+                    simulationClock.Faster();
+                } else if (keyboardEvent->code == sf::Keyboard::Key::Hyphen) {
+                    simulationClock.Slower();
                 }
             }
             if (event->is<sf::Event::Closed>()) {
@@ -300,8 +379,20 @@ int main(int, char **) {
             }
         }
 
-        gameManager.Update();
-
-        gameRenderer.Render(gameManager);
+        const GameSnapshot &snapshot = snapshots->AcquireFront();
+        gameRenderer.Render(snapshot, &snapshot.GetProductMotion(),
+                            simulationClock.GetInterpolation(std::chrono::steady_clock::now()));
     }
+
+    running.store(false, std::memory_order_relaxed);
+    simulationThread.join();
+
+#ifdef PDOGS_ENABLE_TRACING
+    TraceRecorder::Instance().Stop();
+#endif
+#ifdef PDOGS_ENABLE_PROFILING
+    // The window has no console, so the per-phase breakdown goes next to the replay and the journal.
+    std::ofstream profileSummary("gameplay-profile.txt", std::ios::trunc);
+    Profiler::Instance().PrintSummary(profileSummary);
+#endif
 }